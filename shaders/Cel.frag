@@ -5,14 +5,9 @@ in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
-uniform vec3 lightColor;
-uniform vec3 objectColor;
-uniform float time;
-
-uniform sampler2D texture_diffuse1;
-uniform bool hasTexture;
+#include "include/constants.glsl"
+#include "include/material.glsl"
+#include "include/lighting.glsl"
 
 void main() {
     // Normalize vectors
@@ -21,15 +16,10 @@ void main() {
     vec3 viewDir = normalize(viewPos - FragPos);
 
     // Choose base color from texture or fallback to objectColor
-    vec3 finalColor;
-    if (hasTexture) {
-        finalColor = texture(texture_diffuse1, TexCoords).rgb;
-    } else {
-        finalColor = objectColor;
-    }
+    vec3 finalColor = baseColor(TexCoords);
 
     // Quantized diffuse lighting
-    float diff = max(dot(norm, lightDir), 0.0);
+    float diff = lambert(norm, lightDir);
     vec3 toonColor;
     if (diff > 0.8) toonColor = finalColor;
     else if (diff > 0.5) toonColor = finalColor * 0.8;
@@ -38,8 +28,7 @@ void main() {
 
     // Quantized specular
     float specularStrength = 0.5;
-    vec3 reflectDir = reflect(-lightDir, norm);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 16.0);
+    float spec = phongSpecular(norm, lightDir, viewDir, 16.0);
     spec = spec > 0.6 ? 1.0 : 0.0;
 
     // Rim lighting
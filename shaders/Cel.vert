@@ -7,13 +7,14 @@ out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "include/constants.glsl"
+#include "include/vertex_decode.glsl"
 
 void main() {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
+    vec3 position = decodePosition(aPos);
+    vec3 normal = decodeNormal(aNormal);
+    FragPos = vec3(model * vec4(position, 1.0));
+    Normal = mat3(normalMatrix) * normal;
     TexCoords = aTexCoords;
     
     gl_Position = projection * view * vec4(FragPos, 1.0);
@@ -5,30 +5,24 @@ in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
-uniform vec3 lightColor;
-uniform vec3 objectColor;
-uniform sampler2D u_noise_texture;    // Noise texture
-uniform float time;                   // Keep this uniform even if we don't use it
+#include "include/constants.glsl"
+#include "include/lighting.glsl"
 
-// Enhanced grayscale shader parameters with stronger hatching
-uniform vec3 u_light_color = vec3(1.0, 1.0, 1.0);      
-uniform vec3 u_dark_color = vec3(0.15, 0.15, 0.15);       
-uniform vec3 u_mid_color = vec3(0.75, 0.75, 0.75);     // Lighter mid-color
-uniform float u_stroke_density = 200.0;                // Higher density for more prominent lines
-uniform float u_line_thickness = 0.25;                 // Thicker lines for visibility
-uniform float u_outline_thickness = 0.7;               
-uniform float u_tone_strength = 0.5;                   // Lower tone strength to make hatching more visible
-uniform float u_detail_enhancement = 4.0;    
-uniform float u_edge_contrast = 2.0;            
-uniform float u_stroke_randomness = 0.5;              
-uniform float u_hatching_opacity = 0.8;                // Higher opacity for stronger hatching
-uniform float u_gradient_strength = 3.2;               // Steeper gradient
+uniform sampler2D u_noise_texture;    // Noise texture
 
-uniform float ambientStrength;
-uniform float specularStrength;
-uniform float shininess;
+// Enhanced grayscale shader parameters with stronger hatching, constant so they fold into the code
+const vec3 u_light_color = vec3(1.0, 1.0, 1.0);      
+const vec3 u_dark_color = vec3(0.15, 0.15, 0.15);       
+const vec3 u_mid_color = vec3(0.75, 0.75, 0.75);     // Lighter mid-color
+const float u_stroke_density = 200.0;                // Higher density for more prominent lines
+const float u_line_thickness = 0.25;                 // Thicker lines for visibility
+const float u_outline_thickness = 0.7;               
+const float u_tone_strength = 0.5;                   // Lower tone strength to make hatching more visible
+const float u_detail_enhancement = 4.0;    
+const float u_edge_contrast = 2.0;            
+const float u_stroke_randomness = 0.5;              
+const float u_hatching_opacity = 0.8;                // Higher opacity for stronger hatching
+const float u_gradient_strength = 3.2;               // Steeper gradient
 
 // Generate random value based on position
 float random(vec2 st) {
@@ -51,8 +45,14 @@ float lineMask(float coord, float thickness, vec2 pos) {
     float lineCenter = fract(coord + noiseOffset + waviness);
     
     // Create uneven line edges for hand-drawn feel 
+#if QUALITY >= 1
     float edgeNoise1 = texture(u_noise_texture, pos * 80.0).r * 0.06 * u_stroke_randomness;
     float edgeNoise2 = texture(u_noise_texture, pos * 90.0).r * 0.06 * u_stroke_randomness;
+#else
+    // Average edge noise, without the two lookups
+    float edgeNoise1 = 0.03 * u_stroke_randomness;
+    float edgeNoise2 = edgeNoise1;
+#endif
     
     return smoothstep(0.0, thicknessVar * 0.5 + edgeNoise1, lineCenter) * 
            smoothstep(thicknessVar * 1.5 + edgeNoise2, thicknessVar, lineCenter);
@@ -65,13 +65,12 @@ void main() {
     vec3 lightDir = normalize(lightPos - fragPos);
     vec3 viewDir = normalize(viewPos - fragPos);
 
-    vec3 ambient = ambientStrength * lightColor;
+    vec3 ambient = ambientLight();
     
     // Calculate diffuse factor
-    float diffuseFactor = max(dot(normal, lightDir), 0.0);
+    float diffuseFactor = lambert(normal, lightDir);
 
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    float spec = phongSpecular(normal, lightDir, viewDir, shininess);
     vec3 specular = specularStrength * spec * lightColor;
 
     float totalLightingFactor = (ambient.r + diffuseFactor + specular.r);
@@ -134,17 +133,23 @@ void main() {
                               u_line_thickness * (0.85 + noise2 * 0.3), screenPos * 2.3);
     float dLine3 = 1.0 - lineMask(dot(screenPos, rotateUV3) * densityVar3, 
                               u_line_thickness * (1.1 + noise3 * 0.15), screenPos * 3.7);
+#if QUALITY >= 2
     float dLine4 = 1.0 - lineMask(dot(screenPos, rotateUV4) * densityVar4, 
                               u_line_thickness * (0.8 + noise1 * 0.4), screenPos * 5.2);
     float dLine5 = 1.0 - lineMask(dot(screenPos, rotateUV5) * densityVar5, 
                               u_line_thickness * (1.05 + noise2 * 0.25), screenPos * 6.1);
+#else
+    // Lower tiers hatch with three line sets instead of five
+    float dLine4 = dLine2;
+    float dLine5 = dLine1;
+#endif
     
     // Add occasional disruptive strokes in different directions at random locations
     vec2 distortedPos = screenPos + vec2(noise3 - 0.5, noise1 - 0.5) * u_stroke_randomness * 0.15;
     float disruption = 0.0;
     
     // Create random disruption strokes only in certain areas
-    if(noise1 > 0.85) {
+    if(QUALITY >= 1 && noise1 > 0.85) {
         float randAngle = noise2 * 3.14159 * 2.0; // Random direction
         vec2 disruptDir = vec2(cos(randAngle), sin(randAngle));
         disruption = 1.0 - lineMask(dot(distortedPos, disruptDir) * u_stroke_density * 1.2, 
@@ -5,21 +5,14 @@ in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
 
-// Standard Phong-style lighting (from standard.frag)
-uniform vec3 lightPos;
-uniform vec3 viewPos;
-uniform vec3 lightColor;
-uniform vec3 ambientStrength;
-
-uniform bool hasTexture;
+#include "include/constants.glsl"
+#include "include/material.glsl"
 
 // Paper & noise textures
 uniform sampler2D u_noise_texture;  
 uniform sampler2D u_paper_texture;
-uniform sampler2D texture_diffuse1;
 
 // Watercolor palette
-uniform vec3 objectColor;
 uniform vec3 u_color1;
 uniform vec3 u_color2;
 uniform vec3 u_color3;
@@ -62,11 +55,16 @@ void main() {
 
     // Base color or texture 
     // vec3 colBase = layer1colr(clamp(norm.y * 0.5 + 0.5 + (noise1 - 0.5) * 0.1, 0.0, 1.0));
-    vec3 colBase = hasTexture ? texture(texture_diffuse1, uv).rgb : objectColor;
+    vec3 colBase = baseColor(uv);
     float paper = texture(u_paper_texture, uv * 3.0).r;
     float noise1 = noisetex(2.5, uv);
     float noise2 = noisetex(8.0, uv);
+#if QUALITY >= 1
     float noise3 = noisetex(20.0, uv);
+#else
+    // The finest noise is barely visible; low quality reuses the middle one
+    float noise3 = noise2;
+#endif
     float hue = clamp(norm.y * 0.5 + 0.5 + 0.1 * (noise1 - 0.5), 0.0, 1.0);
     vec3 col = ramp_col(hue);
     if (hue < 1/3.0)
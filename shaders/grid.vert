@@ -2,14 +2,13 @@
 
 layout(location = 0) in vec3 aPos;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "include/constants.glsl"
+#include "include/vertex_decode.glsl"
 
 out vec3 worldPos;
 
 void main() {
-    vec4 worldPosition = model * vec4(aPos, 1.0);
+    vec4 worldPosition = model * vec4(decodePosition(aPos), 1.0);
     worldPos = worldPosition.xyz;
     gl_Position = projection * view * worldPosition;
 }
@@ -0,0 +1,28 @@
+// Per-frame values shared by every program, filled by UniformRing (src/uniform_ring.h)
+layout(std140) uniform FrameConstants {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    float ambientStrength;
+    vec3 lightPos;
+    float specularStrength;
+    vec3 lightColor;
+    float shininess;
+    float time;
+};
+
+// Per-object values; normalMatrix is the inverse transpose of model, computed on the CPU
+layout(std140) uniform ObjectConstants {
+    mat4 model;
+    mat4 normalMatrix;
+};
+
+// Permutation defines added by ShaderVariants (src/shader_variants.h); the defaults suit shaders
+// loaded on their own
+#ifndef HAS_TEXTURE
+#define HAS_TEXTURE 0
+#endif
+// 0 low, 1 medium, 2 high
+#ifndef QUALITY
+#define QUALITY 2
+#endif
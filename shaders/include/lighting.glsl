@@ -0,0 +1,14 @@
+// Terms of the one light in FrameConstants
+
+vec3 ambientLight() {
+    return ambientStrength * lightColor;
+}
+
+float lambert(vec3 normal, vec3 lightDir) {
+    return max(dot(normal, lightDir), 0.0);
+}
+
+float phongSpecular(vec3 normal, vec3 lightDir, vec3 viewDir, float exponent) {
+    vec3 reflectDir = reflect(-lightDir, normal);
+    return pow(max(dot(viewDir, reflectDir), 0.0), exponent);
+}
@@ -0,0 +1,26 @@
+uniform vec3 objectColor;
+uniform sampler2D texture_diffuse1;
+
+// The model's diffuse textures as one array: a layer each, or a rectangle of a shared layer
+uniform sampler2DArray materialTextures;
+uniform bool useMaterialArray;
+uniform float materialLayer;
+uniform vec4 materialRect;
+
+vec3 diffuseTexture(vec2 uv) {
+    if (!useMaterialArray)
+        return texture(texture_diffuse1, uv).rgb;
+    // Wrap inside the rectangle; gradients of the unwrapped coordinates keep the seam from picking the smallest mip
+    vec2 scale = materialRect.zw;
+    vec3 coord = vec3(materialRect.xy + fract(uv) * scale, materialLayer);
+    return textureGrad(materialTextures, coord, dFdx(uv) * scale, dFdy(uv) * scale).rgb;
+}
+
+// The diffuse texture, or objectColor in variants without one
+vec3 baseColor(vec2 uv) {
+#if HAS_TEXTURE
+    return diffuseTexture(uv);
+#else
+    return objectColor;
+#endif
+}
@@ -0,0 +1,19 @@
+// Quantized meshes store positions within their bounds and octahedral normals
+uniform vec3 positionScale = vec3(1.0);
+uniform vec3 positionOffset = vec3(0.0);
+uniform bool octahedralNormals = false;
+
+vec3 decodeOctahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+    return normalize(n);
+}
+
+vec3 decodePosition(vec3 position) {
+    return position * positionScale + positionOffset;
+}
+
+vec3 decodeNormal(vec3 normal) {
+    return octahedralNormals ? decodeOctahedral(normal.xy) : normal;
+}
@@ -4,18 +4,12 @@ out vec4 FragColor;
 in vec3 FragPos;
 in vec3 Normal;
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
-uniform vec3 lightColor;
-uniform vec3 objectColor;
+#include "include/constants.glsl"
+#include "include/material.glsl"
+#include "include/lighting.glsl"
 
-in vec2 TexCoords;  
-uniform sampler2D texture_diffuse1; 
-uniform bool hasTexture;   
+in vec2 TexCoords;
 
-uniform float ambientStrength;
-uniform float specularStrength;
-uniform float shininess;
 
 void main() {
     // Use a different lighting approach - light based on view direction
@@ -24,23 +18,17 @@ void main() {
     vec3 lightDir = normalize(lightPos - FragPos);
     
     // Ambient
-    vec3 ambient = ambientStrength * lightColor;
+    vec3 ambient = ambientLight();
     
     // Diffuse
-    float diff = max(dot(norm, lightDir), 0.0);
+    float diff = lambert(norm, lightDir);
     vec3 diffuse = diff * lightColor;
     
     // Specular
-    vec3 reflectDir = reflect(-lightDir, norm);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
+    float spec = phongSpecular(norm, lightDir, viewDir, 32.0);
     vec3 specular = specularStrength * spec * lightColor;
 
-    vec3 finalColor;
-    if (hasTexture) {
-        finalColor = texture(texture_diffuse1, TexCoords).rgb;
-    } else {
-        finalColor = objectColor;
-    }
+    vec3 finalColor = baseColor(TexCoords);
     
     // finalColor = objectColor;
     // finalColor 
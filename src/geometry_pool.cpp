@@ -0,0 +1,55 @@
+#include "geometry_pool.h"
+
+#include <iostream>
+
+namespace {
+
+// Starting sizes; the arenas double from there when a model needs more
+const size_t VERTEX_ARENA_CAPACITY = 16 * 1024 * 1024;
+const size_t INDEX_ARENA_CAPACITY = 8 * 1024 * 1024;
+
+void reportArena(const char* name, const ArenaStats& stats) {
+    std::cout << name << " arena: " << stats.used / 1024 << " KB used of " << stats.capacity / 1024 << " KB in "
+              << stats.allocations << " ranges, " << stats.freeBlocks << " free blocks, "
+              << static_cast<int>(stats.fragmentation() * 100.0f) << "% fragmented" << std::endl;
+}
+
+} // namespace
+
+GeometryPool::GeometryPool()
+    : vertices(VERTEX_ARENA_CAPACITY, "vertex arena"), indices(INDEX_ARENA_CAPACITY, "index arena") {}
+
+GeometryPool& GeometryPool::shared() {
+    static GeometryPool pool;
+    return pool;
+}
+
+void GeometryPool::bindVertexArray(GLuint id) {
+    if (id == boundArray)
+        return;
+    glBindVertexArray(id);
+    boundArray = id;
+}
+
+void GeometryPool::unbindVertexArray() {
+    bindVertexArray(0);
+}
+
+void GeometryPool::defragmentIfNeeded(float maxFragmentation) {
+    if (vertices.stats().fragmentation() > maxFragmentation)
+        vertices.defragment();
+    if (indices.stats().fragmentation() > maxFragmentation)
+        indices.defragment();
+}
+
+void GeometryPool::report() const {
+    reportArena("Vertex", vertices.stats());
+    reportArena("Index", indices.stats());
+}
+
+void GeometryPool::shutdown() {
+    unbindVertexArray();
+    formatArrays.clear();
+    vertices.reset();
+    indices.reset();
+}
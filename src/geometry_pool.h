@@ -0,0 +1,72 @@
+#ifndef GEOMETRY_POOL_H
+#define GEOMETRY_POOL_H
+
+#include "gpu_arena.h"
+
+#include <GL/glew.h>
+
+#include <map>
+#include <typeindex>
+#include <typeinfo>
+
+// The vertex and index arenas every Mesh allocates from. Meshes of the same vertex format share
+// one vertex array whose attributes start at offset 0 of the vertex arena; each draw picks its
+// mesh with a base vertex and an index offset. GL thread only.
+class GeometryPool {
+public:
+    static GeometryPool& shared();
+
+    GpuArena vertices;
+    GpuArena indices;
+
+    // Vertex array for Format over the arenas, set up again whenever an arena buffer was replaced.
+    // Leaves it bound.
+    template <typename Format>
+    static GLuint vertexArray() {
+        GeometryPool& pool = shared();
+        FormatArray& entry = pool.formatArrays[std::type_index(typeid(Format))];
+        if (!entry.vertexArray)
+            entry.vertexArray = GlVertexArray::create("format vertex array");
+        pool.bindVertexArray(entry.vertexArray.id());
+        if (entry.generation != pool.generation() || !entry.ready) {
+            glBindBuffer(GL_ARRAY_BUFFER, pool.vertices.buffer());
+            Format::setup(0);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.indices.buffer());
+            entry.generation = pool.generation();
+            entry.ready = true;
+        }
+        return entry.vertexArray.id();
+    }
+
+    // Changes with every replaced arena buffer
+    unsigned int generation() const { return vertices.generation() + indices.generation(); }
+
+    // Binds a vertex array unless it is already bound. Draws of consecutive meshes that share a
+    // format then bind it only once; unbindVertexArray() ends such a run.
+    void bindVertexArray(GLuint id);
+    void unbindVertexArray();
+
+    // Defragments an arena once this share of its free space is scattered outside the largest block
+    void defragmentIfNeeded(float maxFragmentation = 0.5f);
+
+    // Prints usage and fragmentation of both arenas
+    void report() const;
+
+    // Deletes the arena buffers and shared vertex arrays before the GL context goes away. Every
+    // mesh must have been destroyed first.
+    void shutdown();
+
+private:
+    struct FormatArray {
+        GlVertexArray vertexArray;
+        unsigned int generation = 0;
+        bool ready = false;
+    };
+
+    std::map<std::type_index, FormatArray> formatArrays;
+    GLuint boundArray = 0;
+
+    GeometryPool();
+};
+
+#endif
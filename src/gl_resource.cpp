@@ -0,0 +1,99 @@
+#include "gl_resource.h"
+
+#include <iostream>
+
+namespace {
+
+const char* TYPE_NAMES[] = {"Buffers", "Vertex arrays", "Textures", "Programs"};
+
+} // namespace
+
+GlResourceRegistry& GlResourceRegistry::shared() {
+    static GlResourceRegistry registry;
+    return registry;
+}
+
+void GlResourceRegistry::created(GlResourceType type, GLuint id, const char* label) {
+    objects[static_cast<int>(type)][id] = {label, 0};
+}
+
+void GlResourceRegistry::destroyed(GlResourceType type, GLuint id) {
+    objects[static_cast<int>(type)].erase(id);
+}
+
+void GlResourceRegistry::setBytes(GlResourceType type, GLuint id, size_t bytes) {
+    auto found = objects[static_cast<int>(type)].find(id);
+    if (found != objects[static_cast<int>(type)].end())
+        found->second.bytes = bytes;
+}
+
+size_t GlResourceRegistry::liveBytes(GlResourceType type) const {
+    size_t bytes = 0;
+    for (const auto& object : objects[static_cast<int>(type)])
+        bytes += object.second.bytes;
+    return bytes;
+}
+
+size_t GlResourceRegistry::bytes(GlResourceType type, GLuint id) const {
+    auto found = objects[static_cast<int>(type)].find(id);
+    return found != objects[static_cast<int>(type)].end() ? found->second.bytes : 0;
+}
+
+void GlResourceRegistry::report() const {
+    for (int type = 0; type < static_cast<int>(GlResourceType::Count); type++) {
+        std::cout << TYPE_NAMES[type] << ": " << objects[type].size() << " live, "
+                  << liveBytes(static_cast<GlResourceType>(type)) / 1024 << " KB" << std::endl;
+    }
+}
+
+size_t GlResourceRegistry::reportLeaks() const {
+    size_t leaked = 0;
+    for (int type = 0; type < static_cast<int>(GlResourceType::Count); type++) {
+        for (const auto& object : objects[type]) {
+            std::cout << "WARNING::GL_RESOURCE::LEAKED: " << TYPE_NAMES[type] << " " << object.first << " ("
+                      << object.second.label << ", " << object.second.bytes << " bytes)" << std::endl;
+            leaked++;
+        }
+    }
+    return leaked;
+}
+
+GLuint createGlObject(GlResourceType type) {
+    GLuint id = 0;
+    switch (type) {
+    case GlResourceType::Buffer:
+        glGenBuffers(1, &id);
+        break;
+    case GlResourceType::VertexArray:
+        glGenVertexArrays(1, &id);
+        break;
+    case GlResourceType::Texture:
+        glGenTextures(1, &id);
+        break;
+    case GlResourceType::Program:
+        id = glCreateProgram();
+        break;
+    case GlResourceType::Count:
+        break;
+    }
+    return id;
+}
+
+void deleteGlObject(GlResourceType type, GLuint id) {
+    switch (type) {
+    case GlResourceType::Buffer:
+        glDeleteBuffers(1, &id);
+        break;
+    case GlResourceType::VertexArray:
+        glDeleteVertexArrays(1, &id);
+        break;
+    case GlResourceType::Texture:
+        glDeleteTextures(1, &id);
+        break;
+    case GlResourceType::Program:
+        glDeleteProgram(id);
+        break;
+    case GlResourceType::Count:
+        break;
+    }
+}
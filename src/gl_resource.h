@@ -0,0 +1,100 @@
+#ifndef GL_RESOURCE_H
+#define GL_RESOURCE_H
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <unordered_map>
+
+enum class GlResourceType { Buffer, VertexArray, Texture, Program, Count };
+
+// Every live GL object created through a GlHandle, with the bytes it holds, so memory can be
+// reported by category and objects still alive at shutdown reported as leaks. GL thread only.
+class GlResourceRegistry {
+public:
+    static GlResourceRegistry& shared();
+
+    void created(GlResourceType type, GLuint id, const char* label);
+    void destroyed(GlResourceType type, GLuint id);
+    void setBytes(GlResourceType type, GLuint id, size_t bytes);
+
+    size_t liveCount(GlResourceType type) const { return objects[static_cast<int>(type)].size(); }
+    size_t liveBytes(GlResourceType type) const;
+    // Bytes recorded for one object; 0 when it is not alive
+    size_t bytes(GlResourceType type, GLuint id) const;
+
+    // Prints the live objects and bytes per category
+    void report() const;
+
+    // Prints every object still alive, e.g. once everything should have been released before the
+    // context goes away. Returns how many there were.
+    size_t reportLeaks() const;
+
+private:
+    struct Entry {
+        const char* label;
+        size_t bytes;
+    };
+    std::unordered_map<GLuint, Entry> objects[static_cast<int>(GlResourceType::Count)];
+};
+
+GLuint createGlObject(GlResourceType type);
+void deleteGlObject(GlResourceType type, GLuint id);
+
+// Owns one GL object, registered for as long as it lives, and deletes it when destroyed or
+// reset. Move-only: shared objects (textures used by several meshes, programs held by copies of a
+// Shader) are shared through a shared_ptr to the handle.
+template <GlResourceType Type>
+class GlHandle {
+public:
+    GlHandle() = default;
+    ~GlHandle() { reset(); }
+
+    GlHandle(GlHandle&& other) noexcept : objectId(other.objectId) { other.objectId = 0; }
+    GlHandle& operator=(GlHandle&& other) noexcept {
+        if (this != &other) {
+            reset();
+            objectId = other.objectId;
+            other.objectId = 0;
+        }
+        return *this;
+    }
+
+    GlHandle(const GlHandle&) = delete;
+    GlHandle& operator=(const GlHandle&) = delete;
+
+    // Creates a new object; label names it in reports and must outlive it (a string literal)
+    static GlHandle create(const char* label) {
+        GlHandle handle;
+        handle.objectId = createGlObject(Type);
+        GlResourceRegistry::shared().created(Type, handle.objectId, label);
+        return handle;
+    }
+
+    GLuint id() const { return objectId; }
+    explicit operator bool() const { return objectId != 0; }
+
+    // Records the memory the object holds, e.g. after glBufferData or glTexImage2D
+    void setBytes(size_t bytes) const {
+        if (objectId != 0)
+            GlResourceRegistry::shared().setBytes(Type, objectId, bytes);
+    }
+
+    void reset() {
+        if (objectId == 0)
+            return;
+        GlResourceRegistry::shared().destroyed(Type, objectId);
+        deleteGlObject(Type, objectId);
+        objectId = 0;
+    }
+
+private:
+    GLuint objectId = 0;
+};
+
+using GlBuffer = GlHandle<GlResourceType::Buffer>;
+using GlVertexArray = GlHandle<GlResourceType::VertexArray>;
+using GlTexture = GlHandle<GlResourceType::Texture>;
+using GlProgram = GlHandle<GlResourceType::Program>;
+
+#endif
@@ -0,0 +1,648 @@
+#include "gltf_loader.h"
+#include "json.h"
+#include "mapped_file.h"
+#include "model.h"
+#include "stb_image.h"
+#include "texture_cache.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+namespace {
+
+const uint32_t GLB_MAGIC = 0x46546C67;      // "glTF"
+const uint32_t GLB_CHUNK_JSON = 0x4E4F534A; // "JSON"
+const uint32_t GLB_CHUNK_BIN = 0x004E4942;  // "BIN\0"
+
+// glTF component types are the GL enums, so they pass straight to glVertexAttribPointer
+const int GLTF_UNSIGNED_BYTE = 5121;
+const int GLTF_UNSIGNED_SHORT = 5123;
+const int GLTF_UNSIGNED_INT = 5125;
+const int GLTF_FLOAT = 5126;
+const int GLTF_TRIANGLES = 4;
+
+// Attribute locations of the Vertex layout in Mesh::setupMesh
+const GLuint ATTRIBUTE_POSITION = 0;
+const GLuint ATTRIBUTE_NORMAL = 1;
+const GLuint ATTRIBUTE_TEXCOORD = 2;
+const GLuint ATTRIBUTE_TANGENT = 3;
+
+// Node hierarchies deeper than this are treated as cycles
+const int GLTF_MAX_NODE_DEPTH = 64;
+
+// Share of the progress bar taken by decoding images, the rest is building the meshes
+const float GLTF_IMAGE_PROGRESS = 0.5f;
+
+// The file and any buffers it references; every mesh's streams point into these
+struct GltfStorage {
+    MappedFile file;
+    std::vector<MappedFile> externalFiles;
+    std::vector<std::vector<unsigned char>> decodedBuffers;
+};
+
+// Streams that had to be converted or generated for one primitive, plus the shared storage
+struct PrimitiveStorage {
+    std::shared_ptr<const GltfStorage> source;
+    std::vector<std::vector<unsigned char>> generated;
+
+    unsigned char* add(size_t bytes) {
+        generated.emplace_back(bytes);
+        return generated.back().data();
+    }
+};
+
+struct BufferSpan {
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+};
+
+struct Accessor {
+    const unsigned char* data = nullptr;
+    size_t count = 0;
+    int componentType = 0;
+    int components = 0;
+    bool normalized = false;
+    size_t elementSize = 0;
+    size_t stride = 0;
+
+    size_t size() const { return count > 0 ? stride * (count - 1) + elementSize : 0; }
+    // What glVertexAttribPointer expects: 0 for tightly packed
+    GLsizei glStride() const { return stride == elementSize ? 0 : static_cast<GLsizei>(stride); }
+    const glm::vec3& vec3(size_t i) const { return *reinterpret_cast<const glm::vec3*>(data + i * stride); }
+    const glm::vec4& vec4(size_t i) const { return *reinterpret_cast<const glm::vec4*>(data + i * stride); }
+};
+
+uint32_t readU32(const unsigned char* bytes) {
+    uint32_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+size_t componentSize(int componentType) {
+    switch (componentType) {
+    case 5120: case 5121: return 1;
+    case 5122: case 5123: return 2;
+    case 5125: case 5126: return 4;
+    default: return 0;
+    }
+}
+
+int componentCount(const std::string& type) {
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    return 0;
+}
+
+bool decodeBase64(const char* text, size_t length, std::vector<unsigned char>& out) {
+    auto value = [](char c) -> int {
+        if (c >= 'A' && c <= 'Z') return c - 'A';
+        if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+        if (c >= '0' && c <= '9') return c - '0' + 52;
+        if (c == '+' || c == '-') return 62;
+        if (c == '/' || c == '_') return 63;
+        return -1;
+    };
+    out.clear();
+    out.reserve(length / 4 * 3);
+    uint32_t bits = 0;
+    int bitCount = 0;
+    for (size_t i = 0; i < length && text[i] != '='; i++) {
+        int v = value(text[i]);
+        if (v < 0)
+            return false;
+        bits = (bits << 6) | static_cast<uint32_t>(v);
+        bitCount += 6;
+        if (bitCount >= 8) {
+            bitCount -= 8;
+            out.push_back(static_cast<unsigned char>(bits >> bitCount));
+        }
+    }
+    return true;
+}
+
+// Decodes %XX escapes in relative URIs
+std::string decodeUri(const std::string& uri) {
+    std::string result;
+    for (size_t i = 0; i < uri.size(); i++) {
+        if (uri[i] == '%' && i + 2 < uri.size()) {
+            result += static_cast<char>(std::strtol(uri.substr(i + 1, 2).c_str(), nullptr, 16));
+            i += 2;
+        } else {
+            result += uri[i];
+        }
+    }
+    return result;
+}
+
+// Resolves a data URI or a file next to the asset. Files are mapped into storage.
+bool readUri(const std::string& uri, const std::string& directory, GltfStorage& storage, BufferSpan& span) {
+    if (uri.compare(0, 5, "data:") == 0) {
+        size_t comma = uri.find(',');
+        if (comma == std::string::npos || uri.rfind(";base64", comma) == std::string::npos)
+            return false;
+        storage.decodedBuffers.emplace_back();
+        std::vector<unsigned char>& decoded = storage.decodedBuffers.back();
+        if (!decodeBase64(uri.c_str() + comma + 1, uri.size() - comma - 1, decoded))
+            return false;
+        span = {decoded.data(), decoded.size()};
+        return true;
+    }
+    storage.externalFiles.emplace_back();
+    MappedFile& file = storage.externalFiles.back();
+    if (!file.open(directory + decodeUri(uri)))
+        return false;
+    span = {file.data(), file.size()};
+    return true;
+}
+
+bool resolveBufferView(const JsonValue& doc, const std::vector<BufferSpan>& buffers, int index, BufferSpan& span,
+                       size_t* stride = nullptr) {
+    const JsonValue& view = doc["bufferViews"][static_cast<size_t>(index)];
+    int buffer = view["buffer"].integer(-1);
+    if (!view.isObject() || buffer < 0 || static_cast<size_t>(buffer) >= buffers.size())
+        return false;
+    size_t offset = static_cast<size_t>(view["byteOffset"].number(0));
+    size_t length = static_cast<size_t>(view["byteLength"].number(0));
+    if (offset > buffers[buffer].size || length > buffers[buffer].size - offset)
+        return false;
+    span = {buffers[buffer].data + offset, length};
+    if (stride)
+        *stride = static_cast<size_t>(view["byteStride"].number(0));
+    return true;
+}
+
+bool resolveAccessor(const JsonValue& doc, const std::vector<BufferSpan>& buffers, int index, Accessor& accessor) {
+    const JsonValue& json = doc["accessors"][static_cast<size_t>(index)];
+    // Sparse accessors and accessors without a view would need their data built on the CPU
+    if (!json.isObject() || !json.has("bufferView") || json.has("sparse"))
+        return false;
+
+    BufferSpan view;
+    size_t viewStride = 0;
+    if (!resolveBufferView(doc, buffers, json["bufferView"].integer(-1), view, &viewStride))
+        return false;
+
+    accessor.count = static_cast<size_t>(json["count"].number(0));
+    accessor.componentType = json["componentType"].integer();
+    accessor.components = componentCount(json["type"].string());
+    accessor.normalized = json["normalized"].boolean();
+    accessor.elementSize = componentSize(accessor.componentType) * static_cast<size_t>(accessor.components);
+    accessor.stride = viewStride > 0 ? viewStride : accessor.elementSize;
+    if (accessor.elementSize == 0 || accessor.count == 0)
+        return false;
+
+    size_t offset = static_cast<size_t>(json["byteOffset"].number(0));
+    if (offset > view.size || accessor.size() > view.size - offset)
+        return false;
+    accessor.data = view.data + offset;
+    // Attribute reads go through float pointers
+    return reinterpret_cast<uintptr_t>(accessor.data) % componentSize(accessor.componentType) == 0;
+}
+
+glm::mat4 nodeMatrix(const JsonValue& node) {
+    glm::mat4 m(1.0f);
+    const JsonValue& matrix = node["matrix"];
+    if (matrix.size() == 16) {
+        // Column-major, like glm
+        for (int c = 0; c < 4; c++)
+            for (int r = 0; r < 4; r++)
+                m[c][r] = static_cast<float>(matrix[static_cast<size_t>(c * 4 + r)].number());
+        return m;
+    }
+
+    const JsonValue& t = node["translation"];
+    const JsonValue& r = node["rotation"];
+    const JsonValue& s = node["scale"];
+    glm::vec3 translation(t[0].number(0), t[1].number(0), t[2].number(0));
+    float x = static_cast<float>(r[0].number(0)), y = static_cast<float>(r[1].number(0));
+    float z = static_cast<float>(r[2].number(0)), w = static_cast<float>(r[3].number(1));
+    glm::vec3 scale(s[0].number(1), s[1].number(1), s[2].number(1));
+
+    m[0] = glm::vec4(1 - 2 * (y * y + z * z), 2 * (x * y + w * z), 2 * (x * z - w * y), 0) * scale.x;
+    m[1] = glm::vec4(2 * (x * y - w * z), 1 - 2 * (x * x + z * z), 2 * (y * z + w * x), 0) * scale.y;
+    m[2] = glm::vec4(2 * (x * z + w * y), 2 * (y * z - w * x), 1 - 2 * (x * x + y * y), 0) * scale.z;
+    m[3] = glm::vec4(translation, 1.0f);
+    return m;
+}
+
+bool isIdentity(const glm::mat4& m) {
+    for (int c = 0; c < 4; c++)
+        for (int r = 0; r < 4; r++)
+            if (m[c][r] != (c == r ? 1.0f : 0.0f))
+                return false;
+    return true;
+}
+
+struct PrimitiveJob {
+    const JsonValue* primitive;
+    glm::mat4 transform;
+};
+
+void collectPrimitives(const JsonValue& doc, int nodeIndex, const glm::mat4& parent, int depth,
+                       std::vector<PrimitiveJob>& jobs) {
+    const JsonValue& node = doc["nodes"][static_cast<size_t>(nodeIndex)];
+    if (!node.isObject() || depth > GLTF_MAX_NODE_DEPTH)
+        return;
+    glm::mat4 transform = parent * nodeMatrix(node);
+    if (node.has("mesh")) {
+        const JsonValue& primitives = doc["meshes"][static_cast<size_t>(node["mesh"].integer(-1))]["primitives"];
+        for (size_t i = 0; i < primitives.size(); i++)
+            jobs.push_back({&primitives[i], transform});
+    }
+    const JsonValue& children = node["children"];
+    for (size_t i = 0; i < children.size(); i++)
+        collectPrimitives(doc, children[i].integer(-1), transform, depth + 1, jobs);
+}
+
+uint32_t readIndex(const void* indices, GLenum type, size_t i) {
+    return type == GL_UNSIGNED_SHORT ? static_cast<const uint16_t*>(indices)[i] : static_cast<const uint32_t*>(indices)[i];
+}
+
+// Decodes the images behind a material's texture slots, sharing pixels between materials
+std::vector<std::vector<MaterialImage>> decodeMaterials(const JsonValue& doc, const std::vector<BufferSpan>& buffers,
+                                                        const std::string& directory, GltfStorage& storage,
+                                                        unsigned int threads) {
+    static const std::pair<const char*, const char*> slots[] = {
+        {"baseColorTexture", "texture_diffuse"},
+        {"normalTexture", "texture_normal"},
+        {"metallicRoughnessTexture", "texture_specular"},
+    };
+
+    const JsonValue& materials = doc["materials"];
+    std::vector<std::vector<MaterialImage>> result(materials.size());
+    std::vector<MaterialImage> images(doc["images"].size());
+    std::vector<std::vector<std::pair<size_t, const char*>>> uses(images.size());
+    for (size_t m = 0; m < materials.size(); m++) {
+        for (const auto& slot : slots) {
+            const JsonValue& info = slot.first == std::string("normalTexture")
+                                        ? materials[m][slot.first]
+                                        : materials[m]["pbrMetallicRoughness"][slot.first];
+            int image = doc["textures"][static_cast<size_t>(info["index"].integer(-1))]["source"].integer(-1);
+            if (image >= 0 && static_cast<size_t>(image) < images.size())
+                uses[image].push_back({m, slot.second});
+        }
+    }
+
+    // Sources are resolved here, since readUri grows the storage; decoding runs in parallel. Image
+    // files go through the TextureCache so other models share them.
+    std::vector<BufferSpan> encoded(images.size());
+    std::vector<std::string> files(images.size());
+    for (size_t i = 0; i < images.size(); i++) {
+        if (uses[i].empty())
+            continue;
+        const JsonValue& image = doc["images"][i];
+        const std::string& uri = image["uri"].string();
+        if (!image.has("bufferView") && !uri.empty() && uri.compare(0, 5, "data:") != 0) {
+            files[i] = directory + decodeUri(uri);
+            continue;
+        }
+        bool found = image.has("bufferView") ? resolveBufferView(doc, buffers, image["bufferView"].integer(-1), encoded[i])
+                                             : readUri(image["uri"].string(), directory, storage, encoded[i]);
+        if (!found)
+            std::cout << "WARNING::GLTF::MISSING_IMAGE: " << i << " " << image["uri"].string() << std::endl;
+    }
+    ThreadPool::shared().parallelFor(images.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            // Images used as base color hold sRGB color
+            TextureDecodeParams params;
+            params.srgb = std::any_of(uses[i].begin(), uses[i].end(), [](const std::pair<size_t, const char*>& use) {
+                return use.second == std::string("texture_diffuse");
+            });
+            if (!files[i].empty()) {
+                TextureCache::shared().decode(files[i], params, images[i]);
+                continue;
+            }
+            if (!encoded[i].data)
+                continue;
+            MaterialImage& image = images[i];
+            unsigned char* pixels = stbi_load_from_memory(encoded[i].data, static_cast<int>(encoded[i].size),
+                                                          &image.width, &image.height, &image.channels, 0);
+            if (!pixels)
+                continue;
+            image.pixels = std::make_shared<const std::vector<unsigned char>>(
+                pixels, pixels + static_cast<size_t>(image.width) * image.height * image.channels);
+            image.params = params;
+            stbi_image_free(pixels);
+        }
+    }, 1, threads);
+
+    for (size_t i = 0; i < images.size(); i++) {
+        if (!images[i].pixels && images[i].path.empty())
+            continue;
+        for (const auto& use : uses[i]) {
+            MaterialImage slot = images[i];
+            slot.type = use.second;
+            result[use.first].push_back(slot);
+        }
+    }
+    return result;
+}
+
+// Turns one primitive into a mesh. Returns false with the reason when it cannot be drawn.
+bool buildPrimitive(const JsonValue& doc, const PrimitiveJob& job, const std::vector<BufferSpan>& buffers,
+                    const std::vector<std::vector<MaterialImage>>& materials,
+                    const std::shared_ptr<const GltfStorage>& source, MeshData& data, std::string& problem) {
+    const JsonValue& primitive = *job.primitive;
+    if (primitive["mode"].integer(GLTF_TRIANGLES) != GLTF_TRIANGLES) {
+        problem = "not a triangle list";
+        return false;
+    }
+    const JsonValue& attributes = primitive["attributes"];
+    Accessor position;
+    if (!resolveAccessor(doc, buffers, attributes["POSITION"].integer(-1), position) ||
+        position.componentType != GLTF_FLOAT || position.components != 3) {
+        problem = "missing or unsupported POSITION";
+        return false;
+    }
+    size_t vertexCount = position.count;
+    auto storage = std::make_shared<PrimitiveStorage>();
+    storage->source = source;
+    bool identity = isIdentity(job.transform);
+
+    // Indices stay 16 or 32-bit; 8-bit ones are widened since GL handles them poorly
+    const void* indices = nullptr;
+    GLenum indexType = GL_UNSIGNED_INT;
+    size_t indexCount = 0;
+    if (primitive.has("indices")) {
+        Accessor accessor;
+        if (!resolveAccessor(doc, buffers, primitive["indices"].integer(-1), accessor) || accessor.components != 1 ||
+            accessor.stride != accessor.elementSize) {
+            problem = "unsupported indices";
+            return false;
+        }
+        indexCount = accessor.count - accessor.count % 3;
+        if (accessor.componentType == GLTF_UNSIGNED_BYTE) {
+            uint16_t* widened = reinterpret_cast<uint16_t*>(storage->add(indexCount * sizeof(uint16_t)));
+            for (size_t i = 0; i < indexCount; i++)
+                widened[i] = accessor.data[i];
+            indices = widened;
+            indexType = GL_UNSIGNED_SHORT;
+        } else if (accessor.componentType == GLTF_UNSIGNED_SHORT || accessor.componentType == GLTF_UNSIGNED_INT) {
+            indices = accessor.data;
+            indexType = static_cast<GLenum>(accessor.componentType);
+        } else {
+            problem = "unsupported index type";
+            return false;
+        }
+    } else {
+        indexCount = vertexCount - vertexCount % 3;
+        uint32_t* sequence = reinterpret_cast<uint32_t*>(storage->add(indexCount * sizeof(uint32_t)));
+        for (size_t i = 0; i < indexCount; i++)
+            sequence[i] = static_cast<uint32_t>(i);
+        indices = sequence;
+    }
+    if (indexCount == 0) {
+        problem = "no triangles";
+        return false;
+    }
+    for (size_t i = 0; i < indexCount; i++) {
+        if (readIndex(indices, indexType, i) >= vertexCount) {
+            problem = "index out of range";
+            return false;
+        }
+    }
+
+    // A mirroring node transform turns the baked faces inside out, which would flip the meshlet cones
+    // too; swapping two corners of every triangle restores the winding
+    if (glm::determinant(glm::mat3(job.transform)) < 0.0f) {
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        const unsigned char* original = static_cast<const unsigned char*>(indices);
+        unsigned char* swapped = storage->add(indexCount * indexSize);
+        for (size_t i = 0; i < indexCount; i += 3) {
+            memcpy(swapped + i * indexSize, original + i * indexSize, indexSize);
+            memcpy(swapped + (i + 1) * indexSize, original + (i + 2) * indexSize, indexSize);
+            memcpy(swapped + (i + 2) * indexSize, original + (i + 1) * indexSize, indexSize);
+        }
+        indices = swapped;
+    }
+
+    // Positions, baked into a copy under a node transform
+    const glm::vec3* positions = reinterpret_cast<const glm::vec3*>(position.data);
+    size_t positionStride = position.stride;
+    data.streams.push_back({ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, position.glStride(), position.data,
+                            position.size()});
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(job.transform)));
+    if (!identity) {
+        glm::vec3* moved = reinterpret_cast<glm::vec3*>(storage->add(vertexCount * sizeof(glm::vec3)));
+        for (size_t i = 0; i < vertexCount; i++)
+            moved[i] = glm::vec3(job.transform * glm::vec4(position.vec3(i), 1.0f));
+        positions = moved;
+        positionStride = sizeof(glm::vec3);
+        data.streams.back().data = moved;
+        data.streams.back().stride = 0;
+        data.streams.back().size = vertexCount * sizeof(glm::vec3);
+    }
+    auto positionAt = [&](size_t i) -> const glm::vec3& {
+        return *reinterpret_cast<const glm::vec3*>(reinterpret_cast<const unsigned char*>(positions) + i * positionStride);
+    };
+
+    Accessor normal;
+    bool hasNormals = resolveAccessor(doc, buffers, attributes["NORMAL"].integer(-1), normal) &&
+                      normal.count == vertexCount && normal.componentType == GLTF_FLOAT && normal.components == 3;
+    if (hasNormals && identity) {
+        data.streams.push_back({ATTRIBUTE_NORMAL, 3, GL_FLOAT, GL_FALSE, normal.glStride(), normal.data, normal.size()});
+    } else {
+        glm::vec3* normals = reinterpret_cast<glm::vec3*>(storage->add(vertexCount * sizeof(glm::vec3)));
+        if (hasNormals) {
+            for (size_t i = 0; i < vertexCount; i++)
+                normals[i] = normalMatrix * normal.vec3(i);
+        } else {
+            // Area-weighted face normals summed per vertex
+            std::fill(normals, normals + vertexCount, glm::vec3(0.0f));
+            for (size_t i = 0; i + 2 < indexCount; i += 3) {
+                uint32_t a = readIndex(indices, indexType, i);
+                uint32_t b = readIndex(indices, indexType, i + 1);
+                uint32_t c = readIndex(indices, indexType, i + 2);
+                glm::vec3 n = glm::cross(positionAt(b) - positionAt(a), positionAt(c) - positionAt(a));
+                normals[a] += n;
+                normals[b] += n;
+                normals[c] += n;
+            }
+        }
+        for (size_t i = 0; i < vertexCount; i++) {
+            float length = glm::length(normals[i]);
+            normals[i] = length > 0.0f ? normals[i] / length : glm::vec3(0.0f, 0.0f, 1.0f);
+        }
+        data.streams.push_back({ATTRIBUTE_NORMAL, 3, GL_FLOAT, GL_FALSE, 0, normals, vertexCount * sizeof(glm::vec3)});
+    }
+
+    // Texture coordinates as stored: floats, or normalized bytes/shorts
+    Accessor texCoord;
+    if (resolveAccessor(doc, buffers, attributes["TEXCOORD_0"].integer(-1), texCoord) && texCoord.count == vertexCount &&
+        texCoord.components == 2 &&
+        (texCoord.componentType == GLTF_FLOAT || (texCoord.normalized && texCoord.componentType != GLTF_UNSIGNED_INT))) {
+        data.streams.push_back({ATTRIBUTE_TEXCOORD, 2, static_cast<GLenum>(texCoord.componentType),
+                                static_cast<GLboolean>(texCoord.normalized), texCoord.glStride(), texCoord.data,
+                                texCoord.size()});
+    }
+
+    // Tangents keep their handedness in w; the shader only reads xyz
+    Accessor tangent;
+    if (resolveAccessor(doc, buffers, attributes["TANGENT"].integer(-1), tangent) && tangent.count == vertexCount &&
+        tangent.componentType == GLTF_FLOAT && tangent.components == 4) {
+        if (identity) {
+            data.streams.push_back({ATTRIBUTE_TANGENT, 4, GL_FLOAT, GL_FALSE, tangent.glStride(), tangent.data,
+                                    tangent.size()});
+        } else {
+            glm::mat3 basis(job.transform);
+            glm::vec4* moved = reinterpret_cast<glm::vec4*>(storage->add(vertexCount * sizeof(glm::vec4)));
+            for (size_t i = 0; i < vertexCount; i++) {
+                glm::vec4 t = tangent.vec4(i);
+                moved[i] = glm::vec4(basis * glm::vec3(t), t.w);
+            }
+            data.streams.push_back({ATTRIBUTE_TANGENT, 4, GL_FLOAT, GL_FALSE, 0, moved, vertexCount * sizeof(glm::vec4)});
+        }
+    }
+
+    data.streamIndices = indices;
+    data.streamIndexType = indexType;
+    data.streamVertexCount = vertexCount;
+    data.streamIndexCount = indexCount;
+    data.meshlets = indexType == GL_UNSIGNED_SHORT
+                        ? buildMeshlets(positions, positionStride, vertexCount, static_cast<const uint16_t*>(indices), indexCount)
+                        : buildMeshlets(positions, positionStride, vertexCount, static_cast<const uint32_t*>(indices), indexCount);
+
+    int material = primitive["material"].integer(-1);
+    if (material >= 0 && static_cast<size_t>(material) < materials.size())
+        data.materialImages = materials[material];
+    data.backing = storage;
+    return true;
+}
+
+} // namespace
+
+bool loadGltf(const std::string& path, std::vector<MeshData>& meshes, unsigned int threads, LoadProgress* progress,
+              float progressScale) {
+    auto storage = std::make_shared<GltfStorage>();
+    if (!storage->file.open(path)) {
+        std::cout << "ERROR::GLTF::CANNOT_OPEN_FILE: " << path << std::endl;
+        return false;
+    }
+    size_t slash = path.find_last_of("/\\");
+    std::string directory = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+
+    // A .glb is a header followed by a JSON chunk and an optional binary chunk
+    const unsigned char* bytes = storage->file.data();
+    size_t size = storage->file.size();
+    const char* json = reinterpret_cast<const char*>(bytes);
+    size_t jsonSize = size;
+    BufferSpan binaryChunk;
+    if (size >= 12 && readU32(bytes) == GLB_MAGIC) {
+        if (readU32(bytes + 4) != 2) {
+            std::cout << "ERROR::GLTF::UNSUPPORTED_VERSION: " << path << std::endl;
+            return false;
+        }
+        size_t length = std::min<size_t>(readU32(bytes + 8), size);
+        json = nullptr;
+        for (size_t offset = 12; offset + 8 <= length;) {
+            size_t chunkLength = readU32(bytes + offset);
+            uint32_t chunkType = readU32(bytes + offset + 4);
+            if (chunkLength > length - offset - 8)
+                break;
+            if (chunkType == GLB_CHUNK_JSON && !json) {
+                json = reinterpret_cast<const char*>(bytes + offset + 8);
+                jsonSize = chunkLength;
+            } else if (chunkType == GLB_CHUNK_BIN && !binaryChunk.data) {
+                binaryChunk = {bytes + offset + 8, chunkLength};
+            }
+            offset += 8 + chunkLength;
+        }
+        if (!json) {
+            std::cout << "ERROR::GLTF::MISSING_JSON_CHUNK: " << path << std::endl;
+            return false;
+        }
+    }
+
+    JsonValue doc;
+    std::string error;
+    if (!JsonValue::parse(json, jsonSize, doc, error)) {
+        std::cout << "ERROR::GLTF::INVALID_JSON: " << error << " in " << path << std::endl;
+        return false;
+    }
+    if (doc["asset"]["version"].string().compare(0, 1, "2") != 0) {
+        std::cout << "ERROR::GLTF::UNSUPPORTED_VERSION: " << path << std::endl;
+        return false;
+    }
+
+    // readUri appends to these, and the spans must stay valid
+    const JsonValue& bufferList = doc["buffers"];
+    storage->externalFiles.reserve(bufferList.size() + doc["images"].size());
+    storage->decodedBuffers.reserve(bufferList.size() + doc["images"].size());
+    std::vector<BufferSpan> buffers(bufferList.size());
+    for (size_t i = 0; i < bufferList.size(); i++) {
+        const JsonValue& buffer = bufferList[i];
+        BufferSpan span = binaryChunk;
+        if (buffer.has("uri") && !readUri(buffer["uri"].string(), directory, *storage, span))
+            span = BufferSpan();
+        size_t length = static_cast<size_t>(buffer["byteLength"].number(0));
+        if (!span.data || span.size < length) {
+            std::cout << "ERROR::GLTF::MISSING_BUFFER: " << i << " " << buffer["uri"].string() << " in " << path
+                      << std::endl;
+            return false;
+        }
+        buffers[i] = {span.data, length};
+    }
+
+    std::vector<std::vector<MaterialImage>> materials = decodeMaterials(doc, buffers, directory, *storage, threads);
+    if (progress) {
+        if (progress->cancelled)
+            return false;
+        progress->value = progressScale * GLTF_IMAGE_PROGRESS;
+    }
+
+    // Primitives of the default scene with their world transforms; every mesh once if there is none
+    std::vector<PrimitiveJob> jobs;
+    const JsonValue& scene = doc["scenes"][static_cast<size_t>(doc["scene"].integer(0))];
+    if (scene.isObject()) {
+        const JsonValue& roots = scene["nodes"];
+        for (size_t i = 0; i < roots.size(); i++)
+            collectPrimitives(doc, roots[i].integer(-1), glm::mat4(1.0f), 0, jobs);
+    } else {
+        const JsonValue& meshList = doc["meshes"];
+        for (size_t m = 0; m < meshList.size(); m++) {
+            const JsonValue& primitives = meshList[m]["primitives"];
+            for (size_t i = 0; i < primitives.size(); i++)
+                jobs.push_back({&primitives[i], glm::mat4(1.0f)});
+        }
+    }
+
+    std::shared_ptr<const GltfStorage> source = storage;
+    std::vector<MeshData> built(jobs.size());
+    std::vector<std::string> problems(jobs.size());
+    std::atomic<size_t> completed{0};
+    ThreadPool::shared().parallelFor(jobs.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            if (progress && progress->cancelled)
+                return;
+            if (!buildPrimitive(doc, jobs[i], buffers, materials, source, built[i], problems[i]))
+                built[i] = MeshData();
+            if (progress) {
+                float done = static_cast<float>(++completed) / static_cast<float>(jobs.size());
+                progress->value = progressScale * (GLTF_IMAGE_PROGRESS + (1.0f - GLTF_IMAGE_PROGRESS) * done);
+            }
+        }
+    }, 1, threads);
+    if (progress && progress->cancelled)
+        return false;
+
+    std::vector<MeshData> result;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (built[i].hasStreams())
+            result.push_back(std::move(built[i]));
+        else
+            std::cout << "WARNING::GLTF::SKIPPED_PRIMITIVE: " << problems[i] << " in " << path << std::endl;
+    }
+    if (result.empty()) {
+        std::cout << "ERROR::GLTF::NO_MESHES: " << path << std::endl;
+        return false;
+    }
+    meshes = std::move(result);
+    return true;
+}
@@ -0,0 +1,21 @@
+#ifndef GLTF_LOADER_H
+#define GLTF_LOADER_H
+
+#include "mesh.h"
+
+#include <string>
+#include <vector>
+
+struct LoadProgress;
+
+// Reads glTF 2.0 files (.gltf with external or embedded buffers, and binary .glb) without Assimp.
+// Every triangle primitive becomes a mesh whose vertex streams and indices point straight into the
+// memory-mapped buffers, so Mesh uploads them as stored: attributes keep their component types
+// and indices stay 16 or 32-bit. Primitives under a non-identity node transform, or without
+// normals, get transformed or generated copies of the affected streams. Base color, normal and
+// metallic-roughness images are decoded into the material slots. Progress goes up to
+// progressScale. Returns false if the file cannot be read or the load was cancelled.
+bool loadGltf(const std::string& path, std::vector<MeshData>& meshes, unsigned int threads = 0,
+              LoadProgress* progress = nullptr, float progressScale = 1.0f);
+
+#endif
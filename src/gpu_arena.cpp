@@ -0,0 +1,185 @@
+#include "gpu_arena.h"
+
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+
+namespace {
+
+size_t alignUp(size_t offset, size_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+float ArenaStats::fragmentation() const {
+    return free > 0 ? 1.0f - static_cast<float>(largestFreeBlock) / static_cast<float>(free) : 0.0f;
+}
+
+GpuArena::GpuArena(size_t initialCapacity, const char* label) : initialCapacity(initialCapacity), label(label) {}
+
+ArenaRange GpuArena::allocate(size_t size, size_t alignment) {
+    alignment = std::max<size_t>(alignment, 1);
+    size_t offset = 0;
+    if (!takeFreeBlock(size, alignment, offset)) {
+        // The new space joins a free block at the end, so size + alignment always fits
+        grow(capacity + size + alignment);
+        takeFreeBlock(size, alignment, offset);
+    }
+
+    ArenaAllocation* allocation = new ArenaAllocation{offset, size, alignment, live.size()};
+    live.push_back(allocation);
+    usedBytes += size;
+    return ArenaRange(allocation, [this](ArenaAllocation* released) {
+        release(released);
+        delete released;
+    });
+}
+
+void GpuArena::upload(const ArenaRange& range, size_t offset, size_t size, const void* data) {
+    if (size == 0)
+        return;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, storage.id());
+    glBufferSubData(GL_COPY_WRITE_BUFFER, range->offset + offset, size, data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void GpuArena::download(const ArenaRange& range, size_t offset, size_t size, void* data) const {
+    if (size == 0)
+        return;
+    glBindBuffer(GL_COPY_READ_BUFFER, storage.id());
+    glGetBufferSubData(GL_COPY_READ_BUFFER, range->offset + offset, size, data);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+void GpuArena::copy(const ArenaRange& from, const ArenaRange& to, size_t size) {
+    if (size == 0)
+        return;
+    // Ranges never overlap, so a copy within the buffer is allowed
+    glBindBuffer(GL_COPY_READ_BUFFER, storage.id());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, storage.id());
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, from->offset, to->offset, size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void GpuArena::defragment() {
+    if (!storage)
+        return;
+
+    std::vector<ArenaAllocation*> order = live;
+    std::sort(order.begin(), order.end(),
+              [](const ArenaAllocation* a, const ArenaAllocation* b) { return a->offset < b->offset; });
+
+    GlBuffer packed = GlBuffer::create(label);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, packed.id());
+    glBufferData(GL_COPY_WRITE_BUFFER, capacity, nullptr, GL_STATIC_DRAW);
+    packed.setBytes(capacity);
+    glBindBuffer(GL_COPY_READ_BUFFER, storage.id());
+
+    // In offset order every range lands at or before where it was, so they all still fit
+    freeBlocks.clear();
+    size_t end = 0;
+    for (ArenaAllocation* allocation : order) {
+        size_t offset = alignUp(end, allocation->alignment);
+        addFreeBlock(end, offset - end);
+        if (allocation->size > 0)
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation->offset, offset, allocation->size);
+        allocation->offset = offset;
+        end = offset + allocation->size;
+    }
+    addFreeBlock(end, capacity - end);
+
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    storage = std::move(packed);
+    generationCount++;
+}
+
+void GpuArena::reset() {
+    if (!live.empty())
+        std::cout << "WARNING::GPU_ARENA::RESET: " << live.size() << " ranges still allocated in " << label << std::endl;
+    storage.reset();
+    capacity = 0;
+    usedBytes = 0;
+    freeBlocks.clear();
+    generationCount++;
+}
+
+ArenaStats GpuArena::stats() const {
+    ArenaStats stats;
+    stats.capacity = capacity;
+    stats.used = usedBytes;
+    stats.allocations = live.size();
+    stats.freeBlocks = freeBlocks.size();
+    for (const auto& block : freeBlocks) {
+        stats.free += block.second;
+        stats.largestFreeBlock = std::max(stats.largestFreeBlock, block.second);
+    }
+    return stats;
+}
+
+void GpuArena::release(ArenaAllocation* allocation) {
+    ArenaAllocation* moved = live.back();
+    live[allocation->slot] = moved;
+    moved->slot = allocation->slot;
+    live.pop_back();
+    usedBytes -= allocation->size;
+    addFreeBlock(allocation->offset, allocation->size);
+}
+
+void GpuArena::addFreeBlock(size_t offset, size_t size) {
+    if (size == 0)
+        return;
+    auto next = freeBlocks.lower_bound(offset);
+    if (next != freeBlocks.end() && offset + size == next->first) {
+        size += next->second;
+        next = freeBlocks.erase(next);
+    }
+    if (next != freeBlocks.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            previous->second += size;
+            return;
+        }
+    }
+    freeBlocks.emplace(offset, size);
+}
+
+bool GpuArena::takeFreeBlock(size_t size, size_t alignment, size_t& offset) {
+    for (auto it = freeBlocks.begin(); it != freeBlocks.end(); ++it) {
+        size_t begin = it->first;
+        size_t end = begin + it->second;
+        size_t aligned = alignUp(begin, alignment);
+        if (aligned + size > end)
+            continue;
+
+        // Whatever the range leaves on either side stays free
+        freeBlocks.erase(it);
+        addFreeBlock(begin, aligned - begin);
+        addFreeBlock(aligned + size, end - aligned - size);
+        offset = aligned;
+        return true;
+    }
+    return false;
+}
+
+void GpuArena::grow(size_t minimumCapacity) {
+    size_t grownCapacity = std::max(capacity > 0 ? capacity * 2 : initialCapacity, minimumCapacity);
+
+    GlBuffer grown = GlBuffer::create(label);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, grown.id());
+    glBufferData(GL_COPY_WRITE_BUFFER, grownCapacity, nullptr, GL_STATIC_DRAW);
+    grown.setBytes(grownCapacity);
+    if (storage) {
+        glBindBuffer(GL_COPY_READ_BUFFER, storage.id());
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, capacity);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    addFreeBlock(capacity, grownCapacity - capacity);
+    capacity = grownCapacity;
+    storage = std::move(grown);
+    generationCount++;
+}
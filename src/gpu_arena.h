@@ -0,0 +1,92 @@
+#ifndef GPU_ARENA_H
+#define GPU_ARENA_H
+
+#include "gl_resource.h"
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <vector>
+
+// A range of a GpuArena. The offset changes when the arena is defragmented, so read it when
+// drawing rather than keeping a copy.
+struct ArenaAllocation {
+    size_t offset = 0;
+    size_t size = 0;
+    size_t alignment = 1;
+    // Slot in the arena's list of live allocations
+    size_t slot = 0;
+};
+
+// Shared ownership of a range; it goes back to the arena's free list with the last copy
+using ArenaRange = std::shared_ptr<ArenaAllocation>;
+
+struct ArenaStats {
+    size_t capacity = 0;
+    size_t used = 0;
+    size_t free = 0;
+    size_t allocations = 0;
+    size_t freeBlocks = 0;
+    size_t largestFreeBlock = 0;
+
+    // Share of the free space outside the largest free block; 0 when it is all in one piece
+    float fragmentation() const;
+};
+
+// Suballocates ranges of one large GL buffer through a first-fit free list. The buffer is created
+// on the first allocation and doubles when nothing fits; growing or defragmenting replaces
+// buffer() and bumps generation(), so vertex arrays pointing into it must be set up again.
+// Uploads go through GL_COPY_WRITE_BUFFER and leave the vertex array state alone. GL thread only;
+// ranges must not outlive the arena.
+class GpuArena {
+public:
+    GpuArena(size_t initialCapacity, const char* label);
+
+    GpuArena(const GpuArena&) = delete;
+    GpuArena& operator=(const GpuArena&) = delete;
+
+    // A range of size bytes at an offset that is a multiple of alignment (any value, e.g. a vertex
+    // stride, so the offset divides into a base vertex)
+    ArenaRange allocate(size_t size, size_t alignment);
+
+    void upload(const ArenaRange& range, size_t offset, size_t size, const void* data);
+
+    // Reads size bytes of a range back into data. Stalls until the GPU is done with the buffer, so
+    // only for rare reads such as restoring released CPU geometry.
+    void download(const ArenaRange& range, size_t offset, size_t size, void* data) const;
+
+    // Copies size bytes from one range to another, e.g. when a range is replaced by a bigger one
+    void copy(const ArenaRange& from, const ArenaRange& to, size_t size);
+
+    // Moves every live range to the front of a fresh buffer, in order, leaving one free block
+    void defragment();
+
+    // Deletes the buffer; every range must have been released. The next allocation starts over.
+    void reset();
+
+    GLuint buffer() const { return storage.id(); }
+    unsigned int generation() const { return generationCount; }
+    ArenaStats stats() const;
+
+private:
+    GlBuffer storage;
+    size_t capacity = 0;
+    size_t initialCapacity;
+    const char* label;
+    unsigned int generationCount = 0;
+    size_t usedBytes = 0;
+
+    // Free blocks by offset, with their sizes; neighbours are always merged
+    std::map<size_t, size_t> freeBlocks;
+    std::vector<ArenaAllocation*> live;
+
+    void release(ArenaAllocation* allocation);
+    void addFreeBlock(size_t offset, size_t size);
+    // Takes the first free block that fits; returns false when none does
+    bool takeFreeBlock(size_t size, size_t alignment, size_t& offset);
+    void grow(size_t minimumCapacity);
+};
+
+#endif
@@ -0,0 +1,277 @@
+#include "json.h"
+
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// Nesting limit, so hostile files cannot overflow the stack
+const int JSON_MAX_DEPTH = 128;
+
+const JsonValue& nullValue() {
+    static const JsonValue value;
+    return value;
+}
+
+void appendUtf8(std::string& out, unsigned int codepoint) {
+    if (codepoint < 0x80) {
+        out += static_cast<char>(codepoint);
+    } else if (codepoint < 0x800) {
+        out += static_cast<char>(0xC0 | (codepoint >> 6));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    } else if (codepoint < 0x10000) {
+        out += static_cast<char>(0xE0 | (codepoint >> 12));
+        out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (codepoint >> 18));
+        out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (codepoint & 0x3F));
+    }
+}
+
+} // namespace
+
+int JsonValue::integer(int fallback) const {
+    // Checked before the cast, which is undefined for NaN, infinities and out of range values
+    if (kind != Type::Number || !std::isfinite(numberValue) || numberValue != std::floor(numberValue) ||
+        numberValue < INT_MIN || numberValue > INT_MAX)
+        return fallback;
+    return static_cast<int>(numberValue);
+}
+
+const JsonValue& JsonValue::operator[](size_t index) const {
+    return kind == Type::Array && index < elements.size() ? elements[index] : nullValue();
+}
+
+const JsonValue& JsonValue::operator[](const char* key) const {
+    if (kind != Type::Object)
+        return nullValue();
+    for (const auto& member : members) {
+        if (member.first == key)
+            return member.second;
+    }
+    return nullValue();
+}
+
+// Recursive descent parser; tracks the position for error messages
+class JsonParser {
+public:
+    JsonParser(const char* text, size_t size) : p(text), begin(text), end(text + size) {}
+
+    bool parseDocument(JsonValue& result, std::string& error) {
+        skipWhitespace();
+        bool ok = parseValue(result, 0);
+        skipWhitespace();
+        if (ok && p != end)
+            ok = fail("trailing characters");
+        if (!ok)
+            error = message + " at offset " + std::to_string(failedAt - begin);
+        return ok;
+    }
+
+private:
+    const char* p;
+    const char* begin;
+    const char* end;
+    const char* failedAt = nullptr;
+    std::string message;
+
+    bool fail(const char* what) {
+        message = what;
+        failedAt = p;
+        return false;
+    }
+
+    void skipWhitespace() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            p++;
+    }
+
+    bool literal(const char* word) {
+        size_t length = strlen(word);
+        if (static_cast<size_t>(end - p) < length || memcmp(p, word, length) != 0)
+            return fail("invalid literal");
+        p += length;
+        return true;
+    }
+
+    bool parseValue(JsonValue& value, int depth) {
+        if (depth > JSON_MAX_DEPTH)
+            return fail("nesting too deep");
+        if (p >= end)
+            return fail("unexpected end");
+        switch (*p) {
+        case '{':
+            return parseObject(value, depth);
+        case '[':
+            return parseArray(value, depth);
+        case '"':
+            value.kind = JsonValue::Type::String;
+            return parseString(value.stringValue);
+        case 't':
+            value.kind = JsonValue::Type::Bool;
+            value.boolValue = true;
+            return literal("true");
+        case 'f':
+            value.kind = JsonValue::Type::Bool;
+            value.boolValue = false;
+            return literal("false");
+        case 'n':
+            value.kind = JsonValue::Type::Null;
+            return literal("null");
+        default:
+            return parseNumber(value);
+        }
+    }
+
+    bool parseNumber(JsonValue& value) {
+        // strtod needs a terminated string; numbers are short, so copy into a small buffer
+        char buffer[64];
+        size_t length = 0;
+        while (p + length < end && length + 1 < sizeof(buffer) && strchr("+-0123456789.eE", p[length]))
+            length++;
+        if (length == 0)
+            return fail("unexpected character");
+        memcpy(buffer, p, length);
+        buffer[length] = '\0';
+        char* parsedEnd = nullptr;
+        value.numberValue = std::strtod(buffer, &parsedEnd);
+        if (parsedEnd != buffer + length)
+            return fail("invalid number");
+        value.kind = JsonValue::Type::Number;
+        p += length;
+        return true;
+    }
+
+    bool parseHex4(unsigned int& codepoint) {
+        if (end - p < 4)
+            return fail("truncated escape");
+        codepoint = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = *p++;
+            codepoint <<= 4;
+            if (c >= '0' && c <= '9')
+                codepoint |= static_cast<unsigned int>(c - '0');
+            else if (c >= 'a' && c <= 'f')
+                codepoint |= static_cast<unsigned int>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F')
+                codepoint |= static_cast<unsigned int>(c - 'A' + 10);
+            else
+                return fail("invalid escape");
+        }
+        return true;
+    }
+
+    bool parseString(std::string& out) {
+        p++;
+        while (p < end && *p != '"') {
+            if (*p != '\\') {
+                out += *p++;
+                continue;
+            }
+            if (++p >= end)
+                break;
+            char escape = *p++;
+            switch (escape) {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                unsigned int codepoint;
+                if (!parseHex4(codepoint))
+                    return false;
+                // Surrogate pair
+                if (codepoint >= 0xD800 && codepoint < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                    p += 2;
+                    unsigned int low;
+                    if (!parseHex4(low))
+                        return false;
+                    codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                }
+                appendUtf8(out, codepoint);
+                break;
+            }
+            default:
+                return fail("invalid escape");
+            }
+        }
+        if (p >= end)
+            return fail("unterminated string");
+        p++;
+        return true;
+    }
+
+    bool parseArray(JsonValue& value, int depth) {
+        value.kind = JsonValue::Type::Array;
+        p++;
+        skipWhitespace();
+        if (p < end && *p == ']') {
+            p++;
+            return true;
+        }
+        while (true) {
+            value.elements.emplace_back();
+            skipWhitespace();
+            if (!parseValue(value.elements.back(), depth + 1))
+                return false;
+            skipWhitespace();
+            if (p < end && *p == ',') {
+                p++;
+            } else if (p < end && *p == ']') {
+                p++;
+                return true;
+            } else {
+                return fail("expected ',' or ']'");
+            }
+        }
+    }
+
+    bool parseObject(JsonValue& value, int depth) {
+        value.kind = JsonValue::Type::Object;
+        p++;
+        skipWhitespace();
+        if (p < end && *p == '}') {
+            p++;
+            return true;
+        }
+        while (true) {
+            skipWhitespace();
+            if (p >= end || *p != '"')
+                return fail("expected key");
+            value.members.emplace_back();
+            if (!parseString(value.members.back().first))
+                return false;
+            skipWhitespace();
+            if (p >= end || *p != ':')
+                return fail("expected ':'");
+            p++;
+            skipWhitespace();
+            if (!parseValue(value.members.back().second, depth + 1))
+                return false;
+            skipWhitespace();
+            if (p < end && *p == ',') {
+                p++;
+            } else if (p < end && *p == '}') {
+                p++;
+                return true;
+            } else {
+                return fail("expected ',' or '}'");
+            }
+        }
+    }
+};
+
+bool JsonValue::parse(const char* text, size_t size, JsonValue& result, std::string& error) {
+    result = JsonValue();
+    JsonParser parser(text, size);
+    return parser.parseDocument(result, error);
+}
@@ -0,0 +1,51 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Minimal JSON document, enough for asset manifests like glTF. Lookups of missing keys or
+// indices return a shared null value, so chains like doc["a"][0]["b"] never need checks.
+class JsonValue {
+public:
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type() const { return kind; }
+    bool isNull() const { return kind == Type::Null; }
+    bool isNumber() const { return kind == Type::Number; }
+    bool isString() const { return kind == Type::String; }
+    bool isArray() const { return kind == Type::Array; }
+    bool isObject() const { return kind == Type::Object; }
+
+    double number(double fallback = 0.0) const { return kind == Type::Number ? numberValue : fallback; }
+    // fallback as well for numbers that are not whole or do not fit an int
+    int integer(int fallback = 0) const;
+    bool boolean(bool fallback = false) const { return kind == Type::Bool ? boolValue : fallback; }
+    const std::string& string() const { return stringValue; }
+
+    // Array elements or object members
+    size_t size() const { return kind == Type::Object ? members.size() : elements.size(); }
+    const JsonValue& operator[](size_t index) const;
+    // Negative indices, e.g. from a missing integer field, wrap out of range and give null
+    const JsonValue& operator[](int index) const { return (*this)[static_cast<size_t>(index)]; }
+    const JsonValue& operator[](const char* key) const;
+    bool has(const char* key) const { return !(*this)[key].isNull(); }
+    const std::vector<std::pair<std::string, JsonValue>>& objectMembers() const { return members; }
+
+    // Parses a whole document. Returns false and fills error on malformed input.
+    static bool parse(const char* text, size_t size, JsonValue& result, std::string& error);
+
+private:
+    friend class JsonParser;
+
+    Type kind = Type::Null;
+    bool boolValue = false;
+    double numberValue = 0.0;
+    std::string stringValue;
+    std::vector<JsonValue> elements;
+    std::vector<std::pair<std::string, JsonValue>> members;
+};
+
+#endif
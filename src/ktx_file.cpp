@@ -0,0 +1,202 @@
+#include "ktx_file.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+namespace fs = std::filesystem;
+
+namespace {
+
+const unsigned char KTX2_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+const char* STAMP_KEY = "NPRsourceStamp";
+// Level data starts on a multiple of the block size
+const size_t LEVEL_ALIGNMENT = 16;
+
+struct KtxHeader {
+    unsigned char identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+
+struct KtxLevel {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+// VK_FORMAT_*_UNORM_BLOCK
+uint32_t vkFormatOf(BlockFormat format) {
+    switch (format) {
+    case BlockFormat::BC1:
+        return 131;
+    case BlockFormat::BC4:
+        return 139;
+    case BlockFormat::BC5:
+        return 141;
+    case BlockFormat::BC7:
+        return 145;
+    }
+    return 0;
+}
+
+bool blockFormatOf(uint32_t vkFormat, BlockFormat& format) {
+    for (BlockFormat candidate : {BlockFormat::BC1, BlockFormat::BC4, BlockFormat::BC5, BlockFormat::BC7}) {
+        if (vkFormatOf(candidate) == vkFormat) {
+            format = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+bool writeKtx2(const std::string& path, const CompressedTexture& texture, const std::string& stamp) {
+    // One key/value entry: its length, then the key and value, each NUL-terminated
+    std::string entry = std::string(STAMP_KEY) + '\0' + stamp + '\0';
+    uint32_t entryLength = static_cast<uint32_t>(entry.size());
+    size_t kvdLength = alignUp(sizeof(entryLength) + entry.size(), 4);
+
+    KtxHeader header = {};
+    memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+    header.vkFormat = vkFormatOf(texture.format);
+    header.typeSize = 1;
+    header.pixelWidth = static_cast<uint32_t>(texture.width);
+    header.pixelHeight = static_cast<uint32_t>(texture.height);
+    header.faceCount = 1;
+    header.levelCount = static_cast<uint32_t>(texture.levels.size());
+    header.kvdByteOffset = static_cast<uint32_t>(sizeof(KtxHeader) + texture.levels.size() * sizeof(KtxLevel));
+    header.kvdByteLength = static_cast<uint32_t>(kvdLength);
+
+    // KTX2 stores the smallest level first
+    std::vector<KtxLevel> index(texture.levels.size());
+    size_t offset = alignUp(header.kvdByteOffset + kvdLength, LEVEL_ALIGNMENT);
+    for (size_t i = texture.levels.size(); i-- > 0;) {
+        index[i].byteOffset = offset;
+        index[i].byteLength = texture.levels[i].size;
+        index[i].uncompressedByteLength = texture.levels[i].size;
+        offset = alignUp(offset + texture.levels[i].size, LEVEL_ALIGNMENT);
+    }
+
+    // Written to a temporary file first so a crash never leaves a truncated file behind
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        static const char zeros[LEVEL_ALIGNMENT] = {};
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(index.data()), static_cast<std::streamsize>(index.size() * sizeof(KtxLevel)));
+        out.write(reinterpret_cast<const char*>(&entryLength), sizeof(entryLength));
+        out.write(entry.data(), static_cast<std::streamsize>(entry.size()));
+        size_t written = header.kvdByteOffset + sizeof(entryLength) + entry.size();
+        for (size_t i = texture.levels.size(); i-- > 0;) {
+            out.write(zeros, static_cast<std::streamsize>(index[i].byteOffset - written));
+            out.write(reinterpret_cast<const char*>(texture.data.data() + texture.levels[i].offset),
+                      static_cast<std::streamsize>(texture.levels[i].size));
+            written = index[i].byteOffset + texture.levels[i].size;
+        }
+        if (!out) {
+            out.close();
+            std::error_code ec;
+            fs::remove(tempPath, ec);
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(tempPath, path, ec);
+    if (ec) {
+        fs::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
+
+bool readKtx2(const std::string& path, CompressedTexture& texture, std::string& stamp) {
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+    const unsigned char* base = file.data();
+    size_t size = file.size();
+
+    KtxHeader header;
+    if (size < sizeof(KtxHeader))
+        return false;
+    memcpy(&header, base, sizeof(header));
+    size_t indexSize = static_cast<size_t>(header.levelCount) * sizeof(KtxLevel);
+    if (memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0 ||
+        !blockFormatOf(header.vkFormat, texture.format) || header.supercompressionScheme != 0 ||
+        header.pixelDepth != 0 || header.layerCount > 1 || header.faceCount != 1 || header.levelCount == 0 ||
+        header.levelCount > 32 || sizeof(KtxHeader) + indexSize > size ||
+        static_cast<size_t>(header.kvdByteOffset) + header.kvdByteLength > size) {
+        std::cout << "WARNING::KTX::UNSUPPORTED_FILE: " << path << std::endl;
+        return false;
+    }
+
+    // Find the stamp among the key/value entries
+    stamp.clear();
+    size_t kvd = header.kvdByteOffset;
+    size_t kvdEnd = kvd + header.kvdByteLength;
+    while (kvd + sizeof(uint32_t) <= kvdEnd) {
+        uint32_t length;
+        memcpy(&length, base + kvd, sizeof(length));
+        kvd += sizeof(length);
+        if (length > kvdEnd - kvd)
+            break;
+        const char* key = reinterpret_cast<const char*>(base + kvd);
+        size_t keyLength = strnlen(key, length);
+        if (keyLength < length && strcmp(key, STAMP_KEY) == 0) {
+            const char* value = key + keyLength + 1;
+            stamp.assign(value, strnlen(value, length - keyLength - 1));
+        }
+        kvd = alignUp(kvd + length, 4);
+    }
+
+    texture.width = static_cast<int>(header.pixelWidth);
+    texture.height = static_cast<int>(header.pixelHeight);
+    texture.levels.assign(header.levelCount, CompressedTexture::Level());
+    size_t total = 0;
+    for (uint32_t i = 0; i < header.levelCount; i++) {
+        KtxLevel level;
+        memcpy(&level, base + sizeof(KtxHeader) + i * sizeof(KtxLevel), sizeof(level));
+        int width = std::max(1, texture.width >> i);
+        int height = std::max(1, texture.height >> i);
+        if (level.byteOffset > size || level.byteLength > size - level.byteOffset ||
+            level.byteLength != compressedLevelSize(texture.format, width, height)) {
+            std::cout << "WARNING::KTX::CORRUPT_FILE: " << path << std::endl;
+            return false;
+        }
+        texture.levels[i] = {total, static_cast<size_t>(level.byteLength), width, height};
+        total += static_cast<size_t>(level.byteLength);
+    }
+
+    texture.data.resize(total);
+    for (uint32_t i = 0; i < header.levelCount; i++) {
+        KtxLevel level;
+        memcpy(&level, base + sizeof(KtxHeader) + i * sizeof(KtxLevel), sizeof(level));
+        memcpy(texture.data.data() + texture.levels[i].offset, base + level.byteOffset, texture.levels[i].size);
+    }
+    return true;
+}
@@ -0,0 +1,16 @@
+#ifndef KTX_FILE_H
+#define KTX_FILE_H
+
+#include "texture_compressor.h"
+
+#include <string>
+
+// Reads and writes block-compressed mip chains as KTX 2.0 files: the standard header and level
+// index with the Vulkan format of the blocks, no supercompression and no data format descriptor.
+// One key/value entry carries a stamp that tells a stale file from a current one.
+bool writeKtx2(const std::string& path, const CompressedTexture& texture, const std::string& stamp);
+
+// Returns false when the file is missing, malformed or holds a format this renderer does not write
+bool readKtx2(const std::string& path, CompressedTexture& texture, std::string& stamp);
+
+#endif
@@ -8,10 +8,21 @@
 #include "imgui_impl_opengl3.h"
 
 #include "camera.h"
+#include "geometry_pool.h"
+#include "gl_resource.h"
+#include "mesh_cache.h"
 #include "model.h"
+#include "model_loader.h"
+#include "program_cache.h"
 #include "shader.h"
+#include "shader_variants.h"
+#include "texture_cache.h"
+#include "texture_compressor.h"
+#include "texture_streamer.h"
 #include "transform.h"
+#include "uniform_ring.h"
 
+#include <chrono>
 #include <filesystem>
 #include <iostream>
 #include <string>
@@ -35,10 +46,15 @@ bool fixed_lighting = false;
 // Timing
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
+std::chrono::steady_clock::time_point launchTime;
 
 // Shader index
 int currentShader = 0;
-std::vector<Shader> shaders;
+std::vector<ShaderVariants> shaders;
+ShaderQuality shaderQuality = ShaderQuality::High;
+// Style and quality being drawn; they follow the selection once its variants are ready, -1 before any is
+int drawnShader = -1;
+ShaderQuality drawnQuality = ShaderQuality::High;
 
 // ImGui Variables
 bool showDemoWindow = false;
@@ -58,6 +74,13 @@ bool useWhiteBackground = false;
 
 std::string modelPath = "";
 bool modelLoaded = false;
+ModelLoader modelLoader;
+
+// Meshlet culling
+bool clusterCulling = true;
+ClusterCullStats clusterStats;
+// Uniform setters of the model's shader in the last frame
+UniformStats uniformStats;
 
 std::string texturePath = "";
 bool textureLoaded = false;
@@ -105,6 +128,23 @@ bool SelectableButton(const char* label, bool isSelected) {
         return clicked;
 }
 
+double millisecondsSinceLaunch() {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - launchTime).count();
+}
+
+// Issues the compiles of a style's textured and untextured variants for a quality, and reports whether
+// both are ready to draw with
+bool styleReady(ShaderVariants& style, ShaderQuality quality) {
+        bool ready = true;
+        for (bool hasTexture : {false, true}) {
+                ShaderVariantKey key;
+                key.hasTexture = hasTexture;
+                key.quality = quality;
+                ready = style.ready(key) && ready;
+        }
+        return ready;
+}
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) { glViewport(0, 0, width, height); }
 
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn) {
@@ -233,16 +273,27 @@ void setupImGui(GLFWwindow* window) {
         ImGui_ImplOpenGL3_Init("#version 330");
 }
 
-// Load a 3D model
-bool loadModelFile(Model& model, const std::string& path) {
+// Load a 3D model in the background; the current model keeps rendering until it is swapped in
+void loadModelFile(const std::string& path) {
+        modelLoader.start(path);
+}
+
+// Swap in the model once the background load is done. Only the GL buffer creation runs here.
+void finishModelLoad(Model& model) {
+        if (!modelLoader.isReady())
+                return;
+
         try {
-                model = Model(path);
-                std::cout << "Model loaded successfully: " << path << std::endl;
-                camera.ResetOrientation();
-                return true;
+                if (modelLoader.finish(model)) {
+                        // Drops the texture picked for the previous model; material textures stay
+                        textureLoaded = false;
+                        texturePath = "";
+
+                        camera.ResetOrientation();
+                        modelLoaded = true;
+                }
         } catch (const std::exception& e) {
                 std::cerr << "Failed to load model: " << e.what() << std::endl;
-                return false;
         }
 }
 
@@ -305,7 +356,8 @@ void renderImGui(Model& ourModel, GLFWwindow* window) {
                                                 std::string extension = entry.path().extension().string();
                                                 if (extension == ".obj" || extension == ".fbx" || extension == ".stl" ||
                                                     extension == ".3ds" || extension == ".dae" ||
-                                                    extension == ".blend") {
+                                                    extension == ".blend" || extension == ".gltf" ||
+                                                    extension == ".glb") {
 
                                                         std::string filename = entry.path().filename().string();
                                                         if (ImGui::Button(
@@ -332,26 +384,79 @@ void renderImGui(Model& ourModel, GLFWwindow* window) {
 
                         if (ImGui::Button("Load Model")) {
                                 if (!modelPath.empty()) {
-                                        // Removes texture when placing models
-                                        ourModel.meshes[0].textures.clear();
-                                        textureLoaded = false;
-                                        texturePath = "";
-                                        Texture newTexture;
-                                        ourModel.replaceTextures({newTexture});
-
-                                        modelLoaded = loadModelFile(ourModel, modelPath);
-
-                                        // Set color of model to whats set
-                                        ourModel.replaceTextures({newTexture});
+                                        loadModelFile(modelPath);
                                 }
                         }
 
                         ImGui::SameLine();
 
                         if (ImGui::Button("Load Default Cube")) {
+                                modelLoader.cancel();
                                 ourModel = Model(); // Creates default cube
                                 modelLoaded = true;
                         }
+
+                        if (modelLoader.isLoading()) {
+                                std::string filename = fs::path(modelLoader.path()).filename().string();
+                                ImGui::Text("Loading %s", filename.c_str());
+                                ImGui::ProgressBar(modelLoader.progress(), ImVec2(-1.0f, 0.0f));
+                                if (ImGui::Button("Cancel")) {
+                                        modelLoader.cancel();
+                                }
+                        }
+
+                        MeshCache& meshCache = MeshCache::instance();
+                        ImGui::Text("Mesh cache: %u hits, %u misses", meshCache.hits(), meshCache.misses());
+                        TextureCacheStats textureStats = TextureCache::shared().stats();
+                        ImGui::Text("Texture cache: %u hits, %u misses, %u decodes", textureStats.hits,
+                                    textureStats.misses, textureStats.decodes);
+                        ImGui::Text("Textures: %zu live (%zu KB), %zu in this model", textureStats.liveTextures,
+                                    textureStats.textureBytes / 1024, ourModel.textures_loaded.size());
+                        TextureStreamStats streamStats = TextureStreamer::shared().stats();
+                        if (streamStats.compressed > 0) {
+                                ImGui::Text("Compressed textures: %u, %u from disk", streamStats.compressed,
+                                            streamStats.compressedCacheHits);
+                        }
+                        if (streamStats.decoding > 0 || streamStats.uploading > 0) {
+                                ImGui::Text("Streaming textures: %u decoding, %zu uploading", streamStats.decoding,
+                                            streamStats.uploading);
+                        }
+
+                        ImGui::Text("Draw calls: %zu, texture binds: %zu", clusterStats.drawCalls,
+                                    clusterStats.textureBinds);
+                        ImGui::Text("Uniforms: %zu uploaded, %zu unchanged, %zu inactive", uniformStats.uploads,
+                                    uniformStats.unchanged, uniformStats.inactive);
+                        UniformRingStats ringStats = UniformRing::shared().stats();
+                        ImGui::Text("Uniform ring: %zu bytes per frame, %u fence waits%s", ringStats.frameBytes,
+                                    ringStats.fenceWaits, ringStats.persistent ? "" : " (not mapped)");
+                        if (ourModel.atlasPending()) {
+                                ImGui::Text("Texture array: building...");
+                        } else if (ourModel.atlasLayers() > 0) {
+                                ImGui::Text("Texture array: %d layers", ourModel.atlasLayers());
+                        }
+
+                        ImGui::Checkbox("Cluster Culling", &clusterCulling);
+                        if (clusterCulling) {
+                                size_t culled = clusterStats.frustumCulled + clusterStats.backfaceCulled;
+                                ImGui::Text("Clusters: %zu/%zu drawn in %zu ranges", clusterStats.clusters - culled,
+                                            clusterStats.clusters, clusterStats.drawRanges);
+                                ImGui::Text("Culled: %zu frustum, %zu backface", clusterStats.frustumCulled,
+                                            clusterStats.backfaceCulled);
+                        }
+
+                        if (ourModel.lodsPending()) {
+                                ImGui::Text("LOD: building...");
+                        } else {
+                                ImGui::Text("LOD: %u (%u levels), %zu triangles", ourModel.drawnLod(),
+                                            ourModel.lodCount(), clusterStats.triangles);
+                        }
+                        // Simplifies again from the imported geometry, which may come back from the mesh cache or GPU
+                        ImGui::SetNextItemWidth(SLIDER_WIDTH);
+                        ImGui::SliderFloat("LOD Reduction", &Model::lodSettings.reduction, 0.1f, 0.9f);
+                        if (ImGui::Button("Rebuild LODs") && !ourModel.rebuildLods())
+                                std::cerr << "Cannot rebuild LODs: the model's geometry is not available" << std::endl;
+                        ImGui::Text("Geometry: %zu KB on GPU, %zu KB on CPU", ourModel.gpuGeometryBytes() / 1024,
+                                    ourModel.cpuGeometryBytes() / 1024);
                 }
 
                 if (ImGui::CollapsingHeader("Lighting", ImGuiTreeNodeFlags_DefaultOpen)) {
@@ -429,8 +534,8 @@ void renderImGui(Model& ourModel, GLFWwindow* window) {
                                 if (!texturePath.empty()) {
                                         Texture newTexture;
 
-                                        // Load the texture as a diffuse texture
-                                        if (newTexture.loadTextureFromFile(texturePath)) {
+                                        // Load the texture as a diffuse texture, which holds sRGB color
+                                        if (newTexture.loadTextureFromFile(texturePath, true)) {
                                                 // Replace textures in the model
                                                 ourModel.replaceTextures({newTexture});
 
@@ -462,6 +567,28 @@ void renderImGui(Model& ourModel, GLFWwindow* window) {
                         // Shader selection
                         const char* shaderNames[] = {"Standard", "Cel", "Watercolor", "Sketch"};
                         ImGui::Combo("Shader", &currentShader, shaderNames, IM_ARRAYSIZE(shaderNames));
+                        const char* qualityNames[] = {"Low", "Medium", "High"};
+                        int quality = static_cast<int>(shaderQuality);
+                        if (ImGui::Combo("Shader Quality", &quality, qualityNames, IM_ARRAYSIZE(qualityNames)))
+                                shaderQuality = static_cast<ShaderQuality>(quality);
+                        if (currentShader != drawnShader || shaderQuality != drawnQuality) {
+                                ImGui::Text("Compiling %s (%s)...", shaderNames[currentShader],
+                                            Shader::parallelCompile() ? "parallel" : "blocking");
+                        }
+
+                        // Every permutation compiled so far; each compiles once and is reused
+                        if (ImGui::TreeNode("Shader variants")) {
+                                for (const ShaderVariants& style : shaders) {
+                                        std::vector<ShaderVariantInfo> variants = style.compiled();
+                                        ImGui::Text("%s: %zu compiled, %zu pending, %u reused", style.name().c_str(),
+                                                    variants.size(), style.pending(), style.hits());
+                                        for (const ShaderVariantInfo& variant : variants) {
+                                                ImGui::BulletText("%s: %.1f ms", variant.key.c_str(),
+                                                                  variant.compileMilliseconds);
+                                        }
+                                }
+                                ImGui::TreePop();
+                        }
                 }
 
                 ImGui::Separator();
@@ -514,71 +641,26 @@ void renderImGui(Model& ourModel, GLFWwindow* window) {
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 
-int main(int argc, char** argv) {
-        std::string modelPath = "../models/Baby_Groot_Funko_Pop.stl";
-        if (argc > 1) {
-                modelPath = argv[1];
-        }
-
-        // Initialize GLFW
-        if (!glfwInit()) {
-                std::cerr << "Failed to initialize GLFW" << std::endl;
-                return -1;
-        }
-
-        // Configure GLFW
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-        // Create window
-        GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "NPR Renderer", NULL, NULL);
-        if (window == NULL) {
-                std::cout << "Failed to create GLFW window" << std::endl;
-                glfwTerminate();
-                return -1;
-        }
-        glfwMakeContextCurrent(window);
-        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-        glfwSetCursorPosCallback(window, mouse_callback);
-        glfwSetMouseButtonCallback(window, mouse_button_callback);
-        glfwSetScrollCallback(window, scroll_callback);
-        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-
-        glewExperimental = GL_TRUE; // Needed for core profile
-        if (glewInit() != GLEW_OK) {
-                std::cout << "Failed to initialize GLEW" << std::endl;
-                return -1;
-        }
-
-        // Print OpenGL version info
-        std::cout << "OpenGL Version: " << glGetString(GL_VERSION) << std::endl;
-        std::cout << "GLSL Version: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
-
-        // Configure global OpenGL state
-        glEnable(GL_DEPTH_TEST);
-
-        // Setup ImGui
-        setupImGui(window);
+// Loads the shaders and runs the render loop until the window closes. Every GL object created
+// here is released on return, before the context goes away.
+void runRenderer(GLFWwindow* window) {
+        // Style variants compile the first time a frame needs them
+        shaders.emplace_back("Standard", "../shaders/standard.vert", "../shaders/standard.frag");
+        shaders.emplace_back("Cel", "../shaders/Cel.vert", "../shaders/Cel.frag");
+        shaders.emplace_back("Watercolor", "../shaders/standard.vert", "../shaders/Watercolor.frag");
+        shaders.emplace_back("Sketch", "../shaders/standard.vert", "../shaders/Sketch.frag");
 
-        // Load shaders
+        // Issue the selected style and the grid first, so the driver compiles them while the rest starts up
         std::cout << "Attempting to load shader from: shaders/standard.frag" << std::endl;
-        Shader standardShader("../shaders/standard.vert", "../shaders/standard.frag");
-        Shader celShader("../shaders/Cel.vert", "../shaders/Cel.frag");
-        Shader watercolorShader("../shaders/standard.vert", "../shaders/Watercolor.frag");
-        Shader sketchShader("../shaders/standard.vert", "../shaders/Sketch.frag");
-        Shader gridShader("../shaders/grid.vert", "../shaders/grid.frag");
-        Shader outlineShader("shaders/outline.vert", "shaders/outline.frag");
-
-        shaders.push_back(standardShader);
-        shaders.push_back(celShader);
-        shaders.push_back(watercolorShader);
-        shaders.push_back(sketchShader);
+        styleReady(shaders[currentShader], shaderQuality);
+        Shader gridShader("../shaders/grid.vert", "../shaders/grid.frag", ShaderDefines(), ShaderBuild::Parallel);
+        Shader outlineShader("../shaders/Outline.vert", "../shaders/Outline.frag");
 
+        // Noise and paper are data read by the watercolor shader, not color
         Texture noiseTexture, paperTexture;
-        if (!noiseTexture.loadTextureFromFile("../textures/noise.png"))
+        if (!noiseTexture.loadTextureFromFile("../textures/noise.png", false))
                 std::cerr << "Failed to load noise texture" << std::endl;
-        if (!paperTexture.loadTextureFromFile("../textures/paper.png"))
+        if (!paperTexture.loadTextureFromFile("../textures/paper.png", false))
                 std::cerr << "Failed to load paper texture" << std::endl;
 
         Model gridModel;
@@ -590,6 +672,7 @@ int main(int argc, char** argv) {
         camera.SetOrbitTarget(glm::vec3(0.0f, 0.0f, 0.0f));
 
         // Render loop
+        bool firstFrame = true;
         while (!glfwWindowShouldClose(window)) {
                 // Per-frame time logic
                 float currentFrame = static_cast<float>(glfwGetTime());
@@ -599,8 +682,19 @@ int main(int argc, char** argv) {
                 // Input
                 processInput(window);
 
+                // Switch to the selected style once its variants are compiled; the previous one draws until then
+                if ((currentShader != drawnShader || shaderQuality != drawnQuality) &&
+                    styleReady(shaders[currentShader], shaderQuality)) {
+                        if (drawnShader < 0) {
+                                std::cout << "Style " << shaders[currentShader].name() << " ready "
+                                          << millisecondsSinceLaunch() << " ms after launch" << std::endl;
+                        }
+                        drawnShader = currentShader;
+                        drawnQuality = shaderQuality;
+                }
+
                 // Render
-                if (useWhiteBackground || currentShader == 2 || currentShader == 3) {
+                if (useWhiteBackground || drawnShader == 2 || drawnShader == 3) {
                         glClearColor(1.0f, 1.0f, 1.0f, 1.0f); // White
                 } else {
                         glClearColor(0.1f, 0.1f, 0.1f, 1.0f); // Dark gray / black
@@ -608,16 +702,13 @@ int main(int argc, char** argv) {
 
                 glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-                // Activate shader
-                shaders[currentShader].use();
-
-                // Set shader uniforms
+                // Frame and object constants, written once and read by every program
+                UniformRing& uniformRing = UniformRing::shared();
+                uniformRing.beginFrame();
                 glm::mat4 projection =
                         glm::perspective(glm::radians(camera.Zoom),
                                          static_cast<float>(SCR_WIDTH) / static_cast<float>(SCR_HEIGHT), 0.1f, 100.0f);
                 glm::mat4 view = camera.GetViewMatrix();
-                shaders[currentShader].setMat4("projection", projection);
-                shaders[currentShader].setMat4("view", view);
 
                 // Light properties
                 glm::vec3 lightPos(lightPosX, lightPosY, lightPosZ);
@@ -625,63 +716,80 @@ int main(int argc, char** argv) {
                         lightPos = camera.Position + camera.Front * 2.0f;
                 }
 
-                shaders[currentShader].setVec3("lightPos", lightPos);
-                shaders[currentShader].setVec3("viewPos", camera.Position);
-                shaders[currentShader].setVec3("lightColor", glm::vec3(1.0f, 1.0f, 1.0f));
-
-                // Set custom lighting parameters from ImGui
-                shaders[currentShader].setFloat("ambientStrength", ambientStrength);
-                shaders[currentShader].setFloat("specularStrength", specularStrength);
-                shaders[currentShader].setFloat("shininess", shininess);
-
-                // Optional: Pass time to shader for animation effects
-                shaders[currentShader].setFloat("time", currentFrame);
+                FrameConstants frameConstants;
+                frameConstants.projection = projection;
+                frameConstants.view = view;
+                frameConstants.viewPos = camera.Position;
+                frameConstants.lightPos = lightPos;
+                frameConstants.lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
+                // Custom lighting parameters from ImGui
+                frameConstants.ambientStrength = ambientStrength;
+                frameConstants.specularStrength = specularStrength;
+                frameConstants.shininess = shininess;
+                // Optional: time for animation effects
+                frameConstants.time = currentFrame;
+                uniformRing.bind(FRAME_CONSTANTS_BINDING, frameConstants);
 
                 // Render the model
                 glm::mat4 model = modelTransform.GetModelMatrix();
-                shaders[currentShader].setMat4("model", model);
+                uniformRing.bind(OBJECT_CONSTANTS_BINDING, ObjectConstants::fromModel(model));
 
-                if (!ourModel.meshes.empty()) {
-                        if (textureLoaded) {
+                // Nothing is drawn with a style until one has compiled
+                if (drawnShader >= 0) {
+                        if (!ourModel.meshes.empty() && textureLoaded) {
                                 // Texture is loaded
                                 ourModel.meshes[0].textures[0].bind(0);
-                                shaders[currentShader].setInt("hasTexture", 1);
-                                shaders[currentShader].setInt("texture_diffuse1", 0);
-                        } else {
-                                // No texture, use solid color
-                                // std::cout << "no texture" << std::endl;
-                                shaders[currentShader].setInt("hasTexture", 0);
                         }
-
-                        if (currentShader == 2) {
+                        if (drawnShader == 2) {
                                 noiseTexture.bind(1);
                                 paperTexture.bind(1);
-                                shaders[currentShader].setInt("u_noise_texture", 1);
-                                shaders[currentShader].setInt("u_paper_texture", 2);
-
-                                shaders[currentShader].setVec3("u_color1", glm::vec3(col1.x, col1.y, col1.z));
-                                shaders[currentShader].setVec3("u_color2", glm::vec3(col2.x, col2.y, col2.z));
-                                shaders[currentShader].setVec3("u_color3", glm::vec3(col3.x, col3.y, col3.z));
-                                shaders[currentShader].setVec3("u_color4", glm::vec3(col4.x, col4.y, col4.z));
-
-                                shaders[currentShader].setFloat("u_edge_intensity", edgeIntensityValue);
-                                shaders[currentShader].setFloat("u_edge_noise", edgeNoiseValue);
-                                shaders[currentShader].setFloat("u_granulation", granulationValue);
-                                shaders[currentShader].setFloat("u_paper_visibility", paperVisibilityValue);
-                                shaders[currentShader].setFloat("u_transparency", transparencyValue);
-
                                 glEnable(GL_BLEND);
                                 glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
                         }
-                }
 
-                // Set object color from ImGui
-                shaders[currentShader].setVec3("objectColor", glm::vec3(objectColor.x, objectColor.y, objectColor.z));
-                // shaders[currentShader].setVec3("objectColor", glm::vec3(0.7, 0.1, 0.1));
+                        // The model picks the textured or untextured variant per mesh, so both get the style's
+                        // uniforms
+                        ShaderVariants& style = shaders[drawnShader];
+                        for (bool hasTexture : {false, true}) {
+                                ShaderVariantKey key;
+                                key.hasTexture = hasTexture;
+                                key.quality = drawnQuality;
+                                Shader& shader = style.get(key);
+                                shader.use();
+                                shader.setInt("texture_diffuse1", 0);
+
+                                if (drawnShader == 2) {
+                                        shader.setInt("u_noise_texture", 1);
+                                        shader.setInt("u_paper_texture", 2);
+
+                                        shader.setVec3("u_color1", glm::vec3(col1.x, col1.y, col1.z));
+                                        shader.setVec3("u_color2", glm::vec3(col2.x, col2.y, col2.z));
+                                        shader.setVec3("u_color3", glm::vec3(col3.x, col3.y, col3.z));
+                                        shader.setVec3("u_color4", glm::vec3(col4.x, col4.y, col4.z));
+
+                                        shader.setFloat("u_edge_intensity", edgeIntensityValue);
+                                        shader.setFloat("u_edge_noise", edgeNoiseValue);
+                                        shader.setFloat("u_granulation", granulationValue);
+                                        shader.setFloat("u_paper_visibility", paperVisibilityValue);
+                                        shader.setFloat("u_transparency", transparencyValue);
+                                }
 
-                ourModel.Draw(shaders[currentShader]);
+                                // Set object color from ImGui
+                                shader.setVec3("objectColor",
+                                               glm::vec3(objectColor.x, objectColor.y, objectColor.z));
+                        }
+
+                        ClusterView clusterView = ClusterView::fromMatrices(projection, view, model);
+                        clusterView.frustumCulling = clusterCulling;
+                        // Watercolor blends, so back faces show through and must not be culled
+                        clusterView.coneCulling = clusterCulling && drawnShader != 2;
+                        ourModel.Draw(style, drawnQuality, clusterView, camera, modelTransform,
+                                      static_cast<float>(SCR_HEIGHT));
+                        clusterStats = clusterView.stats;
+                        uniformStats = style.takeUniformStats();
+                }
 
-                if (showGrid) {
+                if (showGrid && gridShader.poll()) {
                         // Enable transparency
                         glEnable(GL_BLEND);
                         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -689,26 +797,172 @@ int main(int argc, char** argv) {
                         // Use grid shader
                         gridShader.use();
 
-                        // Set standard uniforms
-                        gridShader.setMat4("projection", projection);
-                        gridShader.setMat4("view", view);
-                        gridShader.setMat4("model", glm::mat4(1.0f));
+                        // The frame constants are bound already; the grid sits at the origin
+                        uniformRing.bind(OBJECT_CONSTANTS_BINDING, ObjectConstants::fromModel(glm::mat4(1.0f)));
 
-                        // Draw the grid
-                        gridModel.Draw(gridShader);
+                        // Draw the grid; its shader only reads positions
+                        gridModel.DrawPositions(gridShader);
 
                         // Restore OpenGL state
                         glDisable(GL_BLEND);
                 }
+                uniformRing.endFrame();
 
                 // Render ImGui interface
                 renderImGui(ourModel, window);
 
+                // Swap in a background-loaded model once its data is ready
+                finishModelLoad(ourModel);
+
+                // Stage decoded textures, within the per-frame upload budget
+                TextureStreamer::shared().update();
+
                 // Swap buffers and poll events
                 glfwSwapBuffers(window);
                 glfwPollEvents();
+
+                // Programs built for the first frame, from the binary cache or from source
+                if (firstFrame) {
+                        std::cout << "First frame presented " << millisecondsSinceLaunch() << " ms after launch"
+                                  << std::endl;
+                        ProgramCacheStats programStats = ProgramCache::shared().stats();
+                        std::cout << "Programs: " << programStats.cached << " from cache in "
+                                  << programStats.cachedMilliseconds << " ms, " << programStats.compiled
+                                  << " compiled in " << programStats.compiledMilliseconds << " ms";
+                        if (programStats.invalid > 0)
+                                std::cout << " (" << programStats.invalid << " stale cache entries)";
+                        std::cout << std::endl;
+                        firstFrame = false;
+                }
+        }
+}
+
+int main(int argc, char** argv) {
+        launchTime = std::chrono::steady_clock::now();
+        std::string modelPath = "../models/Baby_Groot_Funko_Pop.stl";
+        bool compareReaders = false;
+        std::string compressDirectoryPath;
+        bool compressSrgb = false;
+        for (int i = 1; i < argc; i++) {
+                std::string arg = argv[i];
+                if (arg == "--import-threads" && i + 1 < argc) {
+                        // Threads used to process meshes on import, 0 uses all of them
+                        Model::importSettings.threads = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+                } else if (arg == "--crease-angle" && i + 1 < argc) {
+                        // STL faces meeting at a sharper angle keep hard edges
+                        Model::importSettings.stl.creaseAngle = std::strtof(argv[++i], nullptr);
+                } else if (arg == "--full-vertices") {
+                        // Upload float vertices and 32-bit indices instead of the quantized layout
+                        Mesh::layoutSettings.quantize = false;
+                } else if (arg == "--tangent-frames") {
+                        // Add packed tangent frames to the quantized layout
+                        Mesh::layoutSettings.tangentFrames = true;
+                } else if (arg == "--texture-budget" && i + 1 < argc) {
+                        // Texture pixels staged for upload per frame, in MB
+                        TextureStreamer::shared().uploadBudget =
+                                static_cast<size_t>(std::strtod(argv[++i], nullptr) * 1024.0 * 1024.0);
+                } else if (arg == "--no-texture-compression") {
+                        // Upload textures as plain RGBA instead of BC blocks
+                        TextureStreamer::shared().compression.enabled = false;
+                } else if (arg == "--mip-filter" && i + 1 < argc) {
+                        // Kernel for texture mip levels: box, kaiser or lanczos
+                        if (!parseMipFilter(argv[++i], TextureStreamer::shared().mips.filter)) {
+                                std::cerr << "Unknown mip filter: " << argv[i] << std::endl;
+                        }
+                } else if (arg == "--shader-quality" && i + 1 < argc) {
+                        // Quality tier of the style shaders: low, medium or high
+                        if (!parseShaderQuality(argv[++i], shaderQuality)) {
+                                std::cerr << "Unknown shader quality: " << argv[i] << std::endl;
+                        }
+                } else if (arg == "--no-alpha-coverage") {
+                        // Let alpha-tested textures thin out with distance
+                        TextureStreamer::shared().mips.preserveCoverage = false;
+                } else if (arg == "--no-texture-arrays") {
+                        // Bind each mesh's own textures instead of one texture array per model
+                        Model::atlasSettings.enabled = false;
+                } else if (arg == "--compress-textures" && i + 1 < argc) {
+                        // Write compressed KTX2 copies of every image in a directory and exit
+                        compressDirectoryPath = argv[++i];
+                } else if (arg == "--srgb") {
+                        // The images given to --compress-textures are color (albedo) rather than data
+                        compressSrgb = true;
+                } else if (arg == "--no-program-cache") {
+                        // Compile every shader from source instead of loading cached program binaries
+                        ProgramCache::shared().enabled = false;
+                } else if (arg == "--keep-geometry") {
+                        // Keep the CPU copy of model geometry after it is uploaded
+                        Model::defaultGeometryPolicy = CpuGeometryPolicy::Keep;
+                } else if (arg == "--compare-readers") {
+                        // Benchmark the native OBJ/STL reader against Assimp and exit
+                        compareReaders = true;
+                } else {
+                        modelPath = arg;
+                }
+        }
+        if (compareReaders) {
+                Model::compareReaders(modelPath);
+                return 0;
+        }
+        if (!compressDirectoryPath.empty()) {
+                compressDirectory(compressDirectoryPath, compressSrgb, TextureStreamer::shared().mips,
+                                  Model::importSettings.threads);
+                return 0;
         }
 
+        // Initialize GLFW
+        if (!glfwInit()) {
+                std::cerr << "Failed to initialize GLFW" << std::endl;
+                return -1;
+        }
+
+        // Configure GLFW
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        // Create window
+        GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "NPR Renderer", NULL, NULL);
+        if (window == NULL) {
+                std::cout << "Failed to create GLFW window" << std::endl;
+                glfwTerminate();
+                return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetMouseButtonCallback(window, mouse_button_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+
+        glewExperimental = GL_TRUE; // Needed for core profile
+        if (glewInit() != GLEW_OK) {
+                std::cout << "Failed to initialize GLEW" << std::endl;
+                return -1;
+        }
+
+        // Print OpenGL version info
+        std::cout << "OpenGL Version: " << glGetString(GL_VERSION) << std::endl;
+        std::cout << "GLSL Version: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
+
+        // Configure global OpenGL state
+        glEnable(GL_DEPTH_TEST);
+
+        // Setup ImGui
+        setupImGui(window);
+
+        runRenderer(window);
+
+        // Stop any model still loading and wait for its worker, before the GL context and the thread
+        // pool it uses go away
+        modelLoader.shutdown();
+
+        // Release the remaining GL objects while the context is current and report any left behind
+        shaders.clear();
+        TextureStreamer::shared().shutdown();
+        GeometryPool::shared().shutdown();
+        UniformRing::shared().shutdown();
+        GlResourceRegistry::shared().reportLeaks();
+
         // Cleanup ImGui
         ImGui_ImplOpenGL3_Shutdown();
         ImGui_ImplGlfw_Shutdown();
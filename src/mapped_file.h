@@ -0,0 +1,36 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. Move-only; the mapping is released on destruction.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // Maps the file at path, returns false if it cannot be opened or is empty
+    bool open(const std::string& path);
+
+    // Unmaps the file
+    void close();
+
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+    bool isOpen() const { return bytes != nullptr; }
+
+private:
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+};
+#endif
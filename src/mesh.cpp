@@ -1,4 +1,35 @@
 #include "mesh.h"
+#include "geometry_pool.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "vertex_format.h"
+#include "vertex_quantizer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+VertexLayoutSettings Mesh::layoutSettings;
+
+namespace {
+
+const UniformId OBJECT_COLOR = Shader::uniformId("objectColor");
+const UniformId USE_MATERIAL_ARRAY = Shader::uniformId("useMaterialArray");
+const UniformId MATERIAL_LAYER = Shader::uniformId("materialLayer");
+const UniformId MATERIAL_RECT = Shader::uniformId("materialRect");
+const UniformId POSITION_SCALE = Shader::uniformId("positionScale");
+const UniformId POSITION_OFFSET = Shader::uniformId("positionOffset");
+const UniformId OCTAHEDRAL_NORMALS = Shader::uniformId("octahedralNormals");
+
+// 16-bit copy of indices that are known to fit
+std::vector<uint16_t> narrowIndices(const unsigned int* indices, size_t count) {
+    std::vector<uint16_t> narrow(count);
+    for (size_t i = 0; i < count; i++)
+        narrow[i] = static_cast<uint16_t>(indices[i]);
+    return narrow;
+}
+
+} // namespace
 
 Mesh::Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const std::vector<Texture>& textures) {
     this->vertices = vertices;
@@ -6,49 +37,345 @@ Mesh::Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>&
     this->textures = textures;
 
     // Now that we have all the required data, set the vertex buffers and its attribute pointers.
-    setupMesh();
-}
-
-void Mesh::setupMesh() {
-    // Create buffers/arrays
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
-    // Load data into vertex buffers
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-    // Set the vertex attribute pointers
-    // Vertex Positions
-    glEnableVertexAttribArray(0);   
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-    // Vertex Normals
-    glEnableVertexAttribArray(1);   
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-    // Vertex Texture Coords
-    glEnableVertexAttribArray(2);   
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-    // Vertex Tangent
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-    // Vertex Bitangent
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-    glBindVertexArray(0);
-}
-
-void Mesh::Draw(Shader &shader) {
+    setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
+    setupMeshlets({}, this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
+}
+
+Mesh::Mesh(const MeshData& data) {
+    textures = data.textures;
+
+    if (data.hasStreams()) {
+        // Meshlets come with the streams, the layout is not known here
+        setupStreams(data);
+        setupMeshlets(data.meshlets, nullptr, data.streamVertexCount, nullptr, data.streamIndexCount);
+        return;
+    }
+
+    // The CPU copy stays with the caller (the Model shares it with the LOD build)
+    setupMesh(data.vertexData(), data.vertexCount(), data.indexData(), data.indexCount());
+    setupMeshlets(data.meshlets, data.vertexData(), data.vertexCount(), data.indexData(), data.indexCount());
+}
+
+void Mesh::setupMesh(const Vertex* vertexData, size_t vertexCount, const unsigned int* indexData, size_t indexCount) {
+    this->indexCount = static_cast<unsigned int>(indexCount);
+    bool shortIndices = layoutSettings.quantize && vertexCount <= 65536;
+    indexType = shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    indexSize = shortIndices ? sizeof(uint16_t) : sizeof(unsigned int);
+
+    // Load data into the vertex arena; the format's shared array holds the attribute pointers
+    if (layoutSettings.quantize)
+        setupQuantizedVertices(vertexData, vertexCount);
+    else
+        setupFullVertices(vertexData, vertexCount);
+    vertexBytes = vertexRange->size + (positionRange ? positionRange->size : 0);
+
+    GpuArena& arena = GeometryPool::shared().indices;
+    indexBytes = indexCount * indexSize;
+    indexRange = arena.allocate(indexBytes, indexSize);
+    if (shortIndices) {
+        std::vector<uint16_t> narrow = narrowIndices(indexData, indexCount);
+        arena.upload(indexRange, 0, indexBytes, narrow.data());
+    } else {
+        arena.upload(indexRange, 0, indexBytes, indexData);
+    }
+}
+
+void Mesh::setupQuantizedVertices(const Vertex* vertexData, size_t vertexCount) {
+    glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+    if (vertexCount > 0) {
+        boundsMin = boundsMax = vertexData[0].Position;
+        for (size_t i = 1; i < vertexCount; i++) {
+            boundsMin = glm::min(boundsMin, vertexData[i].Position);
+            boundsMax = glm::max(boundsMax, vertexData[i].Position);
+        }
+    }
+    positionOffset = boundsMin;
+    positionScale = boundsMax - boundsMin;
+    octahedralNormals = true;
+
+    std::vector<QuantizedVertex> packed(vertexCount);
+    quantizeVertices(vertexData, vertexCount, positionOffset, positionScale, packed.data());
+    if (layoutSettings.tangentFrames) {
+        std::vector<QuantizedTangentFrame> frames(vertexCount);
+        encodeTangentFrames(vertexData, vertexCount, frames.data());
+        std::vector<QuantizedFramedVertex> framed(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++)
+            framed[i] = {packed[i], frames[i]};
+        uploadVertices<QuantizedFramedVertexFormat>(framed.data(), vertexCount);
+    } else {
+        uploadVertices<QuantizedVertexFormat>(packed.data(), vertexCount);
+    }
+
+    if (layoutSettings.positionStream) {
+        std::vector<QuantizedPosition> positions(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++)
+            memcpy(positions[i].position, packed[i].position, sizeof(positions[i].position));
+        uploadPositions<QuantizedPositionFormat>(positions.data(), vertexCount);
+    }
+}
+
+void Mesh::setupFullVertices(const Vertex* vertexData, size_t vertexCount) {
+    uploadVertices<FullVertexFormat>(vertexData, vertexCount);
+
+    if (layoutSettings.positionStream) {
+        std::vector<glm::vec3> positions(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++)
+            positions[i] = vertexData[i].Position;
+        uploadPositions<PositionFormat>(positions.data(), vertexCount);
+    }
+}
+
+template <typename Format>
+void Mesh::uploadVertices(const typename Format::VertexType* records, size_t count) {
+    GpuArena& arena = GeometryPool::shared().vertices;
+    // Aligned to the record size, so the offset is a whole number of vertices
+    vertexRange = arena.allocate(count * Format::stride, Format::stride);
+    arena.upload(vertexRange, 0, vertexRange->size, records);
+    vertexStride = Format::stride;
+    formatArray = &GeometryPool::vertexArray<Format>;
+}
+
+template <typename Format>
+void Mesh::uploadPositions(const typename Format::VertexType* records, size_t count) {
+    GpuArena& arena = GeometryPool::shared().vertices;
+    positionRange = arena.allocate(count * Format::stride, Format::stride);
+    arena.upload(positionRange, 0, positionRange->size, records);
+    positionStride = Format::stride;
+    positionFormatArray = &GeometryPool::vertexArray<Format>;
+}
+
+void Mesh::setupStreams(const MeshData& data) {
+    indexCount = static_cast<unsigned int>(data.streamIndexCount);
+    indexType = data.streamIndexType;
+    indexSize = indexType == GL_UNSIGNED_SHORT ? 2 : indexType == GL_UNSIGNED_BYTE ? 1 : 4;
+
+    // Streams that share bytes (interleaved attributes) are uploaded once, as one range
+    struct Range {
+        const unsigned char* begin;
+        const unsigned char* end;
+        size_t offset;
+    };
+    std::vector<const VertexStream*> order;
+    for (const VertexStream& stream : data.streams)
+        order.push_back(&stream);
+    std::sort(order.begin(), order.end(), [](const VertexStream* a, const VertexStream* b) { return a->data < b->data; });
+    std::vector<Range> ranges;
+    for (const VertexStream* stream : order) {
+        const unsigned char* begin = static_cast<const unsigned char*>(stream->data);
+        if (!ranges.empty() && begin < ranges.back().end) {
+            ranges.back().end = std::max(ranges.back().end, begin + stream->size);
+        } else {
+            ranges.push_back({begin, begin + stream->size, 0});
+        }
+    }
+    // Ranges start at the same alignment they had in the file, so attribute offsets stay aligned
+    size_t total = 0;
+    for (Range& range : ranges) {
+        total += (reinterpret_cast<uintptr_t>(range.begin) - total) & 3;
+        range.offset = total;
+        total += range.end - range.begin;
+    }
+
+    GeometryPool& pool = GeometryPool::shared();
+    vertexBytes = total;
+    vertexRange = pool.vertices.allocate(total, 4);
+    for (const Range& range : ranges)
+        pool.vertices.upload(vertexRange, range.offset, range.end - range.begin, range.begin);
+
+    indexBytes = data.streamIndexCount * indexSize;
+    indexRange = pool.indices.allocate(indexBytes, indexSize);
+    pool.indices.upload(indexRange, 0, indexBytes, data.streamIndices);
+
+    bool hasPositions = false;
+    for (const VertexStream& stream : data.streams) {
+        const unsigned char* begin = static_cast<const unsigned char*>(stream.data);
+        const Range* range = &ranges.front();
+        while (begin >= range->end)
+            range++;
+        size_t offset = range->offset + (begin - range->begin);
+        streamAttributes.push_back({stream.location, stream.components, stream.type, stream.normalized, stream.stride,
+                                    offset});
+        hasPositions = hasPositions || stream.location == 0;
+    }
+
+    // The layout is only known at run time, so these meshes keep arrays of their own. The position
+    // stream can be drawn on its own straight from the same range.
+    streamArray = GlVertexArray::create("stream vertex array");
+    if (hasPositions && layoutSettings.positionStream)
+        streamPositionArray = GlVertexArray::create("stream vertex array");
+    setupStreamArrays();
+}
+
+void Mesh::setupStreamArrays() {
+    GeometryPool& pool = GeometryPool::shared();
+    glBindBuffer(GL_ARRAY_BUFFER, pool.vertices.buffer());
+    for (GLuint array : {streamArray.id(), streamPositionArray.id()}) {
+        if (array == 0)
+            continue;
+        pool.bindVertexArray(array);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.indices.buffer());
+        for (const StreamAttribute& attribute : streamAttributes) {
+            if (array == streamPositionArray.id() && attribute.location != 0)
+                continue;
+            glEnableVertexAttribArray(attribute.location);
+            glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized,
+                                  attribute.stride, (void*)(vertexRange->offset + attribute.offset));
+        }
+    }
+    streamGeneration = pool.generation();
+}
+
+GLint Mesh::bindGeometry(bool positionsOnly) {
+    GeometryPool& pool = GeometryPool::shared();
+    if (!formatArray) {
+        // Arena buffers that moved or grew leave the attribute pointers stale
+        if (streamGeneration != pool.generation())
+            setupStreamArrays();
+        pool.bindVertexArray(positionsOnly && streamPositionArray ? streamPositionArray.id() : streamArray.id());
+        return 0;
+    }
+    if (positionsOnly && positionFormatArray) {
+        positionFormatArray();
+        return static_cast<GLint>(positionRange->offset / positionStride);
+    }
+    formatArray();
+    return static_cast<GLint>(vertexRange->offset / vertexStride);
+}
+
+void Mesh::setupMeshlets(std::vector<Meshlet> built, const Vertex* vertexData, size_t vertexCount,
+                         const unsigned int* indexData, size_t indexCount) {
+    MeshLod full;
+    full.indexCount = static_cast<unsigned int>(indexCount);
+    full.meshlets = built.empty() && vertexData ? buildMeshlets(vertexData, vertexCount, indexData, indexCount)
+                                                : std::move(built);
+    full.cullData.assign(full.meshlets);
+    meshletVisible.resize(full.meshlets.size());
+    drawCounts.reserve(full.meshlets.size());
+    drawOffsets.reserve(full.meshlets.size());
+    drawBaseVertices.reserve(full.meshlets.size());
+    lods.clear();
+    lods.push_back(std::move(full));
+}
+
+void Mesh::releaseCpuGeometry() {
+    std::vector<Vertex>().swap(vertices);
+    std::vector<unsigned int>().swap(indices);
+}
+
+bool Mesh::readBack(MeshData& out) const {
+    if (!formatArray)
+        return false;
+
+    GeometryPool& pool = GeometryPool::shared();
+    size_t vertexCount = vertexStride > 0 ? vertexRange->size / vertexStride : 0;
+    std::vector<unsigned char> records(vertexRange->size);
+    pool.vertices.download(vertexRange, 0, records.size(), records.data());
+
+    // LOD0 only; simplified levels are rebuilt from it
+    size_t count = lods.empty() ? indexCount : lods[0].indexCount;
+    out.indices.resize(count);
+    if (indexType == GL_UNSIGNED_SHORT) {
+        std::vector<uint16_t> narrow(count);
+        pool.indices.download(indexRange, 0, count * sizeof(uint16_t), narrow.data());
+        for (size_t i = 0; i < count; i++)
+            out.indices[i] = narrow[i];
+    } else {
+        pool.indices.download(indexRange, 0, count * sizeof(unsigned int), out.indices.data());
+    }
+
+    out.vertices.resize(vertexCount);
+    if (octahedralNormals) {
+        dequantizeVertices(records.data(), vertexStride, vertexCount, positionOffset, positionScale, out.vertices.data());
+        computeTangents(out.vertices, out.indices);
+    } else {
+        memcpy(out.vertices.data(), records.data(), vertexCount * sizeof(Vertex));
+    }
+
+    out.textures = textures;
+    if (!lods.empty())
+        out.meshlets = lods[0].meshlets;
+    return true;
+}
+
+void Mesh::clearLods() {
+    if (lods.size() > 1)
+        lods.resize(1);
+}
+
+void Mesh::addLods(std::vector<LodLevel>&& levels) {
+    if (levels.empty())
+        return;
+
+    size_t existing = lods.back().indexOffset + lods.back().indexCount;
+    size_t total = existing;
+    for (const LodLevel& level : levels)
+        total += level.indices.size();
+
+    // Move to a bigger index range: copy the current levels over, then append the new ones
+    GpuArena& arena = GeometryPool::shared().indices;
+    ArenaRange grown = arena.allocate(total * indexSize, indexSize);
+    arena.copy(indexRange, grown, existing * indexSize);
+    indexBytes = total * indexSize;
+
+    size_t offset = existing;
+    for (LodLevel& level : levels) {
+        // Levels index the same vertices, so they fit the mesh's index size
+        if (indexType == GL_UNSIGNED_SHORT) {
+            std::vector<uint16_t> narrow = narrowIndices(level.indices.data(), level.indices.size());
+            arena.upload(grown, offset * indexSize, narrow.size() * indexSize, narrow.data());
+        } else {
+            arena.upload(grown, offset * indexSize, level.indices.size() * indexSize, level.indices.data());
+        }
+
+        MeshLod lod;
+        lod.indexOffset = static_cast<unsigned int>(offset);
+        lod.indexCount = static_cast<unsigned int>(level.indices.size());
+        lod.error = level.error;
+        lod.meshlets = std::move(level.meshlets);
+        for (Meshlet& meshlet : lod.meshlets)
+            meshlet.indexOffset += lod.indexOffset;
+        lod.cullData.assign(lod.meshlets);
+        meshletVisible.resize(std::max(meshletVisible.size(), lod.meshlets.size()));
+        offset += level.indices.size();
+        lods.push_back(std::move(lod));
+    }
+    // Frees the old range
+    indexRange = std::move(grown);
+}
+
+unsigned int Mesh::selectLod(float pixelsPerUnit, float maxPixelError) const {
+    for (size_t i = lods.size() - 1; i > 0; i--) {
+        if (lods[i].error * pixelsPerUnit <= maxPixelError)
+            return static_cast<unsigned int>(i);
+    }
+    return 0;
+}
+
+bool Mesh::hasDiffuseTexture(bool atlasBound) const {
+    if (atlasBound && atlasSlot.layer >= 0)
+        return true;
+    // Material textures, or the one picked in the UI
+    return std::any_of(textures.begin(), textures.end(),
+                       [](const Texture &texture) { return texture.type == "texture_diffuse" && texture.id != 0; });
+}
+
+unsigned int Mesh::bindTextures(Shader &shader, bool atlasBound) {
+    // With the model's array bound only the mesh's place in it changes. Meshes that are not in it
+    // bind their own textures as usual.
+    bool inAtlas = atlasBound && atlasSlot.layer >= 0;
+    shader.setBool(USE_MATERIAL_ARRAY, inAtlas);
+    if (inAtlas) {
+        shader.setFloat(MATERIAL_LAYER, static_cast<float>(atlasSlot.layer));
+        shader.setVec4(MATERIAL_RECT, atlasSlot.rect);
+        return 0;
+    }
+
     // Since we're temporarily removing texture support, we'll just set a default color
     // in the shader if no textures are available
     if (textures.empty()) {
         // Set a default color if no textures are provided
-        shader.setVec3("objectColor", glm::vec3(0.8f, 0.8f, 0.8f));
+        shader.setVec3(OBJECT_COLOR, glm::vec3(0.8f, 0.8f, 0.8f));
+        return 0;
     }
     else {
         // Bind textures if available (this code remains for future support)
@@ -61,8 +388,9 @@ void Mesh::Draw(Shader &shader) {
             glActiveTexture(GL_TEXTURE0 + i);
             std::string number;
             std::string name = textures[i].type;
-            if(name == "texture_diffuse")
+            if(name == "texture_diffuse") {
                 number = std::to_string(diffuseNr++);
+            }
             else if(name == "texture_specular")
                 number = std::to_string(specularNr++);
             else if(name == "texture_normal")
@@ -70,15 +398,71 @@ void Mesh::Draw(Shader &shader) {
             else if(name == "texture_height")
                 number = std::to_string(heightNr++);
 
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+            shader.setInt(name + number, static_cast<int>(i));
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
+        return static_cast<unsigned int>(textures.size());
     }
+}
+
+void Mesh::setDecodeUniforms(Shader &shader) {
+    shader.setVec3(POSITION_SCALE, positionScale);
+    shader.setVec3(POSITION_OFFSET, positionOffset);
+    shader.setBool(OCTAHEDRAL_NORMALS, octahedralNormals);
+}
+
+void Mesh::Draw(Shader &shader, bool atlasBound) {
+    bindTextures(shader, atlasBound);
+    setDecodeUniforms(shader);
     
     // Draw mesh
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    GLint baseVertex = bindGeometry(false);
+    glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, indexType, reinterpret_cast<const void*>(indexRange->offset),
+                             baseVertex);
+
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void Mesh::DrawPositions(Shader &shader) {
+    setDecodeUniforms(shader);
+    GLint baseVertex = bindGeometry(true);
+    glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, indexType, reinterpret_cast<const void*>(indexRange->offset),
+                             baseVertex);
+}
+
+void Mesh::Draw(Shader &shader, ClusterView &view, unsigned int lod, bool atlasBound) {
+    const MeshLod& level = lods[std::min<size_t>(lod, lods.size() - 1)];
+    const std::vector<Meshlet>& meshlets = level.meshlets;
+    cullMeshlets(level.cullData, view, meshletVisible.data());
+
+    // Meshlets are consecutive in the index buffer, so neighbouring survivors merge into one range
+    size_t indexBase = indexRange->offset;
+    drawCounts.clear();
+    drawOffsets.clear();
+    for (size_t i = 0; i < meshlets.size(); i++) {
+        if (!meshletVisible[i])
+            continue;
+        GLsizei count = static_cast<GLsizei>(meshlets[i].triangleCount * 3);
+        if (i > 0 && meshletVisible[i - 1]) {
+            drawCounts.back() += count;
+        } else {
+            drawCounts.push_back(count);
+            drawOffsets.push_back(reinterpret_cast<const void*>(indexBase + static_cast<size_t>(meshlets[i].indexOffset) * indexSize));
+        }
+    }
+    view.stats.drawRanges += drawCounts.size();
+    for (GLsizei count : drawCounts)
+        view.stats.triangles += static_cast<size_t>(count) / 3;
+    if (drawCounts.empty())
+        return;
+
+    view.stats.textureBinds += bindTextures(shader, atlasBound);
+    view.stats.drawCalls++;
+    setDecodeUniforms(shader);
+    GLint baseVertex = bindGeometry(false);
+    drawBaseVertices.assign(drawCounts.size(), baseVertex);
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawCounts.data(), indexType, drawOffsets.data(),
+                                  static_cast<GLsizei>(drawCounts.size()), drawBaseVertices.data());
 
     glActiveTexture(GL_TEXTURE0);
-}
\ No newline at end of file
+}
@@ -5,9 +5,13 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "gl_resource.h"
+#include "gpu_arena.h"
+#include "meshlet.h"
 #include "shader.h"
 #include "texture.h"
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -19,25 +23,219 @@ struct Vertex {
     glm::vec3 Bitangent;
 };
 
+// A vertex attribute kept in the encoding of the file it came from, uploaded byte for byte
+struct VertexStream {
+    GLuint location;
+    GLint components;
+    GLenum type;
+    GLboolean normalized;
+    // Bytes between elements; 0 when tightly packed
+    GLsizei stride;
+    const void* data;
+    size_t size;
+};
+
+// Decoded pixels for a material slot (texture_diffuse, texture_normal, ...). Shared by every mesh
+// that uses the image, and turned into a texture on the GL thread.
+struct MaterialImage {
+    std::string type;
+    std::shared_ptr<const std::vector<unsigned char>> pixels;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    // Canonical source file and how it was decoded, the TextureCache key; empty for images that
+    // are not files of their own (embedded or data URIs). Pixels may be null for a file whose
+    // texture the cache still holds.
+    std::string path;
+    TextureDecodeParams params;
+};
+
+// Where a mesh's diffuse image sits in its model's texture array: the layer, and the rectangle of
+// the layer the image covers in texture coordinates (offset in xy, size in zw). Layer -1 when the
+// mesh has no image there.
+struct AtlasSlot {
+    int layer = -1;
+    glm::vec4 rect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+};
+
+// CPU-side geometry of a single mesh before it is uploaded. Either owns its arrays, or views
+// memory that is kept alive by `backing` (e.g. a memory-mapped mesh cache file).
+struct MeshData {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<Texture> textures;
+    // Built on import; the Mesh constructors build them when empty
+    std::vector<Meshlet> meshlets;
+
+    std::vector<MaterialImage> materialImages;
+
+    // Geometry in a file's own layout (glTF), uploaded without converting to Vertex. Used instead of
+    // the arrays above when streams is not empty; the pointers stay valid through backing.
+    std::vector<VertexStream> streams;
+    const void* streamIndices = nullptr;
+    GLenum streamIndexType = GL_UNSIGNED_INT;
+    size_t streamVertexCount = 0;
+    size_t streamIndexCount = 0;
+
+    const Vertex* vertexView = nullptr;
+    const unsigned int* indexView = nullptr;
+    size_t viewVertexCount = 0;
+    size_t viewIndexCount = 0;
+    std::shared_ptr<const void> backing;
+
+    const Vertex* vertexData() const { return vertexView ? vertexView : vertices.data(); }
+    const unsigned int* indexData() const { return indexView ? indexView : indices.data(); }
+    size_t vertexCount() const { return vertexView ? viewVertexCount : vertices.size(); }
+    size_t indexCount() const { return indexView ? viewIndexCount : indices.size(); }
+    bool hasStreams() const { return !streams.empty(); }
+};
+
+struct LodLevel;
+
+// GPU vertex layout for meshes uploaded from Vertex arrays, set from the command line
+struct VertexLayoutSettings {
+    // Upload QuantizedVertex (16 bytes) instead of Vertex (56 bytes), and 16-bit indices when the
+    // mesh has at most 65536 vertices. The vertex shaders decode it with the uniforms set in Draw.
+    bool quantize = true;
+    // Also upload a packed tangent frame per vertex at location 3 (quantized layout only)
+    bool tangentFrames = false;
+    // Keep a separate position-only copy for passes that read nothing but aPos (grid, outline,
+    // depth), so they fetch 8 or 12 bytes per vertex instead of the whole record
+    bool positionStream = true;
+};
+
+// One level of detail: a range of the mesh's element buffer and the meshlets covering it
+struct MeshLod {
+    unsigned int indexOffset = 0;
+    unsigned int indexCount = 0;
+    // Simplification error in model units; 0 for the full mesh
+    float error = 0.0f;
+    std::vector<Meshlet> meshlets;
+    MeshletCullData cullData;
+};
+
 class Mesh {
 public:
     // Mesh Data
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
     std::vector<Texture> textures;
-    unsigned int VAO;
+    unsigned int indexCount;
+    // lods[0] is the full mesh; simplified levels are added once they are built
+    std::vector<MeshLod> lods;
+    // Set once the model's texture array is built; used instead of textures while it is bound
+    AtlasSlot atlasSlot;
+
+    static VertexLayoutSettings layoutSettings;
 
     // Constructor
     Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const std::vector<Texture>& textures);
 
-    // Render the mesh
-    void Draw(Shader &shader);
+    // Constructor from imported data; uploads straight from it without keeping a CPU copy
+    explicit Mesh(const MeshData& data);
+
+    // Render the mesh; atlasBound as below
+    void Draw(Shader &shader, bool atlasBound = false);
+
+    // Render with only the position stream bound, for shaders that read nothing but aPos
+    void DrawPositions(Shader &shader);
+
+    // Render only the meshlets of a LOD that survive culling against view, merged into as few ranges as possible.
+    // With atlasBound the model's texture array is bound already and only atlasSlot is set.
+    void Draw(Shader &shader, ClusterView &view, unsigned int lod = 0, bool atlasBound = false);
+
+    // Whether drawing samples a diffuse texture, i.e. needs the HAS_TEXTURE variant of a style shader
+    bool hasDiffuseTexture(bool atlasBound) const;
+
+    // Coarsest LOD whose error stays under maxPixelError at pixelsPerUnit screen pixels per model unit
+    unsigned int selectLod(float pixelsPerUnit, float maxPixelError) const;
+
+    // Appends simplified levels to the index range; their indices refer to the existing vertices
+    void addLods(std::vector<LodLevel>&& levels);
+    // Keeps only the full-detail level; addLods moves the indices to a range of the new size
+    void clearLods();
+
+    // Bytes of the vertex and index arenas held by the mesh
+    size_t gpuBytes() const { return vertexBytes + indexBytes; }
+
+    // Frees the vertices and indices kept by the first constructor once they are on the GPU
+    void releaseCpuGeometry();
+
+    // Rebuilds the full-detail geometry from the arenas: positions, normals and texture coordinates
+    // within the precision of the uploaded layout, tangents recomputed. False for file stream
+    // meshes, whose layout is not known here.
+    bool readBack(MeshData& out) const;
 
 private:
-    // Render data
-    unsigned int VBO, EBO;
+    // Render data, in ranges of the GeometryPool arenas. The position-only copy is null when there
+    // is none; file stream meshes point their position array into vertexRange instead.
+    ArenaRange vertexRange;
+    ArenaRange positionRange;
+    ArenaRange indexRange;
+    GLenum indexType = GL_UNSIGNED_INT;
+    unsigned int indexSize = sizeof(unsigned int);
+    size_t vertexBytes = 0;
+    size_t indexBytes = 0;
+
+    // Shared vertex arrays of the mesh's formats, and the record sizes that turn range offsets into
+    // base vertices; null for file stream meshes
+    GLuint (*formatArray)() = nullptr;
+    GLuint (*positionFormatArray)() = nullptr;
+    size_t vertexStride = 0;
+    size_t positionStride = 0;
+
+    // Layout of a file stream mesh, relative to vertexRange, for re-pointing its own arrays when
+    // the arena buffer is replaced
+    struct StreamAttribute {
+        GLuint location;
+        GLint components;
+        GLenum type;
+        GLboolean normalized;
+        GLsizei stride;
+        size_t offset;
+    };
+    std::vector<StreamAttribute> streamAttributes;
+    // Own vertex arrays of a file stream mesh: all streams, and just the position stream if any
+    GlVertexArray streamArray;
+    GlVertexArray streamPositionArray;
+    unsigned int streamGeneration = 0;
+
+    // Maps quantized attributes back in the vertex shader; identity for float layouts
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+    bool octahedralNormals = false;
+
+    // Culling state, reused every frame
+    std::vector<uint8_t> meshletVisible;
+    std::vector<GLsizei> drawCounts;
+    std::vector<const void*> drawOffsets;
+    std::vector<GLint> drawBaseVertices;
+
+    // Returns the number of textures bound
+    unsigned int bindTextures(Shader &shader, bool atlasBound);
+    void setDecodeUniforms(Shader &shader);
+
+    // Initializes all the buffer objects/arrays, in the vertex formats picked by layoutSettings
+    void setupMesh(const Vertex* vertexData, size_t vertexCount, const unsigned int* indexData, size_t indexCount);
+    void setupQuantizedVertices(const Vertex* vertexData, size_t vertexCount);
+    void setupFullVertices(const Vertex* vertexData, size_t vertexCount);
+
+    // Copies records into the vertex arena and draws them through the shared array of Format
+    template <typename Format>
+    void uploadVertices(const typename Format::VertexType* records, size_t count);
+    template <typename Format>
+    void uploadPositions(const typename Format::VertexType* records, size_t count);
+
+    // Binds the array for a full or position-only draw and returns the base vertex to draw with
+    GLint bindGeometry(bool positionsOnly);
+
+    // Uploads vertex streams and indices as they are, with attribute pointers matching their layout
+    void setupStreams(const MeshData& data);
+    void setupStreamArrays();
 
-    // Initializes all the buffer objects/arrays
-    void setupMesh();
+    // Sets up LOD0 from the given meshlets, or builds them from the geometry when there are none and
+    // vertexData is given
+    void setupMeshlets(std::vector<Meshlet> built, const Vertex* vertexData, size_t vertexCount,
+                       const unsigned int* indexData, size_t indexCount);
 };
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,363 @@
+#include "mesh_cache.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+namespace fs = std::filesystem;
+
+namespace {
+
+const uint32_t MESH_CACHE_MAGIC = 0x4d52504e; // "NPRM"
+const size_t MESH_CACHE_ALIGNMENT = 16;
+const char* MESH_CACHE_EXTENSION = ".mcache";
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexSize;
+    uint32_t meshCount;
+    uint32_t meshletSize;
+    uint32_t reserved;
+    uint64_t importFlags;
+    int64_t sourceTime;
+    uint64_t pathLength;
+};
+
+struct CacheEntry {
+    uint64_t vertexOffset;
+    uint64_t vertexCount;
+    uint64_t indexOffset;
+    uint64_t indexCount;
+    uint64_t meshletOffset;
+    uint64_t meshletCount;
+    // Material images as "type channels flip path" lines
+    uint64_t materialOffset;
+    uint64_t materialSize;
+};
+
+uint64_t fnv1a(const std::string& text, uint64_t hash = 14695981039346656037ull) {
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string encodeMaterials(const std::vector<MaterialImage>& images) {
+    std::string text;
+    for (const MaterialImage& image : images) {
+        text += image.type + ' ' + std::to_string(image.params.channels) + ' ' +
+                (image.params.flipVertically ? '1' : '0') + ' ' + (image.params.srgb ? '1' : '0') + ' ' +
+                image.path + '\n';
+    }
+    return text;
+}
+
+// Images come back with their paths only; the caller decodes them
+bool decodeMaterials(const char* text, size_t size, std::vector<MaterialImage>& images) {
+    std::istringstream in(std::string(text, size));
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        MaterialImage image;
+        int flip = 0, srgb = 0;
+        if (!(fields >> image.type >> image.params.channels >> flip >> srgb))
+            return false;
+        image.params.flipVertically = flip != 0;
+        image.params.srgb = srgb != 0;
+        fields.get();
+        std::getline(fields, image.path);
+        if (image.path.empty())
+            return false;
+        images.push_back(image);
+    }
+    return true;
+}
+
+size_t alignUp(size_t value) {
+    return (value + MESH_CACHE_ALIGNMENT - 1) & ~(MESH_CACHE_ALIGNMENT - 1);
+}
+
+// Whether count elements of elementSize bytes at offset lie within a file of size bytes. The
+// offset and count come from the file, so they are checked without sums that could wrap.
+bool fitsInFile(uint64_t offset, uint64_t count, size_t elementSize, size_t size) {
+    return offset <= size && count <= (size - offset) / elementSize;
+}
+
+void writePadding(std::ofstream& out, size_t& offset) {
+    static const char zeros[MESH_CACHE_ALIGNMENT] = {};
+    size_t aligned = alignUp(offset);
+    out.write(zeros, static_cast<std::streamsize>(aligned - offset));
+    offset = aligned;
+}
+
+} // namespace
+
+MeshCache& MeshCache::instance() {
+    static MeshCache cache;
+    return cache;
+}
+
+void MeshCache::setDirectory(const std::string& dir) {
+    std::lock_guard<std::mutex> lock(mutex);
+    directory = dir;
+}
+
+void MeshCache::setMaxBytes(uintmax_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    maxBytes = bytes;
+    evict();
+}
+
+std::string MeshCache::entryPath(const std::string& sourcePath, uint64_t importFlags, int64_t& sourceTime) const {
+    std::error_code ec;
+    fs::path canonical = fs::weakly_canonical(sourcePath, ec);
+    if (ec)
+        return "";
+    auto writeTime = fs::last_write_time(canonical, ec);
+    if (ec)
+        return "";
+    sourceTime = static_cast<int64_t>(writeTime.time_since_epoch().count());
+
+    std::string key = canonical.string() + '\n' + std::to_string(sourceTime) + '\n' + std::to_string(importFlags) +
+                      '\n' + std::to_string(MESH_CACHE_VERSION);
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(fnv1a(key)));
+    return (fs::path(directory) / (std::string(name) + MESH_CACHE_EXTENSION)).string();
+}
+
+bool MeshCache::load(const std::string& sourcePath, uint64_t importFlags, std::vector<MeshData>& meshes) {
+    bool hit = read(sourcePath, importFlags, meshes);
+    if (hit)
+        hitCount++;
+    else
+        missCount++;
+    return hit;
+}
+
+bool MeshCache::reload(const std::string& sourcePath, uint64_t importFlags, std::vector<MeshData>& meshes) {
+    return read(sourcePath, importFlags, meshes);
+}
+
+bool MeshCache::read(const std::string& sourcePath, uint64_t importFlags, std::vector<MeshData>& meshes) {
+    int64_t sourceTime = 0;
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        path = entryPath(sourcePath, importFlags, sourceTime);
+    }
+
+    auto file = std::make_shared<MappedFile>();
+    if (path.empty() || !file->open(path))
+        return false;
+
+    // Validate everything before handing out views into the mapping
+    const unsigned char* base = file->data();
+    size_t size = file->size();
+    CacheHeader header;
+    if (size < sizeof(CacheHeader))
+        return false;
+    memcpy(&header, base, sizeof(header));
+
+    size_t tableOffset = sizeof(CacheHeader);
+    size_t tableSize = static_cast<size_t>(header.meshCount) * sizeof(CacheEntry);
+    if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION ||
+        header.vertexSize != sizeof(Vertex) || header.meshletSize != sizeof(Meshlet) || header.importFlags != importFlags || header.sourceTime != sourceTime ||
+        !fitsInFile(tableOffset, header.meshCount, sizeof(CacheEntry), size) ||
+        !fitsInFile(tableOffset + tableSize, header.pathLength, 1, size)) {
+        std::cout << "WARNING::MESH_CACHE::STALE_ENTRY: " << path << std::endl;
+        return false;
+    }
+
+    std::vector<MeshData> loaded(header.meshCount);
+    std::shared_ptr<const void> backing = file;
+    for (uint32_t i = 0; i < header.meshCount; i++) {
+        CacheEntry entry;
+        memcpy(&entry, base + tableOffset + i * sizeof(CacheEntry), sizeof(entry));
+        if (entry.vertexOffset % MESH_CACHE_ALIGNMENT != 0 || entry.indexOffset % MESH_CACHE_ALIGNMENT != 0 ||
+            entry.meshletOffset % MESH_CACHE_ALIGNMENT != 0 ||
+            !fitsInFile(entry.vertexOffset, entry.vertexCount, sizeof(Vertex), size) ||
+            !fitsInFile(entry.indexOffset, entry.indexCount, sizeof(unsigned int), size) ||
+            !fitsInFile(entry.meshletOffset, entry.meshletCount, sizeof(Meshlet), size) ||
+            !fitsInFile(entry.materialOffset, entry.materialSize, 1, size)) {
+            std::cout << "WARNING::MESH_CACHE::CORRUPT_ENTRY: " << path << std::endl;
+            return false;
+        }
+
+        MeshData& data = loaded[i];
+        data.vertexView = reinterpret_cast<const Vertex*>(base + entry.vertexOffset);
+        data.viewVertexCount = static_cast<size_t>(entry.vertexCount);
+        data.indexView = reinterpret_cast<const unsigned int*>(base + entry.indexOffset);
+        data.viewIndexCount = static_cast<size_t>(entry.indexCount);
+        data.backing = backing;
+        // Meshlets are small and kept by the Mesh for culling, so they are copied out
+        const Meshlet* meshlets = reinterpret_cast<const Meshlet*>(base + entry.meshletOffset);
+        data.meshlets.assign(meshlets, meshlets + entry.meshletCount);
+        if (!decodeMaterials(reinterpret_cast<const char*>(base + entry.materialOffset),
+                             static_cast<size_t>(entry.materialSize), data.materialImages)) {
+            std::cout << "WARNING::MESH_CACHE::CORRUPT_ENTRY: " << path << std::endl;
+            return false;
+        }
+    }
+
+    // Touch the entry so eviction sees it as recently used
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+
+    meshes = std::move(loaded);
+    return true;
+}
+
+bool MeshCache::store(const std::string& sourcePath, uint64_t importFlags, const std::vector<MeshData>& meshes) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    int64_t sourceTime = 0;
+    std::string path = entryPath(sourcePath, importFlags, sourceTime);
+    if (path.empty())
+        return false;
+
+    std::error_code ec;
+    fs::create_directories(directory, ec);
+    if (ec) {
+        std::cout << "ERROR::MESH_CACHE::CANNOT_CREATE_DIRECTORY: " << directory << std::endl;
+        return false;
+    }
+
+    std::string source = fs::weakly_canonical(sourcePath, ec).string();
+
+    CacheHeader header = {};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.vertexSize = sizeof(Vertex);
+    header.meshletSize = sizeof(Meshlet);
+    header.meshCount = static_cast<uint32_t>(meshes.size());
+    header.importFlags = importFlags;
+    header.sourceTime = sourceTime;
+    header.pathLength = source.size();
+
+    // Lay out the data blocks after the header, entry table and source path
+    std::vector<CacheEntry> entries(meshes.size());
+    std::vector<std::string> materials(meshes.size());
+    size_t offset = alignUp(sizeof(CacheHeader) + entries.size() * sizeof(CacheEntry) + source.size());
+    for (size_t i = 0; i < meshes.size(); i++) {
+        entries[i].vertexOffset = offset;
+        entries[i].vertexCount = meshes[i].vertexCount();
+        offset = alignUp(offset + meshes[i].vertexCount() * sizeof(Vertex));
+        entries[i].indexOffset = offset;
+        entries[i].indexCount = meshes[i].indexCount();
+        offset = alignUp(offset + meshes[i].indexCount() * sizeof(unsigned int));
+        entries[i].meshletOffset = offset;
+        entries[i].meshletCount = meshes[i].meshlets.size();
+        offset = alignUp(offset + meshes[i].meshlets.size() * sizeof(Meshlet));
+        materials[i] = encodeMaterials(meshes[i].materialImages);
+        entries[i].materialOffset = offset;
+        entries[i].materialSize = materials[i].size();
+        offset = alignUp(offset + materials[i].size());
+    }
+
+    // Write to a temporary file first so a crash never leaves a truncated entry behind
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cout << "ERROR::MESH_CACHE::CANNOT_WRITE: " << tempPath << std::endl;
+            return false;
+        }
+
+        size_t written = 0;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(entries.data()),
+                  static_cast<std::streamsize>(entries.size() * sizeof(CacheEntry)));
+        out.write(source.data(), static_cast<std::streamsize>(source.size()));
+        written = sizeof(header) + entries.size() * sizeof(CacheEntry) + source.size();
+        writePadding(out, written);
+
+        for (size_t i = 0; i < meshes.size(); i++) {
+            const MeshData& mesh = meshes[i];
+            size_t vertexBytes = mesh.vertexCount() * sizeof(Vertex);
+            out.write(reinterpret_cast<const char*>(mesh.vertexData()), static_cast<std::streamsize>(vertexBytes));
+            written += vertexBytes;
+            writePadding(out, written);
+
+            size_t indexBytes = mesh.indexCount() * sizeof(unsigned int);
+            out.write(reinterpret_cast<const char*>(mesh.indexData()), static_cast<std::streamsize>(indexBytes));
+            written += indexBytes;
+            writePadding(out, written);
+
+            size_t meshletBytes = mesh.meshlets.size() * sizeof(Meshlet);
+            out.write(reinterpret_cast<const char*>(mesh.meshlets.data()), static_cast<std::streamsize>(meshletBytes));
+            written += meshletBytes;
+            writePadding(out, written);
+
+            out.write(materials[i].data(), static_cast<std::streamsize>(materials[i].size()));
+            written += materials[i].size();
+            writePadding(out, written);
+        }
+
+        if (!out) {
+            std::cout << "ERROR::MESH_CACHE::CANNOT_WRITE: " << tempPath << std::endl;
+            out.close();
+            fs::remove(tempPath, ec);
+            return false;
+        }
+    }
+
+    fs::rename(tempPath, path, ec);
+    if (ec) {
+        fs::remove(tempPath, ec);
+        return false;
+    }
+
+    evict();
+    return true;
+}
+
+uintmax_t MeshCache::sizeOnDisk() const {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    uintmax_t total = 0;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(directory, ec)) {
+        if (entry.path().extension() == MESH_CACHE_EXTENSION)
+            total += entry.file_size(ec);
+    }
+    return total;
+}
+
+void MeshCache::evict() {
+    struct CacheFile {
+        fs::path path;
+        uintmax_t size;
+        fs::file_time_type lastUsed;
+    };
+
+    std::vector<CacheFile> files;
+    uintmax_t total = 0;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(directory, ec)) {
+        if (entry.path().extension() != MESH_CACHE_EXTENSION)
+            continue;
+        CacheFile file = {entry.path(), entry.file_size(ec), entry.last_write_time(ec)};
+        total += file.size;
+        files.push_back(file);
+    }
+    if (total <= maxBytes)
+        return;
+
+    // Oldest first
+    std::sort(files.begin(), files.end(),
+              [](const CacheFile& a, const CacheFile& b) { return a.lastUsed < b.lastUsed; });
+    for (const CacheFile& file : files) {
+        if (total <= maxBytes)
+            break;
+        if (fs::remove(file.path, ec)) {
+            total -= file.size;
+            std::cout << "Mesh cache evicted: " << file.path.filename().string() << std::endl;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "mesh.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Bump whenever the layout of a cache file or of the data stored in it changes
+const uint32_t MESH_CACHE_VERSION = 6;
+
+// On-disk cache of imported meshes so repeat loads can skip Assimp entirely.
+// Entries are keyed by the source path, its modification time and the import flags, hold the
+// final Vertex/index arrays, meshlets and material image paths of every mesh and are memory-mapped on load. The cache directory is
+// kept under a size budget by evicting the least recently used entries.
+class MeshCache {
+public:
+    static MeshCache& instance();
+
+    void setDirectory(const std::string& dir);
+    void setMaxBytes(uintmax_t bytes);
+
+    // Fills meshes with views into the mapped cache entry. Returns false on a miss.
+    bool load(const std::string& sourcePath, uint64_t importFlags, std::vector<MeshData>& meshes);
+    // Same as load, for geometry brought back after import; not counted in hits() and misses()
+    bool reload(const std::string& sourcePath, uint64_t importFlags, std::vector<MeshData>& meshes);
+
+    // Writes the imported meshes of sourcePath to the cache, then evicts entries over budget
+    bool store(const std::string& sourcePath, uint64_t importFlags, const std::vector<MeshData>& meshes);
+
+    unsigned int hits() const { return hitCount; }
+    unsigned int misses() const { return missCount; }
+    uintmax_t sizeOnDisk() const;
+
+private:
+    MeshCache() = default;
+
+    std::string directory = "../cache/meshes";
+    uintmax_t maxBytes = 1024ull * 1024ull * 1024ull;
+    std::atomic<unsigned int> hitCount{0};
+    std::atomic<unsigned int> missCount{0};
+    mutable std::mutex mutex;
+
+    bool read(const std::string& sourcePath, uint64_t importFlags, std::vector<MeshData>& meshes);
+
+    // Returns the cache file for a source, or an empty string if the source cannot be stat'ed
+    std::string entryPath(const std::string& sourcePath, uint64_t importFlags, int64_t& sourceTime) const;
+
+    // Removes least recently used entries until the directory fits in maxBytes
+    void evict();
+};
+#endif
@@ -0,0 +1,550 @@
+#include "mesh_optimizer.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace {
+
+// Vertex chunk size for parallel loops
+const size_t VERTEX_GRAIN = 16384;
+
+// Top bits of the cell hash pick one of these partitions, each sorted independently
+const unsigned int PARTITION_BITS = 8;
+const size_t PARTITION_COUNT = size_t(1) << PARTITION_BITS;
+
+struct CellEntry {
+    uint64_t key;
+    uint32_t vertex;
+
+    bool operator<(const CellEntry& other) const {
+        return key < other.key || (key == other.key && vertex < other.vertex);
+    }
+};
+
+uint64_t hashCell(int64_t x, int64_t y, int64_t z) {
+    uint64_t h = static_cast<uint64_t>(x) * 0x9E3779B185EBCA87ull;
+    h ^= static_cast<uint64_t>(y) * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+    h ^= static_cast<uint64_t>(z) * 0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+    // Final avalanche so the top bits spread evenly over the partitions
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    return h;
+}
+
+size_t partitionOf(uint64_t key) {
+    return static_cast<size_t>(key >> (64 - PARTITION_BITS));
+}
+
+bool directionsMatch(const glm::vec3& a, const glm::vec3& b, float cosAngle) {
+    float lengths = glm::length(a) * glm::length(b);
+    if (lengths == 0.0f)
+        return glm::dot(a, a) == glm::dot(b, b);
+    return glm::dot(a, b) >= cosAngle * lengths;
+}
+
+// The hash grid search shared by the welders. For every point, finds the lowest-indexed point
+// within positionEpsilon (relative to the bounds diagonal) that matches(candidate, point) accepts.
+template <typename PositionOf, typename Matches>
+std::vector<uint32_t> findRepresentatives(size_t count, PositionOf positionOf, float positionEpsilon,
+                                          Matches matches, unsigned int threads) {
+    ThreadPool& pool = ThreadPool::shared();
+
+    // Tolerances in model units
+    glm::vec3 boundsMin(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+    for (size_t i = 0; i < count; i++) {
+        boundsMin = glm::min(boundsMin, positionOf(i));
+        boundsMax = glm::max(boundsMax, positionOf(i));
+    }
+    float diagonal = glm::length(boundsMax - boundsMin);
+    float epsilon = positionEpsilon * diagonal;
+    // Cells twice the tolerance wide, so a tolerance box overlaps at most 2x2x2 cells
+    float cellSize = std::max(2.0f * epsilon, std::max(diagonal, 1.0f) * 1e-7f);
+    float invCell = 1.0f / cellSize;
+
+    auto cellCoord = [&](float value) { return static_cast<int64_t>(std::floor(value * invCell)); };
+
+    // 1. Bucket every point by its grid cell. Partition on the top hash bits so each partition can
+    //    be sorted independently; chunk order is preserved so the layout is deterministic.
+    std::vector<uint64_t> keys(count);
+    size_t chunkCount = (count + VERTEX_GRAIN - 1) / VERTEX_GRAIN;
+    std::vector<size_t> chunkCounts(chunkCount * PARTITION_COUNT, 0);
+    pool.parallelFor(count, [&](size_t begin, size_t end) {
+        size_t* counts = &chunkCounts[(begin / VERTEX_GRAIN) * PARTITION_COUNT];
+        for (size_t i = begin; i < end; i++) {
+            const glm::vec3& p = positionOf(i);
+            keys[i] = hashCell(cellCoord(p.x), cellCoord(p.y), cellCoord(p.z));
+            counts[partitionOf(keys[i])]++;
+        }
+    }, VERTEX_GRAIN, threads);
+
+    std::vector<size_t> partitionStart(PARTITION_COUNT + 1, 0);
+    std::vector<size_t> chunkOffsets(chunkCount * PARTITION_COUNT);
+    size_t running = 0;
+    for (size_t p = 0; p < PARTITION_COUNT; p++) {
+        partitionStart[p] = running;
+        for (size_t c = 0; c < chunkCount; c++) {
+            chunkOffsets[c * PARTITION_COUNT + p] = running;
+            running += chunkCounts[c * PARTITION_COUNT + p];
+        }
+    }
+    partitionStart[PARTITION_COUNT] = running;
+
+    std::vector<CellEntry> cells(count);
+    pool.parallelFor(count, [&](size_t begin, size_t end) {
+        size_t* offsets = &chunkOffsets[(begin / VERTEX_GRAIN) * PARTITION_COUNT];
+        for (size_t i = begin; i < end; i++)
+            cells[offsets[partitionOf(keys[i])]++] = {keys[i], static_cast<uint32_t>(i)};
+    }, VERTEX_GRAIN, threads);
+
+    // Sorted partitions are sorted by key as a whole. A directory over the key bits below the
+    // partition bits narrows each lookup to a few entries instead of a whole partition.
+    unsigned int directoryBits = 0;
+    while ((PARTITION_COUNT << (directoryBits + 1)) <= count)
+        directoryBits++;
+    unsigned int prefixBits = PARTITION_BITS + directoryBits;
+    auto prefixOf = [prefixBits](uint64_t key) { return static_cast<size_t>(key >> (64 - prefixBits)); };
+    std::vector<uint32_t> directory((PARTITION_COUNT << directoryBits) + 1);
+    pool.parallelFor(PARTITION_COUNT, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; p++) {
+            std::sort(cells.begin() + partitionStart[p], cells.begin() + partitionStart[p + 1]);
+            size_t entry = partitionStart[p];
+            for (size_t prefix = p << directoryBits; prefix < (p + 1) << directoryBits; prefix++) {
+                while (entry < partitionStart[p + 1] && prefixOf(cells[entry].key) < prefix)
+                    entry++;
+                directory[prefix] = static_cast<uint32_t>(entry);
+            }
+        }
+    }, 1, threads);
+    directory.back() = static_cast<uint32_t>(count);
+
+    // 2. Each point finds the lowest-indexed point it matches in the cells overlapping its
+    //    tolerance box. That point always comes first, so the mapping resolves in one pass.
+    std::vector<uint32_t> representative(count);
+    pool.parallelFor(count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const glm::vec3& v = positionOf(i);
+            uint32_t best = static_cast<uint32_t>(i);
+
+            int64_t x0 = cellCoord(v.x - epsilon), x1 = cellCoord(v.x + epsilon);
+            int64_t y0 = cellCoord(v.y - epsilon), y1 = cellCoord(v.y + epsilon);
+            int64_t z0 = cellCoord(v.z - epsilon), z1 = cellCoord(v.z + epsilon);
+            for (int64_t x = x0; x <= x1; x++)
+            for (int64_t y = y0; y <= y1; y++)
+            for (int64_t z = z0; z <= z1; z++) {
+                uint64_t key = hashCell(x, y, z);
+                size_t prefix = prefixOf(key);
+                auto first = cells.begin() + directory[prefix];
+                auto last = cells.begin() + directory[prefix + 1];
+                for (auto it = std::lower_bound(first, last, CellEntry{key, 0}); it != last && it->key == key; ++it) {
+                    // Entries are sorted by index, nothing later can beat the current best
+                    if (it->vertex >= best)
+                        break;
+                    glm::vec3 d = glm::abs(positionOf(it->vertex) - v);
+                    if (d.x > epsilon || d.y > epsilon || d.z > epsilon || !matches(it->vertex, i))
+                        continue;
+                    best = it->vertex;
+                }
+            }
+            representative[i] = best;
+        }
+    }, VERTEX_GRAIN, threads);
+    return representative;
+}
+
+// Numbers the points that represent themselves in their original order and maps every other
+// point to its representative's number. Returns the number of unique points.
+uint32_t numberRepresentatives(const std::vector<uint32_t>& representative, std::vector<uint32_t>& remap) {
+    remap.resize(representative.size());
+    uint32_t uniqueCount = 0;
+    for (size_t i = 0; i < representative.size(); i++)
+        remap[i] = representative[i] == i ? uniqueCount++ : remap[representative[i]];
+    return uniqueCount;
+}
+
+// FIFO vertex cache simulation. A vertex is resident while fewer than size misses happened after
+// its own. restart() empties the cache without clearing: stamps keep counting across runs, and one
+// from before the current run counts as a miss.
+class FifoCache {
+public:
+    FifoCache(size_t vertexCount, unsigned int size) : stampedAt(vertexCount, 0), size(size) {}
+
+    void restart() { runStart = misses; }
+    // True when v was not resident
+    bool access(unsigned int v) {
+        size_t stamp = stampedAt[v];
+        if (stamp > runStart && misses - stamp < size)
+            return false;
+        stampedAt[v] = ++misses;
+        return true;
+    }
+    size_t runMisses() const { return misses - runStart; }
+
+private:
+    // Miss count at which each vertex last entered, 0 for never
+    std::vector<size_t> stampedAt;
+    size_t misses = 0;
+    size_t runStart = 0;
+    unsigned int size;
+};
+
+} // namespace
+
+WeldStats weldVertices(MeshData& data, const WeldSettings& settings, unsigned int threads) {
+    std::vector<Vertex>& vertices = data.vertices;
+    std::vector<unsigned int>& indices = data.indices;
+    const size_t vertexCount = vertices.size();
+
+    WeldStats stats;
+    stats.verticesBefore = vertexCount;
+    stats.bytesBefore = vertexCount * sizeof(Vertex) + indices.size() * sizeof(unsigned int);
+    if (vertexCount == 0 || data.vertexView) {
+        stats.verticesAfter = vertexCount;
+        stats.bytesAfter = stats.bytesBefore;
+        return stats;
+    }
+
+    ThreadPool& pool = ThreadPool::shared();
+    float cosAngle = std::cos(glm::radians(settings.normalAngle));
+    std::vector<uint32_t> representative = findRepresentatives(
+        vertexCount, [&](size_t i) -> const glm::vec3& { return vertices[i].Position; }, settings.positionEpsilon,
+        [&](size_t a, size_t b) {
+            const Vertex& o = vertices[a];
+            const Vertex& v = vertices[b];
+            if (std::fabs(o.TexCoords.x - v.TexCoords.x) > settings.uvEpsilon ||
+                std::fabs(o.TexCoords.y - v.TexCoords.y) > settings.uvEpsilon)
+                return false;
+            return directionsMatch(o.Normal, v.Normal, cosAngle) && directionsMatch(o.Tangent, v.Tangent, cosAngle) &&
+                   directionsMatch(o.Bitangent, v.Bitangent, cosAngle);
+        },
+        threads);
+
+    // 3. Number the surviving vertices in their original order
+    std::vector<uint32_t> remap;
+    uint32_t uniqueCount = numberRepresentatives(representative, remap);
+
+    std::vector<Vertex> welded(uniqueCount);
+    pool.parallelFor(vertexCount, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            if (representative[i] == i)
+                welded[remap[i]] = vertices[i];
+        }
+    }, VERTEX_GRAIN, threads);
+
+    pool.parallelFor(indices.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            indices[i] = remap[indices[i]];
+    }, VERTEX_GRAIN, threads);
+
+    // Triangles whose corners collapsed together no longer cover any area
+    size_t kept = 0;
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        unsigned int a = indices[t], b = indices[t + 1], c = indices[t + 2];
+        if (a == b || b == c || a == c) {
+            stats.degenerateTriangles++;
+            continue;
+        }
+        indices[kept++] = a;
+        indices[kept++] = b;
+        indices[kept++] = c;
+    }
+    indices.resize(kept);
+
+    vertices = std::move(welded);
+
+    stats.verticesAfter = vertices.size();
+    stats.bytesAfter = vertices.size() * sizeof(Vertex) + indices.size() * sizeof(unsigned int);
+    return stats;
+}
+
+std::vector<uint32_t> weldPositions(const std::vector<glm::vec3>& positions, float positionEpsilon,
+                                    std::vector<glm::vec3>& unique, unsigned int threads) {
+    std::vector<uint32_t> representative = findRepresentatives(
+        positions.size(), [&](size_t i) -> const glm::vec3& { return positions[i]; }, positionEpsilon,
+        [](size_t, size_t) { return true; }, threads);
+
+    std::vector<uint32_t> remap;
+    unique.resize(numberRepresentatives(representative, remap));
+    ThreadPool::shared().parallelFor(positions.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            if (representative[i] == i)
+                unique[remap[i]] = positions[i];
+        }
+    }, VERTEX_GRAIN, threads);
+    return remap;
+}
+
+VertexCacheStats analyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount,
+                                    unsigned int cacheSize) {
+    VertexCacheStats stats;
+    if (indexCount < 3 || vertexCount == 0)
+        return stats;
+
+    FifoCache cache(vertexCount, cacheSize);
+    for (size_t i = 0; i < indexCount; i++)
+        cache.access(indices[i]);
+    size_t misses = cache.runMisses();
+
+    std::vector<bool> used(vertexCount, false);
+    size_t usedCount = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+        if (!used[indices[i]]) {
+            used[indices[i]] = true;
+            usedCount++;
+        }
+    }
+
+    stats.acmr = static_cast<float>(misses) / static_cast<float>(indexCount / 3);
+    stats.atvr = static_cast<float>(misses) / static_cast<float>(usedCount);
+    return stats;
+}
+
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize,
+                         std::vector<unsigned int>* clusters) {
+    // Tipsify: Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"
+    const size_t triangleCount = indices.size() / 3;
+    if (clusters)
+        clusters->clear();
+    if (triangleCount == 0)
+        return;
+
+    // Vertex -> triangle adjacency in compressed rows
+    std::vector<unsigned int> adjacencyStart(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        adjacencyStart[indices[i] + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        adjacencyStart[v + 1] += adjacencyStart[v];
+    std::vector<unsigned int> adjacency(triangleCount * 3);
+    std::vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (int k = 0; k < 3; k++)
+            adjacency[fill[indices[t * 3 + k]]++] = static_cast<unsigned int>(t);
+    }
+
+    std::vector<unsigned int> liveTriangles(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        liveTriangles[v] = adjacencyStart[v + 1] - adjacencyStart[v];
+
+    std::vector<unsigned int> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> deadEnd;
+    std::vector<unsigned int> candidates;
+    std::vector<unsigned int> output;
+    output.reserve(triangleCount * 3);
+
+    unsigned int timestamp = cacheSize + 1;
+    size_t cursor = 0;
+    long fanning = 0;
+    bool flushed = true;
+
+    while (fanning >= 0) {
+        if (flushed && clusters)
+            clusters->push_back(static_cast<unsigned int>(output.size() / 3));
+        flushed = false;
+
+        // Emit every live triangle around the fanning vertex
+        candidates.clear();
+        for (unsigned int a = adjacencyStart[fanning]; a < adjacencyStart[fanning + 1]; a++) {
+            unsigned int t = adjacency[a];
+            if (emitted[t])
+                continue;
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = indices[t * 3 + k];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (timestamp - cacheTime[v] > cacheSize)
+                    cacheTime[v] = timestamp++;
+            }
+            emitted[t] = true;
+        }
+
+        // Next fanning vertex: the candidate that stays in cache longest while still having work
+        long next = -1;
+        long best = -1;
+        for (unsigned int v : candidates) {
+            if (liveTriangles[v] == 0)
+                continue;
+            long priority = 0;
+            if (timestamp - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                priority = timestamp - cacheTime[v];
+            if (priority > best) {
+                best = priority;
+                next = v;
+            }
+        }
+
+        if (next == -1) {
+            // Dead end: fall back to recently used vertices, then to the input order
+            while (!deadEnd.empty() && next == -1) {
+                unsigned int v = deadEnd.back();
+                deadEnd.pop_back();
+                if (liveTriangles[v] > 0)
+                    next = v;
+            }
+            while (next == -1 && cursor < vertexCount) {
+                if (liveTriangles[cursor] > 0)
+                    next = static_cast<long>(cursor);
+                cursor++;
+            }
+            flushed = true;
+        }
+        fanning = next;
+    }
+
+    indices.swap(output);
+}
+
+size_t optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices,
+                        const std::vector<unsigned int>& clusters, unsigned int cacheSize, float threshold) {
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || clusters.empty())
+        return 0;
+
+    // Split the hard clusters where their running ACMR is already close to the cluster's ACMR, so
+    // the sort below has finer pieces to work with without losing much cache efficiency
+    // One simulation restarted per run, so each cluster costs its own indices only
+    std::vector<unsigned int> softClusters;
+    FifoCache cache(vertices.size(), cacheSize);
+    for (size_t c = 0; c < clusters.size(); c++) {
+        size_t begin = clusters[c];
+        size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+        cache.restart();
+        for (size_t i = begin * 3; i < end * 3; i++)
+            cache.access(indices[i]);
+        float wholeAcmr = static_cast<float>(cache.runMisses()) / static_cast<float>(end - begin);
+
+        softClusters.push_back(static_cast<unsigned int>(begin));
+        size_t start = begin;
+        cache.restart();
+        for (size_t t = begin; t < end; t++) {
+            for (int k = 0; k < 3; k++)
+                cache.access(indices[t * 3 + k]);
+            float running = static_cast<float>(cache.runMisses()) / static_cast<float>(t - start + 1);
+            if (t + 1 < end && running <= wholeAcmr * threshold) {
+                softClusters.push_back(static_cast<unsigned int>(t + 1));
+                start = t + 1;
+                cache.restart();
+            }
+        }
+    }
+
+    // Score each cluster by how far it faces away from the mesh centroid
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    struct ClusterInfo {
+        size_t begin, end;
+        float sortKey;
+    };
+    std::vector<ClusterInfo> info(softClusters.size());
+    std::vector<glm::vec3> clusterCentroids(softClusters.size());
+    std::vector<glm::vec3> clusterNormals(softClusters.size());
+    for (size_t c = 0; c < softClusters.size(); c++) {
+        info[c].begin = softClusters[c];
+        info[c].end = c + 1 < softClusters.size() ? softClusters[c + 1] : triangleCount;
+
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = info[c].begin; t < info[c].end; t++) {
+            const glm::vec3& a = vertices[indices[t * 3]].Position;
+            const glm::vec3& b = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3& d = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 n = glm::cross(b - a, d - a);
+            float triangleArea = glm::length(n);
+            centroid += (a + b + d) * (triangleArea / 3.0f);
+            normal += n;
+            area += triangleArea;
+        }
+        clusterCentroids[c] = area > 0.0f ? centroid / area : centroid;
+        float normalLength = glm::length(normal);
+        clusterNormals[c] = normalLength > 0.0f ? normal / normalLength : normal;
+        meshCentroid += centroid;
+        meshArea += area;
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+    for (size_t c = 0; c < info.size(); c++)
+        info[c].sortKey = glm::dot(clusterCentroids[c] - meshCentroid, clusterNormals[c]);
+
+    // Outward facing clusters first; they tend to occlude the rest of the mesh
+    std::stable_sort(info.begin(), info.end(),
+                     [](const ClusterInfo& a, const ClusterInfo& b) { return a.sortKey > b.sortKey; });
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    for (const ClusterInfo& cluster : info)
+        output.insert(output.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+    indices.swap(output);
+    return info.size();
+}
+
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    const unsigned int unused = std::numeric_limits<unsigned int>::max();
+    std::vector<unsigned int> remap(vertices.size(), unused);
+    std::vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+
+    for (unsigned int& index : indices) {
+        if (remap[index] == unused) {
+            remap[index] = static_cast<unsigned int>(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(reordered);
+}
+
+OptimizeStats optimizeMesh(MeshData& data, float overdrawThreshold) {
+    OptimizeStats stats;
+    if (data.vertexView || data.indices.size() < 3)
+        return stats;
+
+    stats.before = analyzeVertexCache(data.indices.data(), data.indices.size(), data.vertices.size());
+
+    std::vector<unsigned int> clusters;
+    optimizeVertexCache(data.indices, data.vertices.size(), VERTEX_CACHE_SIZE, &clusters);
+    stats.clusters = optimizeOverdraw(data.indices, data.vertices, clusters, VERTEX_CACHE_SIZE, overdrawThreshold);
+    optimizeVertexFetch(data.vertices, data.indices);
+
+    stats.after = analyzeVertexCache(data.indices.data(), data.indices.size(), data.vertices.size());
+    return stats;
+}
+
+void computeTangents(std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices) {
+    for (Vertex& v : vertices) {
+        v.Tangent = glm::vec3(0.0f);
+        v.Bitangent = glm::vec3(0.0f);
+    }
+
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        Vertex& a = vertices[indices[t]];
+        Vertex& b = vertices[indices[t + 1]];
+        Vertex& c = vertices[indices[t + 2]];
+        glm::vec3 e1 = b.Position - a.Position, e2 = c.Position - a.Position;
+        glm::vec2 d1 = b.TexCoords - a.TexCoords, d2 = c.TexCoords - a.TexCoords;
+        float det = d1.x * d2.y - d2.x * d1.y;
+        if (std::fabs(det) < 1e-12f)
+            continue;
+        float r = 1.0f / det;
+        glm::vec3 tangent = (e1 * d2.y - e2 * d1.y) * r;
+        glm::vec3 bitangent = (e2 * d1.x - e1 * d2.x) * r;
+        for (Vertex* v : {&a, &b, &c}) {
+            v->Tangent += tangent;
+            v->Bitangent += bitangent;
+        }
+    }
+
+    for (Vertex& v : vertices) {
+        glm::vec3 tangent = v.Tangent - v.Normal * glm::dot(v.Normal, v.Tangent);
+        glm::vec3 bitangent = v.Bitangent - v.Normal * glm::dot(v.Normal, v.Bitangent);
+        float tangentLength = glm::length(tangent), bitangentLength = glm::length(bitangent);
+        v.Tangent = tangentLength > 0.0f ? tangent / tangentLength : glm::vec3(0.0f);
+        v.Bitangent = bitangentLength > 0.0f ? bitangent / bitangentLength : glm::vec3(0.0f);
+    }
+}
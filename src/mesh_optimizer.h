@@ -0,0 +1,80 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include "mesh.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Tolerances used when merging vertices. Vertices are only merged when every attribute is
+// within tolerance, so normal and UV seams stay split.
+struct WeldSettings {
+    // Maximum position difference per axis, relative to the mesh bounds diagonal
+    float positionEpsilon = 1e-6f;
+    // Maximum angle between normals (and tangents), in degrees
+    float normalAngle = 1.0f;
+    // Maximum texture coordinate difference per axis
+    float uvEpsilon = 1e-5f;
+};
+
+struct WeldStats {
+    size_t verticesBefore = 0;
+    size_t verticesAfter = 0;
+    size_t bytesBefore = 0;
+    size_t bytesAfter = 0;
+    size_t degenerateTriangles = 0;
+};
+
+// Post-transform vertex cache efficiency of an index buffer, measured with a FIFO cache.
+// ACMR is cache misses per triangle (0.5 is ideal), ATVR is misses per vertex (1.0 is ideal).
+struct VertexCacheStats {
+    float acmr = 0.0f;
+    float atvr = 0.0f;
+};
+
+struct OptimizeStats {
+    VertexCacheStats before;
+    VertexCacheStats after;
+    size_t clusters = 0;
+};
+
+// Cache size assumed by the optimizer and the ACMR/ATVR report
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+// Merges identical or nearly identical vertices of an owned, triangulated mesh and rewrites its
+// index buffer. Uses a spatial hash grid and runs on up to `threads` pool threads; the result does
+// not depend on the thread count.
+WeldStats weldVertices(MeshData& data, const WeldSettings& settings, unsigned int threads = 0);
+
+// Merges positions that lie within positionEpsilon (relative to the bounds diagonal) of each other,
+// on the same hash grid as weldVertices. unique receives the merged positions in first-use order;
+// returns the index into unique for every input position.
+std::vector<uint32_t> weldPositions(const std::vector<glm::vec3>& positions, float positionEpsilon,
+                                    std::vector<glm::vec3>& unique, unsigned int threads = 0);
+
+// Simulates a FIFO post-transform cache of cacheSize entries over a triangle list
+VertexCacheStats analyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount,
+                                    unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorders triangles for post-transform cache locality (Tipsify). When clusters is given it
+// receives the first triangle of every cluster that starts after a cache flush.
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize,
+                         std::vector<unsigned int>* clusters = nullptr);
+
+// Reorders the clusters of a cache-optimized index buffer so outward facing clusters are drawn first.
+// Clusters are split further wherever the local ACMR is within threshold of the cluster's own ACMR.
+size_t optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices,
+                        const std::vector<unsigned int>& clusters, unsigned int cacheSize, float threshold);
+
+// Reorders vertices by first use in the index buffer and drops unreferenced ones
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+// Runs the vertex cache, overdraw and vertex fetch passes on an owned mesh, in that order
+OptimizeStats optimizeMesh(MeshData& data, float overdrawThreshold);
+
+// Fills Tangent and Bitangent from the UV layout of the triangles around each vertex, made
+// orthogonal to the vertex normal (what aiProcess_CalcTangentSpace does for Assimp imports)
+void computeTangents(std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices);
+
+#endif
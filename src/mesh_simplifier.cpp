@@ -0,0 +1,369 @@
+#include "mesh_simplifier.h"
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+
+namespace {
+
+const unsigned int NO_GROUP = std::numeric_limits<unsigned int>::max();
+
+// Wedges of a position whose UVs differ by more than this are a seam
+const float SEAM_UV_EPSILON = 1e-5f;
+
+// A collapse may turn a remaining triangle by at most ~78 degrees
+const float FLIP_MIN_DOT = 0.2f;
+
+// Sum of squared distances to a set of planes, weighted by triangle area (Garland and Heckbert)
+struct Quadric {
+    double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+    double weight = 0;
+
+    void addPlane(const glm::vec3& n, float d, double w) {
+        a2 += w * n.x * n.x; ab += w * n.x * n.y; ac += w * n.x * n.z; ad += w * n.x * d;
+        b2 += w * n.y * n.y; bc += w * n.y * n.z; bd += w * n.y * d;
+        c2 += w * n.z * n.z; cd += w * n.z * d;
+        d2 += w * d * d;
+        weight += w;
+    }
+
+    Quadric& operator+=(const Quadric& o) {
+        a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad;
+        b2 += o.b2; bc += o.bc; bd += o.bd;
+        c2 += o.c2; cd += o.cd;
+        d2 += o.d2;
+        weight += o.weight;
+        return *this;
+    }
+
+    // Mean squared distance of p to the planes
+    double error(const glm::vec3& p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double e = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x +
+                   b2 * y * y + 2 * bc * y * z + 2 * bd * y +
+                   c2 * z * z + 2 * cd * z + d2;
+        return weight > 0 ? std::max(e, 0.0) / weight : 0.0;
+    }
+};
+
+struct Collapse {
+    double cost;
+    unsigned int from, to;
+    unsigned int fromVersion, toVersion;
+
+    bool operator>(const Collapse& other) const { return cost > other.cost; }
+};
+
+struct PositionKey {
+    uint32_t bits[3];
+
+    bool operator==(const PositionKey& other) const { return memcmp(bits, other.bits, sizeof(bits)) == 0; }
+};
+
+struct PositionKeyHash {
+    size_t operator()(const PositionKey& key) const {
+        uint64_t h = key.bits[0] * 0x9E3779B185EBCA87ull;
+        h ^= key.bits[1] * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+        h ^= key.bits[2] * 0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+        return static_cast<size_t>(h ^ (h >> 32));
+    }
+};
+
+} // namespace
+
+std::vector<unsigned int> simplifyMesh(const Vertex* vertices, size_t vertexCount, const unsigned int* indices,
+                                       size_t indexCount, size_t targetIndexCount, float* resultError) {
+    const size_t triangleCount = indexCount / 3;
+    std::vector<unsigned int> corners(indices, indices + triangleCount * 3);
+    if (resultError)
+        *resultError = 0.0f;
+    if (corners.size() <= targetIndexCount)
+        return corners;
+
+    // 1. Collapses work on positions; wedges (vertices that share a position but differ in normal
+    //    or UV) follow along
+    std::vector<unsigned int> group(vertexCount, NO_GROUP);
+    std::vector<glm::vec3> positions;
+    std::unordered_map<PositionKey, unsigned int, PositionKeyHash> lookup;
+    lookup.reserve(vertexCount);
+    for (unsigned int v : corners) {
+        if (group[v] != NO_GROUP)
+            continue;
+        PositionKey key;
+        memcpy(key.bits, &vertices[v].Position, sizeof(key.bits));
+        auto inserted = lookup.emplace(key, static_cast<unsigned int>(positions.size()));
+        if (inserted.second)
+            positions.push_back(vertices[v].Position);
+        group[v] = inserted.first->second;
+    }
+    const size_t groupCount = positions.size();
+
+    std::vector<std::vector<unsigned int>> wedges(groupCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        if (group[v] != NO_GROUP)
+            wedges[group[v]].push_back(static_cast<unsigned int>(v));
+    }
+
+    // 2. Seams stay where they are
+    std::vector<uint8_t> locked(groupCount, 0);
+    for (size_t g = 0; g < groupCount; g++) {
+        const glm::vec2& uv = vertices[wedges[g][0]].TexCoords;
+        for (unsigned int w : wedges[g]) {
+            if (std::fabs(vertices[w].TexCoords.x - uv.x) > SEAM_UV_EPSILON ||
+                std::fabs(vertices[w].TexCoords.y - uv.y) > SEAM_UV_EPSILON) {
+                locked[g] = 1;
+                break;
+            }
+        }
+    }
+
+    std::vector<unsigned int> triangleGroups(corners.size());
+    std::vector<uint8_t> alive(triangleCount, 1);
+    size_t liveTriangles = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        unsigned int* g = &triangleGroups[t * 3];
+        for (int k = 0; k < 3; k++)
+            g[k] = group[corners[t * 3 + k]];
+        alive[t] = g[0] != g[1] && g[1] != g[2] && g[0] != g[2];
+        liveTriangles += alive[t];
+    }
+
+    // 3. So do open borders and non-manifold edges: anything not shared by exactly two triangles
+    std::vector<uint64_t> edges;
+    edges.reserve(liveTriangles * 3);
+    for (size_t t = 0; t < triangleCount; t++) {
+        if (!alive[t])
+            continue;
+        for (int k = 0; k < 3; k++) {
+            uint64_t a = triangleGroups[t * 3 + k], b = triangleGroups[t * 3 + (k + 1) % 3];
+            edges.push_back(std::min(a, b) << 32 | std::max(a, b));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    std::vector<uint64_t> uniqueEdges;
+    for (size_t i = 0; i < edges.size();) {
+        size_t j = i;
+        while (j < edges.size() && edges[j] == edges[i])
+            j++;
+        if (j - i != 2) {
+            locked[edges[i] >> 32] = 1;
+            locked[edges[i] & 0xFFFFFFFFu] = 1;
+        }
+        uniqueEdges.push_back(edges[i]);
+        i = j;
+    }
+    edges.clear();
+    edges.shrink_to_fit();
+
+    // 4. Plane quadrics and triangle adjacency per position
+    std::vector<Quadric> quadrics(groupCount);
+    std::vector<std::vector<unsigned int>> groupTriangles(groupCount);
+    for (size_t t = 0; t < triangleCount; t++) {
+        if (!alive[t])
+            continue;
+        const unsigned int* g = &triangleGroups[t * 3];
+        glm::vec3 n = glm::cross(positions[g[1]] - positions[g[0]], positions[g[2]] - positions[g[0]]);
+        float length = glm::length(n);
+        for (int k = 0; k < 3; k++)
+            groupTriangles[g[k]].push_back(static_cast<unsigned int>(t));
+        if (length == 0.0f)
+            continue;
+        n /= length;
+        for (int k = 0; k < 3; k++)
+            quadrics[g[k]].addPlane(n, -glm::dot(n, positions[g[0]]), 0.5 * length);
+    }
+
+    // 5. Greedy collapses, cheapest first. Entries go stale when either end changes.
+    std::vector<unsigned int> version(groupCount, 0);
+    std::vector<uint8_t> removed(groupCount, 0);
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+    auto pushCollapses = [&](unsigned int a, unsigned int b) {
+        Quadric q = quadrics[a];
+        q += quadrics[b];
+        if (!locked[a])
+            heap.push({q.error(positions[b]), a, b, version[a], version[b]});
+        if (!locked[b])
+            heap.push({q.error(positions[a]), b, a, version[b], version[a]});
+    };
+    for (uint64_t edge : uniqueEdges)
+        pushCollapses(static_cast<unsigned int>(edge >> 32), static_cast<unsigned int>(edge & 0xFFFFFFFFu));
+    uniqueEdges.clear();
+    uniqueEdges.shrink_to_fit();
+
+    // Stamps mark neighbour sets without clearing an array per collapse
+    std::vector<unsigned int> stamp(groupCount, 0);
+    unsigned int currentStamp = 0;
+    auto contains = [&](size_t t, unsigned int g) {
+        const unsigned int* tg = &triangleGroups[t * 3];
+        return tg[0] == g || tg[1] == g || tg[2] == g;
+    };
+
+    auto canCollapse = [&](unsigned int from, unsigned int to) {
+        size_t shared = 0;
+        for (unsigned int t : groupTriangles[from]) {
+            if (alive[t] && contains(t, to))
+                shared++;
+        }
+        if (shared == 0)
+            return false;
+
+        // Link condition: the ends may only share the neighbours across their shared triangles,
+        // otherwise the collapse pinches the surface
+        currentStamp++;
+        for (unsigned int t : groupTriangles[from]) {
+            if (!alive[t])
+                continue;
+            for (int k = 0; k < 3; k++)
+                stamp[triangleGroups[t * 3 + k]] = currentStamp;
+        }
+        unsigned int markedStamp = ++currentStamp;
+        size_t common = 0;
+        for (unsigned int t : groupTriangles[to]) {
+            if (!alive[t])
+                continue;
+            for (int k = 0; k < 3; k++) {
+                unsigned int g = triangleGroups[t * 3 + k];
+                if (g != from && g != to && stamp[g] == markedStamp - 1) {
+                    stamp[g] = markedStamp;
+                    common++;
+                }
+            }
+        }
+        if (common != shared)
+            return false;
+
+        // No remaining triangle may flip or collapse to a line
+        for (unsigned int t : groupTriangles[from]) {
+            if (!alive[t] || contains(t, to))
+                continue;
+            glm::vec3 p[3], q[3];
+            for (int k = 0; k < 3; k++) {
+                unsigned int g = triangleGroups[t * 3 + k];
+                p[k] = positions[g];
+                q[k] = g == from ? positions[to] : positions[g];
+            }
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            if (glm::dot(before, after) <= FLIP_MIN_DOT * glm::length(before) * glm::length(after))
+                return false;
+        }
+        return true;
+    };
+
+    // The wedge of `to` that best continues the attributes of a wedge of `from`
+    auto pickWedge = [&](unsigned int to, unsigned int oldWedge) {
+        const Vertex& old = vertices[oldWedge];
+        unsigned int best = wedges[to][0];
+        float bestScore = std::numeric_limits<float>::max();
+        for (unsigned int w : wedges[to]) {
+            glm::vec2 duv = vertices[w].TexCoords - old.TexCoords;
+            float score = glm::dot(duv, duv) * 1000.0f + (1.0f - glm::dot(vertices[w].Normal, old.Normal));
+            if (score < bestScore) {
+                bestScore = score;
+                best = w;
+            }
+        }
+        return best;
+    };
+
+    double maxError = 0.0;
+    while (liveTriangles * 3 > targetIndexCount && !heap.empty()) {
+        Collapse collapse = heap.top();
+        heap.pop();
+        unsigned int from = collapse.from, to = collapse.to;
+        if (removed[from] || removed[to] || version[from] != collapse.fromVersion || version[to] != collapse.toVersion)
+            continue;
+        if (!canCollapse(from, to))
+            continue;
+
+        for (unsigned int t : groupTriangles[from]) {
+            if (!alive[t])
+                continue;
+            if (contains(t, to)) {
+                alive[t] = 0;
+                liveTriangles--;
+                continue;
+            }
+            for (int k = 0; k < 3; k++) {
+                if (triangleGroups[t * 3 + k] == from) {
+                    triangleGroups[t * 3 + k] = to;
+                    corners[t * 3 + k] = pickWedge(to, corners[t * 3 + k]);
+                }
+            }
+            groupTriangles[to].push_back(t);
+        }
+        quadrics[to] += quadrics[from];
+        removed[from] = 1;
+        version[to]++;
+        std::vector<unsigned int>().swap(groupTriangles[from]);
+
+        std::vector<unsigned int>& around = groupTriangles[to];
+        around.erase(std::remove_if(around.begin(), around.end(), [&](unsigned int t) { return !alive[t]; }),
+                     around.end());
+        maxError = std::max(maxError, collapse.cost);
+
+        // Re-price every edge around the merged vertex
+        currentStamp++;
+        for (unsigned int t : around) {
+            for (int k = 0; k < 3; k++) {
+                unsigned int g = triangleGroups[t * 3 + k];
+                if (g != to && stamp[g] != currentStamp) {
+                    stamp[g] = currentStamp;
+                    pushCollapses(to, g);
+                }
+            }
+        }
+    }
+
+    std::vector<unsigned int> result;
+    result.reserve(liveTriangles * 3);
+    for (size_t t = 0; t < triangleCount; t++) {
+        if (alive[t])
+            result.insert(result.end(), corners.begin() + t * 3, corners.begin() + t * 3 + 3);
+    }
+    if (resultError)
+        *resultError = static_cast<float>(std::sqrt(maxError));
+    return result;
+}
+
+std::vector<LodLevel> buildLodChain(const MeshData& data, const LodSettings& settings,
+                                    const std::function<bool()>& cancelled) {
+    std::vector<LodLevel> levels;
+    const Vertex* vertices = data.vertexData();
+    const size_t vertexCount = data.vertexCount();
+    std::vector<unsigned int> current(data.indexData(), data.indexData() + data.indexCount());
+    float error = 0.0f;
+
+    for (unsigned int level = 0; level < settings.maxLevels; level++) {
+        if (cancelled && cancelled())
+            break;
+        size_t triangles = current.size() / 3;
+        if (triangles < settings.minTriangles)
+            break;
+
+        size_t target = static_cast<size_t>(static_cast<float>(triangles) * settings.reduction) * 3;
+        float levelError = 0.0f;
+        std::vector<unsigned int> simplified =
+            simplifyMesh(vertices, vertexCount, current.data(), current.size(), target, &levelError);
+        // Stop once locked borders and seams keep the simplifier from getting anywhere
+        if (simplified.size() * 10 > current.size() * 9)
+            break;
+
+        // Each level starts from the previous one, so the errors add up
+        error += levelError;
+        optimizeVertexCache(simplified, vertexCount, VERTEX_CACHE_SIZE);
+
+        LodLevel lod;
+        lod.error = error;
+        lod.meshlets = buildMeshlets(vertices, vertexCount, simplified.data(), simplified.size());
+        lod.indices = std::move(simplified);
+        current = lod.indices;
+        levels.push_back(std::move(lod));
+    }
+    return levels;
+}
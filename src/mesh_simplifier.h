@@ -0,0 +1,42 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include "mesh.h"
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+struct LodSettings {
+    bool enabled = true;
+    // Maximum number of levels after the full mesh
+    unsigned int maxLevels = 4;
+    // Triangle count of each level relative to the previous one
+    float reduction = 0.5f;
+    // Meshes with fewer triangles than this are not simplified further
+    size_t minTriangles = 256;
+    // Largest simplification error, in pixels, allowed on screen when picking a level
+    float pixelError = 1.0f;
+};
+
+// One simplified level; indices refer to the vertex buffer of the full mesh
+struct LodLevel {
+    std::vector<unsigned int> indices;
+    // Distance the surface may have moved from the full mesh, in model units
+    float error = 0.0f;
+    std::vector<Meshlet> meshlets;
+};
+
+// Collapses edges in order of quadric error until the triangle list has at most targetIndexCount
+// indices or no collapse is left. Vertices only ever move onto their neighbours, so the result
+// reuses the input vertex buffer. Open borders, UV seams and non-manifold edges stay in place.
+// resultError receives the largest error of any collapse, in model units.
+std::vector<unsigned int> simplifyMesh(const Vertex* vertices, size_t vertexCount, const unsigned int* indices,
+                                       size_t indexCount, size_t targetIndexCount, float* resultError = nullptr);
+
+// Builds successively coarser levels of a mesh, each simplified from the one before and ordered for
+// the vertex cache. Stops early when cancelled returns true.
+std::vector<LodLevel> buildLodChain(const MeshData& data, const LodSettings& settings,
+                                    const std::function<bool()>& cancelled = nullptr);
+
+#endif
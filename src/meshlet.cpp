@@ -0,0 +1,221 @@
+#include "meshlet.h"
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+namespace {
+
+// Normal cones narrower than this spread are not worth testing
+const float MESHLET_CONE_MIN_DOT = 0.1f;
+
+// Positions stride bytes apart, so the builder works on Vertex arrays and file layouts alike
+struct PositionStream {
+    const unsigned char* data;
+    size_t stride;
+
+    const glm::vec3& operator[](size_t v) const { return *reinterpret_cast<const glm::vec3*>(data + v * stride); }
+};
+
+template <typename Index>
+Meshlet finishMeshlet(const PositionStream& positions, const Index* indices, uint32_t indexOffset,
+                      uint32_t triangleCount, const std::vector<unsigned int>& meshletVertices) {
+    Meshlet meshlet = {};
+    meshlet.indexOffset = indexOffset;
+    meshlet.triangleCount = triangleCount;
+    meshlet.vertexCount = static_cast<uint32_t>(meshletVertices.size());
+
+    // Sphere around the bounding box center
+    glm::vec3 boundsMin(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+    for (unsigned int v : meshletVertices) {
+        boundsMin = glm::min(boundsMin, positions[v]);
+        boundsMax = glm::max(boundsMax, positions[v]);
+    }
+    meshlet.center = (boundsMin + boundsMax) * 0.5f;
+    float radiusSquared = 0.0f;
+    for (unsigned int v : meshletVertices) {
+        glm::vec3 d = positions[v] - meshlet.center;
+        radiusSquared = std::max(radiusSquared, glm::dot(d, d));
+    }
+    meshlet.radius = std::sqrt(radiusSquared);
+
+    // Cone around the average face normal, from the winding rather than the vertex normals
+    std::vector<glm::vec3> normals;
+    normals.reserve(triangleCount);
+    glm::vec3 axis(0.0f);
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        const Index* triangle = indices + indexOffset + t * 3;
+        const glm::vec3& a = positions[triangle[0]];
+        glm::vec3 n = glm::cross(positions[triangle[1]] - a, positions[triangle[2]] - a);
+        float length = glm::length(n);
+        if (length == 0.0f)
+            continue;
+        normals.push_back(n / length);
+        axis += normals.back();
+    }
+
+    meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+    meshlet.coneCutoff = 1.0f;
+    float axisLength = glm::length(axis);
+    if (normals.empty() || axisLength == 0.0f)
+        return meshlet;
+    axis /= axisLength;
+
+    float minDot = 1.0f;
+    for (const glm::vec3& n : normals)
+        minDot = std::min(minDot, glm::dot(axis, n));
+    meshlet.coneAxis = axis;
+    if (minDot > MESHLET_CONE_MIN_DOT)
+        meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+    return meshlet;
+}
+
+template <typename Index>
+std::vector<Meshlet> buildMeshletList(const PositionStream& positions, size_t vertexCount, const Index* indices,
+                                      size_t indexCount) {
+    std::vector<Meshlet> meshlets;
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return meshlets;
+
+    // owner[v] is the meshlet number + 1 that last referenced v
+    std::vector<uint32_t> owner(vertexCount, 0);
+    std::vector<unsigned int> meshletVertices;
+    meshletVertices.reserve(MESHLET_MAX_VERTICES);
+    uint32_t current = 1;
+    uint32_t start = 0;
+
+    for (size_t t = 0; t < triangleCount; t++) {
+        const Index* triangle = indices + t * 3;
+        unsigned int added = 0;
+        for (int k = 0; k < 3; k++)
+            added += owner[triangle[k]] != current;
+        // Repeated vertices within the triangle are counted twice, which only makes the limit stricter
+
+        uint32_t meshletTriangles = static_cast<uint32_t>(t) - start / 3;
+        if (meshletVertices.size() + added > MESHLET_MAX_VERTICES || meshletTriangles == MESHLET_MAX_TRIANGLES) {
+            meshlets.push_back(finishMeshlet(positions, indices, start, meshletTriangles, meshletVertices));
+            meshletVertices.clear();
+            current++;
+            start = static_cast<uint32_t>(t * 3);
+        }
+
+        for (int k = 0; k < 3; k++) {
+            if (owner[triangle[k]] != current) {
+                owner[triangle[k]] = current;
+                meshletVertices.push_back(triangle[k]);
+            }
+        }
+    }
+    meshlets.push_back(finishMeshlet(positions, indices, start, static_cast<uint32_t>(triangleCount) - start / 3,
+                                     meshletVertices));
+    return meshlets;
+}
+
+} // namespace
+
+std::vector<Meshlet> buildMeshlets(const Vertex* vertices, size_t vertexCount, const unsigned int* indices,
+                                   size_t indexCount) {
+    PositionStream positions = {reinterpret_cast<const unsigned char*>(vertices) + offsetof(Vertex, Position),
+                                sizeof(Vertex)};
+    return buildMeshletList(positions, vertexCount, indices, indexCount);
+}
+
+std::vector<Meshlet> buildMeshlets(const glm::vec3* positions, size_t stride, size_t vertexCount,
+                                   const uint16_t* indices, size_t indexCount) {
+    return buildMeshletList(PositionStream{reinterpret_cast<const unsigned char*>(positions), stride}, vertexCount,
+                            indices, indexCount);
+}
+
+std::vector<Meshlet> buildMeshlets(const glm::vec3* positions, size_t stride, size_t vertexCount,
+                                   const uint32_t* indices, size_t indexCount) {
+    return buildMeshletList(PositionStream{reinterpret_cast<const unsigned char*>(positions), stride}, vertexCount,
+                            indices, indexCount);
+}
+
+ClusterView ClusterView::fromMatrices(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model) {
+    ClusterView result;
+
+    // Planes of the model-view-projection matrix are the frustum planes in model space
+    glm::mat4 clip = projection * view * model;
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+    result.planes[0] = rows[3] + rows[0];
+    result.planes[1] = rows[3] - rows[0];
+    result.planes[2] = rows[3] + rows[1];
+    result.planes[3] = rows[3] - rows[1];
+    result.planes[4] = rows[3] + rows[2];
+    result.planes[5] = rows[3] - rows[2];
+    for (glm::vec4& plane : result.planes)
+        plane /= glm::length(glm::vec3(plane));
+
+    // Which side of a triangle the camera is on does not change under the model transform, so the
+    // cone test works in model space too
+    result.cameraPosition = glm::vec3(glm::inverse(view * model) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    return result;
+}
+
+void MeshletCullData::assign(const std::vector<Meshlet>& meshlets) {
+    size_t count = meshlets.size();
+    for (std::vector<float>* array : {&centerX, &centerY, &centerZ, &radius, &axisX, &axisY, &axisZ, &cutoff})
+        array->resize(count);
+    for (size_t i = 0; i < count; i++) {
+        const Meshlet& m = meshlets[i];
+        centerX[i] = m.center.x;
+        centerY[i] = m.center.y;
+        centerZ[i] = m.center.z;
+        radius[i] = m.radius;
+        axisX[i] = m.coneAxis.x;
+        axisY[i] = m.coneAxis.y;
+        axisZ[i] = m.coneAxis.z;
+        cutoff[i] = m.coneCutoff;
+    }
+}
+
+void cullMeshlets(const MeshletCullData& data, ClusterView& view, uint8_t* visible) {
+    const size_t count = data.size();
+    const float* cx = data.centerX.data();
+    const float* cy = data.centerY.data();
+    const float* cz = data.centerZ.data();
+    const float* r = data.radius.data();
+    std::fill(visible, visible + count, uint8_t(1));
+
+    // Branch-free loops over the arrays, one plane at a time, so the compiler can vectorize them
+    size_t visibleCount = count;
+    if (view.frustumCulling) {
+        for (const glm::vec4& plane : view.planes) {
+            const float px = plane.x, py = plane.y, pz = plane.z, pw = plane.w;
+            for (size_t i = 0; i < count; i++)
+                visible[i] &= static_cast<uint8_t>(px * cx[i] + py * cy[i] + pz * cz[i] + pw >= -r[i]);
+        }
+        visibleCount = 0;
+        for (size_t i = 0; i < count; i++)
+            visibleCount += visible[i];
+        view.stats.frustumCulled += count - visibleCount;
+    }
+
+    if (view.coneCulling) {
+        const float* ax = data.axisX.data();
+        const float* ay = data.axisY.data();
+        const float* az = data.axisZ.data();
+        const float* cutoff = data.cutoff.data();
+        const glm::vec3 camera = view.cameraPosition;
+        // Culled when the camera sits behind every triangle of the cluster
+        for (size_t i = 0; i < count; i++) {
+            float dx = cx[i] - camera.x, dy = cy[i] - camera.y, dz = cz[i] - camera.z;
+            float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+            float facing = dx * ax[i] + dy * ay[i] + dz * az[i];
+            visible[i] &= static_cast<uint8_t>(facing < cutoff[i] * distance + r[i]);
+        }
+        size_t remaining = 0;
+        for (size_t i = 0; i < count; i++)
+            remaining += visible[i];
+        view.stats.backfaceCulled += visibleCount - remaining;
+    }
+
+    view.stats.clusters += count;
+}
@@ -0,0 +1,79 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Vertex;
+
+// Cluster limits; 124 triangles keeps a meshlet's index range under 384 indices
+const unsigned int MESHLET_MAX_VERTICES = 64;
+const unsigned int MESHLET_MAX_TRIANGLES = 124;
+
+// A contiguous range of a mesh's index buffer with bounds for culling. Plain data so it can be
+// written to the mesh cache as is.
+struct Meshlet {
+    uint32_t indexOffset;
+    uint32_t triangleCount;
+    uint32_t vertexCount;
+    // Bounding sphere
+    glm::vec3 center;
+    float radius;
+    // Normal cone; cutoff is 1 when the triangles face too many ways to ever be culled
+    glm::vec3 coneAxis;
+    float coneCutoff;
+};
+
+// Splits a triangle list into meshlets in index buffer order. The index order is kept, so run this
+// after the vertex cache optimizer to get compact clusters.
+std::vector<Meshlet> buildMeshlets(const Vertex* vertices, size_t vertexCount, const unsigned int* indices,
+                                   size_t indexCount);
+
+// The same for positions stored stride bytes apart in some other layout, with 16 or 32-bit indices
+std::vector<Meshlet> buildMeshlets(const glm::vec3* positions, size_t stride, size_t vertexCount,
+                                   const uint16_t* indices, size_t indexCount);
+std::vector<Meshlet> buildMeshlets(const glm::vec3* positions, size_t stride, size_t vertexCount,
+                                   const uint32_t* indices, size_t indexCount);
+
+// Per-frame culling and draw results
+struct ClusterCullStats {
+    size_t clusters = 0;
+    size_t frustumCulled = 0;
+    size_t backfaceCulled = 0;
+    size_t drawRanges = 0;
+    size_t triangles = 0;
+    // Draw commands issued and textures bound for them
+    size_t drawCalls = 0;
+    size_t textureBinds = 0;
+};
+
+// Camera state for cluster culling, in the model's local space so the meshlet bounds never need
+// to be transformed
+struct ClusterView {
+    // Left, right, bottom, top, near, far; normalized so distances are in model units
+    glm::vec4 planes[6];
+    glm::vec3 cameraPosition;
+    bool frustumCulling = true;
+    // Only valid when back faces are never visible, i.e. opaque closed meshes
+    bool coneCulling = true;
+    ClusterCullStats stats;
+
+    static ClusterView fromMatrices(const glm::mat4& projection, const glm::mat4& view, const glm::mat4& model);
+};
+
+// Meshlet bounds as separate arrays, so the culling loops run over contiguous floats and vectorize
+struct MeshletCullData {
+    std::vector<float> centerX, centerY, centerZ, radius;
+    std::vector<float> axisX, axisY, axisZ, cutoff;
+
+    void assign(const std::vector<Meshlet>& meshlets);
+    size_t size() const { return radius.size(); }
+};
+
+// Writes 1 to visible[i] for every meshlet that survives culling and 0 otherwise
+void cullMeshlets(const MeshletCullData& data, ClusterView& view, uint8_t* visible);
+
+#endif
@@ -0,0 +1,362 @@
+#include "mip_generator.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIP_GENERATOR_SSE2 1
+#endif
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+// Kernel radii in texels of the smaller level
+const double KAISER_RADIUS = 3.0;
+const double KAISER_ALPHA = 4.0;
+const double LANCZOS_RADIUS = 3.0;
+// Destination rows per parallel chunk; each chunk filters the source rows its kernel reaches
+const size_t ROWS_PER_CHUNK = 32;
+// Linear values are quantized to 16 bits before the sRGB encode lookup
+const int SRGB_TABLE_SIZE = 65536;
+
+struct ColorTables {
+    float srgbToLinear[256];
+    float byteToUnit[256];
+    unsigned char linearToSrgb[SRGB_TABLE_SIZE];
+};
+
+const ColorTables& colorTables() {
+    static const ColorTables* tables = [] {
+        ColorTables* built = new ColorTables();
+        for (int i = 0; i < 256; i++) {
+            double c = i / 255.0;
+            built->srgbToLinear[i] = static_cast<float>(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+            built->byteToUnit[i] = static_cast<float>(c);
+        }
+        for (int i = 0; i < SRGB_TABLE_SIZE; i++) {
+            double l = static_cast<double>(i) / (SRGB_TABLE_SIZE - 1);
+            double c = l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+            built->linearToSrgb[i] = static_cast<unsigned char>(std::lround(c * 255.0));
+        }
+        return built;
+    }();
+    return *tables;
+}
+
+double sinc(double x) {
+    if (std::fabs(x) < 1e-9)
+        return 1.0;
+    x *= PI;
+    return std::sin(x) / x;
+}
+
+// Zeroth order modified Bessel function of the first kind
+double besselI0(double x) {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 64; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12)
+            break;
+    }
+    return sum;
+}
+
+double filterRadius(MipFilter filter) {
+    switch (filter) {
+    case MipFilter::Box:
+        return 0.5;
+    case MipFilter::Kaiser:
+        return KAISER_RADIUS;
+    case MipFilter::Lanczos:
+        return LANCZOS_RADIUS;
+    }
+    return 0.5;
+}
+
+// Weight at distance u, in texels of the smaller level
+double filterWeight(MipFilter filter, double u) {
+    u = std::fabs(u);
+    switch (filter) {
+    case MipFilter::Box:
+        return u <= 0.5 ? 1.0 : 0.0;
+    case MipFilter::Kaiser: {
+        if (u >= KAISER_RADIUS)
+            return 0.0;
+        double r = u / KAISER_RADIUS;
+        return sinc(u) * besselI0(KAISER_ALPHA * std::sqrt(1.0 - r * r)) / besselI0(KAISER_ALPHA);
+    }
+    case MipFilter::Lanczos:
+        return u >= LANCZOS_RADIUS ? 0.0 : sinc(u) * sinc(u / LANCZOS_RADIUS);
+    }
+    return 0.0;
+}
+
+// Source texels and normalized weights of every destination texel along one axis, count per
+// texel. Indices are clamped to the image, so edges repeat their last texel.
+struct AxisTaps {
+    int count = 0;
+    std::vector<int> index;
+    std::vector<float> weight;
+};
+
+AxisTaps buildTaps(MipFilter filter, int source, int destination) {
+    AxisTaps taps;
+    if (source == destination) {
+        // An axis already down to one texel passes straight through
+        taps.count = 1;
+        for (int i = 0; i < destination; i++) {
+            taps.index.push_back(i);
+            taps.weight.push_back(1.0f);
+        }
+        return taps;
+    }
+
+    double scale = static_cast<double>(source) / destination;
+    double support = filterRadius(filter) * scale;
+    int span = static_cast<int>(std::ceil(support * 2.0)) + 1;
+
+    // Trim taps whose weight is zero for every texel
+    std::vector<int> first(destination);
+    std::vector<double> raw(static_cast<size_t>(destination) * span);
+    int low = span, high = -1;
+    for (int d = 0; d < destination; d++) {
+        double center = (d + 0.5) * scale;
+        first[d] = static_cast<int>(std::floor(center - support));
+        for (int k = 0; k < span; k++) {
+            double w = filterWeight(filter, (first[d] + k + 0.5 - center) / scale);
+            raw[static_cast<size_t>(d) * span + k] = w;
+            if (w != 0.0) {
+                low = std::min(low, k);
+                high = std::max(high, k);
+            }
+        }
+    }
+    taps.count = high - low + 1;
+    taps.index.resize(static_cast<size_t>(destination) * taps.count);
+    taps.weight.resize(taps.index.size());
+    for (int d = 0; d < destination; d++) {
+        double sum = 0.0;
+        for (int k = low; k <= high; k++)
+            sum += raw[static_cast<size_t>(d) * span + k];
+        for (int k = low; k <= high; k++) {
+            size_t slot = static_cast<size_t>(d) * taps.count + (k - low);
+            taps.index[slot] = std::min(std::max(first[d] + k, 0), source - 1);
+            taps.weight[slot] = static_cast<float>(raw[static_cast<size_t>(d) * span + k] / sum);
+        }
+    }
+    return taps;
+}
+
+bool isColorChannel(int channel, int channels) {
+    return channels >= 3 ? channel < 3 : channel == 0;
+}
+
+void filterRow(const float* source, const AxisTaps& columns, int channels, int width, float* out) {
+#ifdef MIP_GENERATOR_SSE2
+    if (channels == 4) {
+        for (int x = 0; x < width; x++) {
+            const int* index = &columns.index[static_cast<size_t>(x) * columns.count];
+            const float* weight = &columns.weight[static_cast<size_t>(x) * columns.count];
+            __m128 sum = _mm_setzero_ps();
+            for (int k = 0; k < columns.count; k++)
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weight[k]), _mm_loadu_ps(source + index[k] * 4)));
+            _mm_storeu_ps(out + x * 4, sum);
+        }
+        return;
+    }
+#endif
+    for (int x = 0; x < width; x++) {
+        const int* index = &columns.index[static_cast<size_t>(x) * columns.count];
+        const float* weight = &columns.weight[static_cast<size_t>(x) * columns.count];
+        for (int c = 0; c < channels; c++) {
+            float sum = 0.0f;
+            for (int k = 0; k < columns.count; k++)
+                sum += weight[k] * source[index[k] * channels + c];
+            out[x * channels + c] = sum;
+        }
+    }
+}
+
+// out += weight * row, over a whole row of floats
+void accumulateRow(const float* row, float weight, size_t count, float* out) {
+    size_t i = 0;
+#ifdef MIP_GENERATOR_SSE2
+    __m128 w = _mm_set1_ps(weight);
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(w, _mm_loadu_ps(row + i))));
+#endif
+    for (; i < count; i++)
+        out[i] += weight * row[i];
+}
+
+void downsampleLevel(const unsigned char* source, int sourceWidth, int sourceHeight, unsigned char* out, int width,
+                     int height, int channels, bool srgb, MipFilter filter, unsigned int threads) {
+    AxisTaps columns = buildTaps(filter, sourceWidth, width);
+    AxisTaps rows = buildTaps(filter, sourceHeight, height);
+    const ColorTables& tables = colorTables();
+    bool color[4];
+    const float* decode[4];
+    for (int c = 0; c < 4; c++) {
+        color[c] = srgb && c < channels && isColorChannel(c, channels);
+        decode[c] = color[c] ? tables.srgbToLinear : tables.byteToUnit;
+    }
+    size_t sourceFloats = static_cast<size_t>(sourceWidth) * channels;
+    size_t rowFloats = static_cast<size_t>(width) * channels;
+
+    ThreadPool::shared().parallelFor(static_cast<size_t>(height), [&](size_t begin, size_t end) {
+        // The band of source rows the chunk's taps reach, each filtered horizontally once
+        int firstRow = sourceHeight, lastRow = 0;
+        for (size_t y = begin; y < end; y++) {
+            for (int k = 0; k < rows.count; k++) {
+                firstRow = std::min(firstRow, rows.index[y * rows.count + k]);
+                lastRow = std::max(lastRow, rows.index[y * rows.count + k]);
+            }
+        }
+
+        std::vector<float> linear(sourceFloats);
+        std::vector<float> band(static_cast<size_t>(lastRow - firstRow + 1) * rowFloats);
+        for (int r = firstRow; r <= lastRow; r++) {
+            const unsigned char* texels = source + static_cast<size_t>(r) * sourceFloats;
+            for (size_t i = 0; i < sourceFloats; i += channels) {
+                for (int c = 0; c < channels; c++)
+                    linear[i + c] = decode[c][texels[i + c]];
+            }
+            filterRow(linear.data(), columns, channels, width, band.data() + static_cast<size_t>(r - firstRow) * rowFloats);
+        }
+
+        std::vector<float> sum(rowFloats);
+        for (size_t y = begin; y < end; y++) {
+            std::fill(sum.begin(), sum.end(), 0.0f);
+            for (int k = 0; k < rows.count; k++) {
+                size_t slot = y * rows.count + k;
+                accumulateRow(band.data() + static_cast<size_t>(rows.index[slot] - firstRow) * rowFloats,
+                              rows.weight[slot], rowFloats, sum.data());
+            }
+            // Negative lobes can overshoot; values are clamped on the way back to bytes
+            unsigned char* texels = out + y * rowFloats;
+            for (size_t i = 0; i < rowFloats; i += channels) {
+                for (int c = 0; c < channels; c++) {
+                    float value = std::min(std::max(sum[i + c], 0.0f), 1.0f);
+                    texels[i + c] = color[c] ? tables.linearToSrgb[static_cast<int>(value * (SRGB_TABLE_SIZE - 1) + 0.5f)]
+                                             : static_cast<unsigned char>(value * 255.0f + 0.5f);
+                }
+            }
+        }
+    }, ROWS_PER_CHUNK, threads);
+}
+
+void alphaHistogram(const unsigned char* pixels, size_t texels, size_t histogram[256], unsigned int threads) {
+    std::fill(histogram, histogram + 256, 0);
+    std::mutex mutex;
+    ThreadPool::shared().parallelFor(texels, [&](size_t begin, size_t end) {
+        size_t local[256] = {};
+        for (size_t i = begin; i < end; i++)
+            local[pixels[i * 4 + 3]]++;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int a = 0; a < 256; a++)
+            histogram[a] += local[a];
+    }, 1 << 16, threads);
+}
+
+// Texels whose alpha, multiplied by scale, ends above the cutoff
+size_t coveredTexels(const size_t histogram[256], float cutoff, double scale) {
+    size_t covered = 0;
+    for (int a = 0; a < 256; a++) {
+        if (a * scale > cutoff * 255.0)
+            covered += histogram[a];
+    }
+    return covered;
+}
+
+// Scales the alpha of an RGBA level so that about target of its texels pass the cutoff
+void preserveCoverage(unsigned char* pixels, size_t texels, float cutoff, double target, unsigned int threads) {
+    size_t histogram[256];
+    alphaHistogram(pixels, texels, histogram, threads);
+    double coverage = static_cast<double>(coveredTexels(histogram, cutoff, 1.0)) / texels;
+    if (coverage == target)
+        return;
+
+    // Coverage only grows with the scale; search the side of 1 that moves toward the target
+    double low = coverage < target ? 1.0 : 0.0;
+    double high = coverage < target ? 64.0 : 1.0;
+    for (int iteration = 0; iteration < 24; iteration++) {
+        double middle = (low + high) * 0.5;
+        if (static_cast<double>(coveredTexels(histogram, cutoff, middle)) / texels < target)
+            low = middle;
+        else
+            high = middle;
+    }
+    double scale = high;
+
+    unsigned char scaled[256];
+    for (int a = 0; a < 256; a++)
+        scaled[a] = static_cast<unsigned char>(std::min(255.0, std::floor(a * scale + 0.5)));
+    ThreadPool::shared().parallelFor(texels, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            pixels[i * 4 + 3] = scaled[pixels[i * 4 + 3]];
+    }, 1 << 16, threads);
+}
+
+} // namespace
+
+const char* mipFilterName(MipFilter filter) {
+    static const char* names[] = {"box", "kaiser", "lanczos"};
+    return names[static_cast<int>(filter)];
+}
+
+bool parseMipFilter(const std::string& name, MipFilter& filter) {
+    for (MipFilter candidate : {MipFilter::Box, MipFilter::Kaiser, MipFilter::Lanczos}) {
+        if (name == mipFilterName(candidate)) {
+            filter = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void generateMips(const unsigned char* pixels, int width, int height, int channels, bool srgb,
+                  const MipSettings& settings, MipChain& out, unsigned int threads) {
+    out.width = width;
+    out.height = height;
+    out.channels = channels;
+    out.levels.clear();
+
+    size_t total = 0;
+    for (int levelWidth = width, levelHeight = height;; levelWidth = std::max(1, levelWidth / 2),
+             levelHeight = std::max(1, levelHeight / 2)) {
+        size_t size = static_cast<size_t>(levelWidth) * levelHeight * channels;
+        out.levels.push_back({total, size, levelWidth, levelHeight});
+        total += size;
+        if (levelWidth == 1 && levelHeight == 1)
+            break;
+    }
+    out.data.resize(total);
+    memcpy(out.data.data(), pixels, out.levels[0].size);
+
+    // Coverage is only worth keeping when the image has both cut-out and kept texels
+    bool coverage = false;
+    double target = 0.0;
+    if (settings.preserveCoverage && channels == 4) {
+        size_t histogram[256];
+        size_t texels = static_cast<size_t>(width) * height;
+        alphaHistogram(pixels, texels, histogram, threads);
+        target = static_cast<double>(coveredTexels(histogram, settings.alphaCutoff, 1.0)) / texels;
+        coverage = target > 0.0 && target < 1.0;
+    }
+
+    for (size_t i = 1; i < out.levels.size(); i++) {
+        const MipChain::Level& above = out.levels[i - 1];
+        const MipChain::Level& level = out.levels[i];
+        unsigned char* texels = out.data.data() + level.offset;
+        downsampleLevel(out.data.data() + above.offset, above.width, above.height, texels, level.width, level.height,
+                        channels, srgb, settings.filter, threads);
+        if (coverage)
+            preserveCoverage(texels, static_cast<size_t>(level.width) * level.height, settings.alphaCutoff, target,
+                             threads);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef MIP_GENERATOR_H
+#define MIP_GENERATOR_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+enum class MipFilter { Box, Kaiser, Lanczos };
+
+struct MipSettings {
+    // Box averages 2x2 texels; Kaiser and Lanczos are windowed sincs that keep more detail
+    MipFilter filter = MipFilter::Kaiser;
+    // Rescale the alpha of smaller levels of RGBA images so the share of texels above
+    // alphaCutoff stays that of the full image, keeping alpha-tested edges from thinning out
+    bool preserveCoverage = true;
+    float alphaCutoff = 0.5f;
+};
+
+// Every level of an 8-bit image back to back from the largest, down to 1x1
+struct MipChain {
+    struct Level {
+        size_t offset = 0;
+        size_t size = 0;
+        int width = 0;
+        int height = 0;
+    };
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    std::vector<Level> levels;
+    std::vector<unsigned char> data;
+};
+
+const char* mipFilterName(MipFilter filter);
+// False when the name is not box, kaiser or lanczos
+bool parseMipFilter(const std::string& name, MipFilter& filter);
+
+// Builds the mip chain of an image with 1-4 channels. With srgb set the color channels are
+// decoded to linear light before filtering and encoded again after; alpha is always linear.
+// Each level is filtered from the one above with separable kernels, rows split over up to threads
+// pool threads and texels processed with SSE2 where available. The output does not depend on
+// the thread count.
+void generateMips(const unsigned char* pixels, int width, int height, int channels, bool srgb,
+                  const MipSettings& settings, MipChain& out, unsigned int threads = 0);
+
+#endif
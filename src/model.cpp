@@ -1,5 +1,62 @@
 // model.cpp
 #include "model.h"
+#include "geometry_pool.h"
+#include "gltf_loader.h"
+#include "mesh_cache.h"
+#include "obj_loader.h"
+#include "stb_image.h"
+#include "texture_cache.h"
+#include "texture_streamer.h"
+#include "thread_pool.h"
+
+#include <assimp/ProgressHandler.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <filesystem>
+#include <limits>
+namespace fs = std::filesystem;
+
+namespace {
+
+// Keeps the projected size finite when the camera is inside the bounds
+const float LOD_MIN_DISTANCE = 0.01f;
+// Texture unit of a model's texture array, clear of the units meshes and the watercolor shader use
+const int ATLAS_TEXTURE_UNIT = 3;
+
+} // namespace
+
+ImportSettings Model::importSettings;
+LodSettings Model::lodSettings;
+TextureAtlasSettings Model::atlasSettings;
+CpuGeometryPolicy Model::defaultGeometryPolicy = CpuGeometryPolicy::Release;
+
+uint64_t ImportSettings::cacheKey() const {
+    // FNV-1a over the Assimp flags and the settings that affect the output
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const void *bytes, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            hash ^= static_cast<const unsigned char *>(bytes)[i];
+            hash *= 1099511628211ull;
+        }
+    };
+    unsigned int flags = MODEL_IMPORT_FLAGS;
+    mix(&flags, sizeof(flags));
+    mix(&weldVertices, sizeof(weldVertices));
+    if (weldVertices) {
+        mix(&weld.positionEpsilon, sizeof(weld.positionEpsilon));
+        mix(&weld.normalAngle, sizeof(weld.normalAngle));
+        mix(&weld.uvEpsilon, sizeof(weld.uvEpsilon));
+    }
+    mix(&stl.positionEpsilon, sizeof(stl.positionEpsilon));
+    mix(&stl.creaseAngle, sizeof(stl.creaseAngle));
+    mix(&optimizeMeshes, sizeof(optimizeMeshes));
+    if (optimizeMeshes)
+        mix(&overdrawThreshold, sizeof(overdrawThreshold));
+    return hash;
+}
 
 Model::Model(const std::string &path, bool gamma) : gammaCorrection(gamma) {
     loadModel(path);
@@ -11,63 +68,627 @@ Model::Model() {
     // createGrid(10, 20);
 }
 
+Model::Model(std::vector<MeshData> &&meshData, const std::string &directory, const std::string &sourcePath,
+             uint64_t cacheKey)
+    : directory(directory), gammaCorrection(false), sourcePath(sourcePath), sourceCacheKey(cacheKey) {
+    setupMeshes(std::move(meshData));
+}
+
+void Model::setupMeshes(std::vector<MeshData> &&meshData) {
+    startAtlasBuild(meshData);
+
+    // Image files become textures through the TextureCache, shared with every other mesh and model
+    // using them; images that are not files of their own are shared by their pixels
+    std::map<const void *, Texture> uploaded;
+    for (MeshData &data : meshData) {
+        for (const MaterialImage &image : data.materialImages) {
+            Texture texture;
+            if (image.path.empty()) {
+                auto found = uploaded.find(image.pixels.get());
+                if (found == uploaded.end()) {
+                    if (!TextureCache::shared().acquire(image, texture))
+                        continue;
+                    found = uploaded.emplace(image.pixels.get(), texture).first;
+                }
+                texture = found->second;
+            } else if (!TextureCache::shared().acquire(image, texture)) {
+                continue;
+            }
+            texture.type = image.type;
+            data.textures.push_back(texture);
+
+            bool known = std::any_of(textures_loaded.begin(), textures_loaded.end(),
+                                     [&texture](const Texture &loaded) { return loaded.id == texture.id; });
+            if (!known)
+                textures_loaded.push_back(texture);
+        }
+        data.materialImages.clear();
+    }
+
+    auto source = std::make_shared<const std::vector<MeshData>>(std::move(meshData));
+    meshes.reserve(source->size());
+    size_t gpuBytes = 0;
+    size_t fullBytes = 0;
+    for (const MeshData &data : *source) {
+        meshes.emplace_back(data);
+        gpuBytes += meshes.back().gpuBytes();
+        fullBytes += data.hasStreams() ? meshes.back().gpuBytes()
+                                       : data.vertexCount() * sizeof(Vertex) + data.indexCount() * sizeof(unsigned int);
+    }
+    std::cout << "Uploaded " << gpuBytes / 1024 << " KB of geometry (" << fullBytes / 1024 << " KB as full vertices)"
+              << std::endl;
+    weakGeometry = source;
+    if (geometryPolicy == CpuGeometryPolicy::Keep)
+        geometry = source;
+    updateBounds();
+    startLodBuild(source);
+}
+
+void Model::startLodBuild(std::shared_ptr<const std::vector<MeshData>> source) {
+    // Meshes uploaded from file streams have no Vertex copy to simplify
+    bool simplifiable = std::any_of(source->begin(), source->end(), [](const MeshData &data) { return !data.hasStreams(); });
+    if (!lodSettings.enabled || !simplifiable)
+        return;
+
+    // Simplify on the pool while LOD0 is already on screen. The build only holds a weak reference
+    // to its results, so replacing the model cancels it.
+    lodBuild = std::make_shared<LodBuild>();
+    std::weak_ptr<LodBuild> target = lodBuild;
+    LodSettings settings = lodSettings;
+    ThreadPool::shared().submit([source, target, settings]() {
+        auto startTime = std::chrono::steady_clock::now();
+        auto cancelled = [&target]() { return target.expired(); };
+        std::vector<std::vector<LodLevel>> levels(source->size());
+        ThreadPool::shared().parallelFor(source->size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                if (!(*source)[i].hasStreams())
+                    levels[i] = buildLodChain((*source)[i], settings, cancelled);
+            }
+        });
+
+        std::shared_ptr<LodBuild> build = target.lock();
+        if (!build)
+            return;
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - startTime;
+        std::cout << "Built LODs for " << levels.size() << " meshes in " << elapsed.count() << " ms" << std::endl;
+        build->levels = std::move(levels);
+        build->done = true;
+    });
+}
+
+void Model::pollLodBuild() {
+    if (!lodBuild || !lodBuild->done)
+        return;
+
+    for (size_t i = 0; i < meshes.size() && i < lodBuild->levels.size(); i++) {
+        std::vector<LodLevel> &levels = lodBuild->levels[i];
+        for (size_t level = 0; level < levels.size(); level++) {
+            std::cout << "Mesh " << i << " LOD" << level + 1 << ": " << levels[level].indices.size() / 3
+                      << " triangles, error " << levels[level].error << std::endl;
+        }
+        meshes[i].addLods(std::move(levels));
+    }
+    lodBuild.reset();
+}
+
+bool Model::rebuildLods() {
+    std::shared_ptr<const std::vector<MeshData>> source = cpuGeometry();
+    if (!source || source->size() != meshes.size())
+        return false;
+    for (Mesh &mesh : meshes)
+        mesh.clearLods();
+    lastLod = 0;
+    // Replacing the build cancels one still running
+    lodBuild.reset();
+    startLodBuild(source);
+    return true;
+}
+
+void Model::startAtlasBuild(const std::vector<MeshData> &meshData) {
+    if (!atlasSettings.enabled)
+        return;
+
+    // The shaders only sample a mesh's first diffuse texture
+    std::vector<MaterialImage> images;
+    std::vector<int> meshImages(meshData.size(), -1);
+    for (size_t i = 0; i < meshData.size(); i++) {
+        const std::vector<MaterialImage> &materialImages = meshData[i].materialImages;
+        auto diffuse = std::find_if(materialImages.begin(), materialImages.end(),
+                                    [](const MaterialImage &image) { return image.type == "texture_diffuse"; });
+        if (diffuse == materialImages.end())
+            continue;
+        auto same = std::find_if(images.begin(), images.end(), [&diffuse](const MaterialImage &image) {
+            return diffuse->path.empty() ? image.pixels == diffuse->pixels
+                                         : image.path == diffuse->path && image.params == diffuse->params;
+        });
+        meshImages[i] = static_cast<int>(same - images.begin());
+        if (same == images.end())
+            images.push_back(*diffuse);
+    }
+    if (images.empty())
+        return;
+
+    GLint maxLayers = 0, maxSize = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    TextureAtlasSettings settings = atlasSettings;
+    settings.maxLayerSize = std::min(settings.maxLayerSize, static_cast<int>(maxSize));
+    TextureStreamer &streamer = TextureStreamer::shared();
+    MipSettings mips = streamer.mips;
+    unsigned int formats = streamer.compression.enabled ? streamer.compressibleFormats() : 0;
+
+    atlasBuild = std::make_shared<AtlasBuild>();
+    atlasBuild->meshImages = std::move(meshImages);
+    std::weak_ptr<AtlasBuild> target = atlasBuild;
+    ThreadPool::shared().submit([images, target, settings, mips, formats, maxLayers]() {
+        if (target.expired())
+            return;
+        auto startTime = std::chrono::steady_clock::now();
+        TextureAtlasData atlas;
+        bool built = buildTextureAtlas(images, settings, mips, formats, maxLayers, atlas);
+
+        std::shared_ptr<AtlasBuild> build = target.lock();
+        if (!build)
+            return;
+        build->atlas = std::move(atlas);
+        build->built = built;
+        build->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        build->done = true;
+    });
+}
+
+void Model::pollAtlasBuild() {
+    if (!atlasBuild || !atlasBuild->done)
+        return;
+    std::shared_ptr<AtlasBuild> build = std::move(atlasBuild);
+    if (!build->built) {
+        std::cout << "WARNING::MODEL::TEXTURE_ARRAY_NOT_BUILT: meshes keep binding their own textures" << std::endl;
+        return;
+    }
+
+    const TextureAtlasData &atlas = build->atlas;
+    size_t bindsBefore = 0;
+    size_t bindsAfter = 1;
+    for (const Mesh &mesh : meshes)
+        bindsBefore += mesh.textures.size();
+    atlasTexture = uploadTextureAtlas(atlas);
+    atlasLayerCount = atlas.layers;
+
+    for (size_t i = 0; i < meshes.size() && i < build->meshImages.size(); i++) {
+        Mesh &mesh = meshes[i];
+        if (build->meshImages[i] < 0) {
+            bindsAfter += mesh.textures.size();
+            continue;
+        }
+        // The array replaces the diffuse texture; no shader samples the other maps
+        mesh.atlasSlot = atlas.slots[build->meshImages[i]];
+        mesh.textures.erase(std::remove_if(mesh.textures.begin(), mesh.textures.end(),
+                                           [](const Texture &texture) { return texture.type == "texture_diffuse"; }),
+                            mesh.textures.end());
+    }
+    textures_loaded.clear();
+    for (const Mesh &mesh : meshes) {
+        for (const Texture &texture : mesh.textures) {
+            bool known = std::any_of(textures_loaded.begin(), textures_loaded.end(),
+                                     [&texture](const Texture &loaded) { return loaded.id == texture.id; });
+            if (!known)
+                textures_loaded.push_back(texture);
+        }
+    }
+
+    std::cout << "Texture array: " << atlas.slots.size() << " images in " << atlas.layers
+              << (atlas.packed ? " packed" : "") << " layers of " << atlas.layerWidth << "x" << atlas.layerHeight
+              << " (" << (atlas.compressed ? blockFormatName(atlas.format) : "RGBA8") << "), built in "
+              << build->milliseconds << " ms" << std::endl;
+    std::cout << "Per frame: " << meshes.size() << " draws, texture binds " << bindsBefore << " -> " << bindsAfter
+              << std::endl;
+}
+
+bool Model::bindAtlas(Shader &shader) {
+    pollAtlasBuild();
+    // Samplers of different types must not share a unit, even when one of them goes unused
+    shader.setInt("materialTextures", ATLAS_TEXTURE_UNIT);
+    if (!atlasTexture) {
+        shader.setBool("useMaterialArray", false);
+        return false;
+    }
+    glActiveTexture(GL_TEXTURE0 + ATLAS_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, atlasTexture->id());
+    glActiveTexture(GL_TEXTURE0);
+    return true;
+}
+
+void Model::updateBounds() {
+    // Sphere around the box that holds every meshlet's sphere
+    glm::vec3 boundsMin(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+    for (const Mesh &mesh : meshes) {
+        for (const Meshlet &meshlet : mesh.lods[0].meshlets) {
+            boundsMin = glm::min(boundsMin, meshlet.center - glm::vec3(meshlet.radius));
+            boundsMax = glm::max(boundsMax, meshlet.center + glm::vec3(meshlet.radius));
+        }
+    }
+    boundsCenter = glm::vec3(0.0f);
+    boundsRadius = 0.0f;
+    if (boundsMin.x > boundsMax.x)
+        return;
+
+    boundsCenter = (boundsMin + boundsMax) * 0.5f;
+    for (const Mesh &mesh : meshes) {
+        for (const Meshlet &meshlet : mesh.lods[0].meshlets)
+            boundsRadius = std::max(boundsRadius, glm::length(meshlet.center - boundsCenter) + meshlet.radius);
+    }
+}
+
+unsigned int Model::lodCount() const {
+    size_t count = 0;
+    for (const Mesh &mesh : meshes)
+        count = std::max(count, mesh.lods.size());
+    return static_cast<unsigned int>(count);
+}
+
+std::shared_ptr<const std::vector<MeshData>> Model::cpuGeometry() const {
+    if (std::shared_ptr<const std::vector<MeshData>> held = weakGeometry.lock())
+        return held;
+
+    // The cache holds exactly what was uploaded, under the key of the settings the model was imported with
+    auto reloaded = std::make_shared<std::vector<MeshData>>();
+    if (!sourcePath.empty() && sourceCacheKey != 0 &&
+        MeshCache::instance().reload(sourcePath, sourceCacheKey, *reloaded) && reloaded->size() == meshes.size())
+        return reloaded;
+
+    reloaded->clear();
+    reloaded->resize(meshes.size());
+    for (size_t i = 0; i < meshes.size(); i++) {
+        if (!meshes[i].readBack((*reloaded)[i]))
+            return nullptr;
+    }
+    return reloaded;
+}
+
+size_t Model::cpuGeometryBytes() const {
+    size_t bytes = 0;
+    if (std::shared_ptr<const std::vector<MeshData>> held = weakGeometry.lock()) {
+        for (const MeshData &data : *held) {
+            bytes += data.vertices.capacity() * sizeof(Vertex) + data.indices.capacity() * sizeof(unsigned int) +
+                     data.meshlets.capacity() * sizeof(Meshlet);
+        }
+    }
+    for (const Mesh &mesh : meshes)
+        bytes += mesh.vertices.capacity() * sizeof(Vertex) + mesh.indices.capacity() * sizeof(unsigned int);
+    return bytes;
+}
+
+size_t Model::gpuGeometryBytes() const {
+    size_t bytes = 0;
+    for (const Mesh &mesh : meshes)
+        bytes += mesh.gpuBytes();
+    return bytes;
+}
+
 void Model::replaceTextures(const std::vector<Texture>& newTextures) {
     if (!meshes.empty()) {
         meshes[0].textures = newTextures;
+        // The first mesh binds its own texture from now on
+        meshes[0].atlasSlot = AtlasSlot();
     }
 }
 
 void Model::Draw(Shader &shader) {
+    bool atlasBound = bindAtlas(shader);
     for(unsigned int i = 0; i < meshes.size(); i++) {
-        meshes[i].Draw(shader);
+        meshes[i].Draw(shader, atlasBound);
+    }
+    GeometryPool::shared().unbindVertexArray();
+}
+
+void Model::DrawPositions(Shader &shader) {
+    for (Mesh &mesh : meshes)
+        mesh.DrawPositions(shader);
+    GeometryPool::shared().unbindVertexArray();
+}
+
+void Model::Draw(ShaderVariants &style, ShaderQuality quality, ClusterView &view, const Camera &camera,
+                 const Transform &transform, float viewportHeight) {
+    pollLodBuild();
+    pollAtlasBuild();
+
+    // Screen pixels per model unit at the nearest point of the bounding sphere
+    glm::vec3 scale = glm::abs(transform.Scale);
+    float maxScale = std::max(scale.x, std::max(scale.y, scale.z));
+    glm::vec3 center = glm::vec3(transform.GetModelMatrix() * glm::vec4(boundsCenter, 1.0f));
+    float distance = std::max(glm::length(center - camera.Position) - boundsRadius * maxScale, LOD_MIN_DISTANCE);
+    float pixelsPerUnit = maxScale * viewportHeight * 0.5f / (distance * std::tan(glm::radians(camera.Zoom) * 0.5f));
+
+    Shader *current = nullptr;
+    bool atlasBound = false;
+    lastLod = 0;
+    for (Mesh &mesh : meshes) {
+        ShaderVariantKey key;
+        key.hasTexture = mesh.hasDiffuseTexture(atlasTexture != nullptr);
+        key.quality = quality;
+        Shader &shader = style.get(key);
+        if (&shader != current) {
+            shader.use();
+            atlasBound = bindAtlas(shader);
+            if (atlasBound)
+                view.stats.textureBinds++;
+            current = &shader;
+        }
+
+        unsigned int lod = mesh.selectLod(pixelsPerUnit, lodSettings.pixelError);
+        lastLod = std::max(lastLod, lod);
+        mesh.Draw(shader, view, lod, atlasBound);
+    }
+    // Meshes of one format bind their shared vertex array once per run
+    GeometryPool::shared().unbindVertexArray();
+}
+
+namespace {
+
+// Forwards Assimp's read progress to a LoadProgress and aborts the import when it is cancelled
+class ImportProgressHandler : public Assimp::ProgressHandler {
+public:
+    ImportProgressHandler(LoadProgress *progress, float scale) : progress(progress), scale(scale) {}
+
+    bool Update(float percentage) override {
+        if (percentage >= 0.0f)
+            progress->value = percentage * scale;
+        return !progress->cancelled;
     }
+
+private:
+    LoadProgress *progress;
+    float scale;
+};
+
+// Share of the progress bar taken by reading the file, the rest is post-processing
+const float IMPORT_READ_PROGRESS = 0.6f;
+
+std::string lowercaseExtension(const std::string &path) {
+    std::string extension = fs::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    return extension;
 }
 
+} // namespace
+
 void Model::loadModel(const std::string &path) {
-    // Read file via ASSIMP
+    // Retrieve the directory path of the filepath
+    directory = path.substr(0, path.find_last_of('/'));
+    sourcePath = path;
+
+    std::vector<MeshData> meshData;
+    if (!importMeshes(path, meshData, nullptr, &sourceCacheKey))
+        return;
+
+    setupMeshes(std::move(meshData));
+}
+
+bool Model::importMeshes(const std::string &path, std::vector<MeshData> &meshData, LoadProgress *progress,
+                         uint64_t *usedCacheKey) {
+    // Repeat loads come straight from the memory-mapped mesh cache
+    uint64_t cacheKey = importSettings.cacheKey();
+    if (usedCacheKey)
+        *usedCacheKey = cacheKey;
+    if (MeshCache::instance().load(path, cacheKey, meshData)) {
+        std::cout << "Mesh cache hit: " << path << std::endl;
+        decodeMaterialImages(meshData);
+        if (progress)
+            progress->value = 1.0f;
+        return true;
+    }
+
+    // OBJ and STL have native readers, everything else goes through Assimp
+    auto readStart = std::chrono::steady_clock::now();
+    unsigned int threads = importThreadCount();
+    std::vector<MeshData> processed;
+    std::string extension = lowercaseExtension(path);
+    if (extension == ".gltf" || extension == ".glb") {
+        // Uploaded as stored, so neither cached nor post-processed
+        if (!loadGltf(path, processed, threads, progress))
+            return false;
+        size_t vertexCount = 0;
+        size_t meshletCount = 0;
+        for (const MeshData &data : processed) {
+            vertexCount += data.streamVertexCount;
+            meshletCount += data.meshlets.size();
+        }
+        std::chrono::duration<double, std::milli> readTime = std::chrono::steady_clock::now() - readStart;
+        std::cout << "Imported " << processed.size() << " meshes (" << vertexCount << " vertices, " << meshletCount
+                  << " meshlets) from " << path << ": read " << readTime.count() << " ms on " << threads
+                  << " threads" << std::endl;
+        meshData = std::move(processed);
+        return true;
+    }
+    bool read;
+    bool weld = importSettings.weldVertices;
+    if (extension == ".obj") {
+        read = loadObj(path, processed, threads, progress, IMPORT_READ_PROGRESS);
+    } else if (extension == ".stl") {
+        // Comes out welded already
+        read = loadStl(path, processed, importSettings.stl, threads, progress, IMPORT_READ_PROGRESS);
+        weld = false;
+    } else {
+        read = readWithAssimp(path, processed, progress);
+    }
+    if (!read || (progress && progress->cancelled))
+        return false;
+
+    // Post-process the meshes in parallel; results stay in reader order
+    auto processStart = std::chrono::steady_clock::now();
+    std::vector<WeldStats> weldStats(processed.size());
+    std::vector<OptimizeStats> optimizeStats(processed.size());
+    std::atomic<size_t> completed{0};
+    ThreadPool::shared().parallelFor(processed.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            if (progress && progress->cancelled)
+                return;
+            if (weld)
+                weldStats[i] = weldVertices(processed[i], importSettings.weld, threads);
+            if (importSettings.optimizeMeshes)
+                optimizeStats[i] = optimizeMesh(processed[i], importSettings.overdrawThreshold);
+            processed[i].meshlets = buildMeshlets(processed[i].vertexData(), processed[i].vertexCount(),
+                                                  processed[i].indexData(), processed[i].indexCount());
+
+            if (progress) {
+                float done = static_cast<float>(++completed) / static_cast<float>(processed.size());
+                progress->value = IMPORT_READ_PROGRESS + (1.0f - IMPORT_READ_PROGRESS) * done;
+            }
+        }
+    }, 1, threads);
+    if (progress && progress->cancelled)
+        return false;
+    auto processEnd = std::chrono::steady_clock::now();
+
+    size_t vertexCount = 0;
+    size_t meshletCount = 0;
+    for (size_t i = 0; i < processed.size(); i++) {
+        vertexCount += processed[i].vertexCount();
+        meshletCount += processed[i].meshlets.size();
+        if (weld) {
+            const WeldStats &welded = weldStats[i];
+            std::cout << "Welded mesh " << i << ": " << welded.verticesBefore << " -> " << welded.verticesAfter
+                      << " vertices, " << welded.bytesBefore / 1024 << " KB -> " << welded.bytesAfter / 1024 << " KB";
+            if (welded.degenerateTriangles > 0)
+                std::cout << ", " << welded.degenerateTriangles << " degenerate triangles removed";
+            std::cout << std::endl;
+        }
+        if (importSettings.optimizeMeshes) {
+            const OptimizeStats &optimized = optimizeStats[i];
+            std::cout << "Optimized mesh " << i << ": ACMR " << optimized.before.acmr << " -> " << optimized.after.acmr
+                      << ", ATVR " << optimized.before.atvr << " -> " << optimized.after.atvr << ", "
+                      << optimized.clusters << " overdraw clusters" << std::endl;
+        }
+    }
+    std::chrono::duration<double, std::milli> readTime = processStart - readStart;
+    std::chrono::duration<double, std::milli> processTime = processEnd - processStart;
+    std::cout << "Imported " << processed.size() << " meshes (" << vertexCount << " vertices, " << meshletCount
+              << " meshlets) from " << path << ": read " << readTime.count() << " ms, process "
+              << processTime.count() << " ms on " << threads << " threads" << std::endl;
+
+    // The cache keeps material images as paths, so embedded ones would be lost on the next load
+    bool embeddedImages = std::any_of(processed.begin(), processed.end(), [](const MeshData &data) {
+        return std::any_of(data.materialImages.begin(), data.materialImages.end(),
+                           [](const MaterialImage &image) { return image.path.empty(); });
+    });
+    meshData = std::move(processed);
+    if (!embeddedImages)
+        MeshCache::instance().store(path, cacheKey, meshData);
+    if (progress)
+        progress->value = 1.0f;
+    return true;
+}
+
+void Model::compareReaders(const std::string &path) {
+    std::string extension = lowercaseExtension(path);
+    if (extension != ".obj" && extension != ".stl") {
+        std::cout << "WARNING::MODEL::NO_NATIVE_READER: " << path << std::endl;
+        return;
+    }
+    unsigned int threads = importThreadCount();
+    auto report = [&path](const char *reader, const std::vector<MeshData> &meshes, double milliseconds) {
+        size_t vertexCount = 0, triangleCount = 0, bytes = 0;
+        for (const MeshData &mesh : meshes) {
+            vertexCount += mesh.vertexCount();
+            triangleCount += mesh.indexCount() / 3;
+            bytes += mesh.vertexCount() * sizeof(Vertex) + mesh.indexCount() * sizeof(unsigned int);
+        }
+        std::cout << reader << ": " << milliseconds << " ms, " << meshes.size() << " meshes, " << vertexCount
+                  << " vertices, " << triangleCount << " triangles, " << bytes / 1024 << " KB (" << path << ")"
+                  << std::endl;
+    };
+
+    std::vector<MeshData> native;
+    auto start = std::chrono::steady_clock::now();
+    bool read = extension == ".obj" ? loadObj(path, native, threads)
+                                    : loadStl(path, native, importSettings.stl, threads);
+    std::chrono::duration<double, std::milli> nativeTime = std::chrono::steady_clock::now() - start;
+    if (read)
+        report("Native reader", native, nativeTime.count());
+    native.clear();
+
+    // Assimp output is only comparable once welded
+    std::vector<MeshData> imported;
+    start = std::chrono::steady_clock::now();
+    if (readWithAssimp(path, imported, nullptr)) {
+        ThreadPool::shared().parallelFor(imported.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                weldVertices(imported[i], importSettings.weld, threads);
+        }, 1, threads);
+        std::chrono::duration<double, std::milli> assimpTime = std::chrono::steady_clock::now() - start;
+        report("Assimp + weld", imported, assimpTime.count());
+        if (read)
+            std::cout << "Native reader speedup: " << assimpTime.count() / nativeTime.count() << "x" << std::endl;
+    }
+}
+
+bool Model::readWithAssimp(const std::string &path, std::vector<MeshData> &meshData, LoadProgress *progress) {
     Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(path, 
-        aiProcess_Triangulate | 
-        aiProcess_GenSmoothNormals | 
-        aiProcess_FlipUVs | 
-        aiProcess_CalcTangentSpace);
+    if (progress) {
+        // The importer takes ownership of the handler
+        importer.SetProgressHandler(new ImportProgressHandler(progress, IMPORT_READ_PROGRESS));
+    }
+    const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
     
     // Check for errors
+    if (progress && progress->cancelled)
+        return false;
     if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
         std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
-        return;
+        return false;
     }
-    
-    // Retrieve the directory path of the filepath
-    directory = path.substr(0, path.find_last_of('/'));
 
-    // Process ASSIMP's root node recursively
-    processNode(scene->mRootNode, scene);
+    // Walk the node tree first, then convert the collected meshes in parallel. Results are stored by
+    // work item index so the mesh order matches the serial node walk.
+    std::vector<aiMesh*> workItems;
+    processNode(scene->mRootNode, scene, workItems);
+
+    std::string directory = fs::path(path).parent_path().string();
+    std::vector<MaterialImage> embedded = decodeEmbeddedTextures(scene);
+    std::vector<MeshData> converted(workItems.size());
+    ThreadPool::shared().parallelFor(workItems.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            converted[i] = processMesh(workItems[i], scene, directory, embedded);
+    }, 1, importThreadCount());
+
+    meshData = std::move(converted);
+    return true;
 }
 
-void Model::processNode(aiNode *node, const aiScene *scene) {
-    // Process each mesh located at the current node
+unsigned int Model::importThreadCount() {
+    unsigned int available = ThreadPool::shared().size() + 1;
+    return importSettings.threads == 0 ? available : std::min(importSettings.threads, available);
+}
+
+void Model::processNode(aiNode *node, const aiScene *scene, std::vector<aiMesh*> &workItems) {
+    // Collect each mesh located at the current node
     for(unsigned int i = 0; i < node->mNumMeshes; i++) {
         // The node object only contains indices to index the actual objects in the scene
-        aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        meshes.push_back(processMesh(mesh, scene));
+        workItems.push_back(scene->mMeshes[node->mMeshes[i]]);
     }
     
-    // After we've processed all of the meshes, recursively process each of the children nodes
+    // After we've collected all of the meshes, recursively process each of the children nodes
     for(unsigned int i = 0; i < node->mNumChildren; i++) {
-        processNode(node->mChildren[i], scene);
+        processNode(node->mChildren[i], scene, workItems);
     }
 }
 
-Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene) {
+MeshData Model::processMesh(aiMesh *mesh, const aiScene *scene, const std::string &directory,
+                             const std::vector<MaterialImage> &embedded) {
     // Data to fill
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
-    std::vector<Texture> textures;
+    MeshData data;
+    std::vector<Vertex> &vertices = data.vertices;
+    std::vector<unsigned int> &indices = data.indices;
+    std::vector<MaterialImage> &textures = data.materialImages;
+
+    // Size the arrays up front; faces are triangles after aiProcess_Triangulate
+    vertices.resize(mesh->mNumVertices);
+    indices.reserve(static_cast<size_t>(mesh->mNumFaces) * 3);
 
     // Walk through each of the mesh's vertices
     for(unsigned int i = 0; i < mesh->mNumVertices; i++) {
-        Vertex vertex;
+        Vertex &vertex = vertices[i];
         
         // Positions
         vertex.Position.x = mesh->mVertices[i].x;
@@ -79,6 +700,8 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene) {
             vertex.Normal.x = mesh->mNormals[i].x;
             vertex.Normal.y = mesh->mNormals[i].y;
             vertex.Normal.z = mesh->mNormals[i].z;
+        } else {
+            vertex.Normal = glm::vec3(0.0f);
         }
         
         // Texture Coordinates
@@ -107,13 +730,11 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene) {
             vertex.Tangent = glm::vec3(0.0f);
             vertex.Bitangent = glm::vec3(0.0f);
         }
-
-        vertices.push_back(vertex);
     }
     
     // Walk through each of the mesh's faces and retrieve indices
     for(unsigned int i = 0; i < mesh->mNumFaces; i++) {
-        aiFace face = mesh->mFaces[i];
+        const aiFace &face = mesh->mFaces[i];
         // Retrieve all indices of the face and store them
         for(unsigned int j = 0; j < face.mNumIndices; j++)
             indices.push_back(face.mIndices[j]);        
@@ -123,36 +744,113 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene) {
     aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
     
     // 1. Diffuse maps
-    std::vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+    std::vector<MaterialImage> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", scene, directory, embedded);
     textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
     
     // 2. Specular maps
-    std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+    std::vector<MaterialImage> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", scene, directory, embedded);
     textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
     
     // 3. Normal maps
-    std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+    std::vector<MaterialImage> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal", scene, directory, embedded);
     textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
     
     // 4. Height maps
-    std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+    std::vector<MaterialImage> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height", scene, directory, embedded);
     textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
     
-    // Return a mesh object created from the extracted mesh data
-    return Mesh(vertices, indices, textures);
+    // The GL buffers are created from this data once every mesh has been processed
+    return data;
 }
 
-std::vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName) {
-    std::vector<Texture> textures;
-    
-    // For now, we'll return an empty vector since we're not loading textures yet
-    // You can implement actual texture loading here later
-    
-    // TODO: Implement TextureFromFile function
-    
+std::vector<MaterialImage> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName,
+                                                       const aiScene *scene, const std::string &directory,
+                                                       const std::vector<MaterialImage> &embedded) {
+    std::vector<MaterialImage> textures;
+    // Diffuse maps hold sRGB color; the other maps hold data
+    TextureDecodeParams params;
+    params.srgb = type == aiTextureType_DIFFUSE;
+    for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
+        aiString str;
+        if (mat->GetTexture(type, i, &str) != AI_SUCCESS)
+            continue;
+
+        // Embedded textures are named "*<index>", or by their original file name in some formats
+        MaterialImage image;
+        const aiTexture *texture = scene->GetEmbeddedTexture(str.C_Str());
+        if (texture) {
+            auto found = std::find(scene->mTextures, scene->mTextures + scene->mNumTextures, texture);
+            image = embedded[found - scene->mTextures];
+            if (!image.pixels)
+                continue;
+            image.params = params;
+        } else {
+            std::string file = str.C_Str();
+            std::string path = fs::path(file).is_absolute() || directory.empty() ? file : directory + '/' + file;
+            if (!TextureCache::shared().decode(path, params, image))
+                continue;
+        }
+        image.type = typeName;
+        textures.push_back(image);
+    }
     return textures;
 }
 
+std::vector<MaterialImage> Model::decodeEmbeddedTextures(const aiScene *scene) {
+    std::vector<MaterialImage> images(scene->mNumTextures);
+    ThreadPool::shared().parallelFor(images.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const aiTexture *texture = scene->mTextures[i];
+            MaterialImage &image = images[i];
+            if (texture->mHeight == 0) {
+                // Compressed file contents, mWidth bytes long
+                unsigned char *pixels = stbi_load_from_memory(reinterpret_cast<const unsigned char *>(texture->pcData),
+                                                              static_cast<int>(texture->mWidth), &image.width,
+                                                              &image.height, &image.channels, 0);
+                if (!pixels) {
+                    std::cout << "WARNING::ASSIMP::CANNOT_DECODE_EMBEDDED_TEXTURE: " << i << std::endl;
+                    continue;
+                }
+                image.pixels = std::make_shared<const std::vector<unsigned char>>(
+                    pixels, pixels + static_cast<size_t>(image.width) * image.height * image.channels);
+                stbi_image_free(pixels);
+            } else {
+                // Raw BGRA texels
+                image.width = static_cast<int>(texture->mWidth);
+                image.height = static_cast<int>(texture->mHeight);
+                image.channels = 4;
+                auto pixels = std::make_shared<std::vector<unsigned char>>(static_cast<size_t>(image.width) * image.height * 4);
+                for (size_t t = 0; t < pixels->size() / 4; t++) {
+                    const aiTexel &texel = texture->pcData[t];
+                    unsigned char *out = pixels->data() + t * 4;
+                    out[0] = texel.r;
+                    out[1] = texel.g;
+                    out[2] = texel.b;
+                    out[3] = texel.a;
+                }
+                image.pixels = pixels;
+            }
+        }
+    }, 1, importThreadCount());
+    return images;
+}
+
+void Model::decodeMaterialImages(std::vector<MeshData> &meshData) {
+    ThreadPool::shared().parallelFor(meshData.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            std::vector<MaterialImage> &images = meshData[i].materialImages;
+            for (MaterialImage &image : images) {
+                std::string path = image.path;
+                TextureCache::shared().decode(path, image.params, image);
+            }
+            // Files that went missing since the cache entry was written
+            images.erase(std::remove_if(images.begin(), images.end(),
+                                        [](const MaterialImage &image) { return image.path.empty(); }),
+                         images.end());
+        }
+    }, 1, importThreadCount());
+}
+
 void Model::createCube() {
     // Clear any existing meshes
     meshes.clear();
@@ -331,6 +1029,9 @@ void Model::createCube() {
     
     // Create mesh and add to the meshes vector
     meshes.push_back(Mesh(vertices, indices, textures));
+    if (geometryPolicy == CpuGeometryPolicy::Release)
+        meshes.back().releaseCpuGeometry();
+    updateBounds();
 }
 
 void Model::createGrid(float size, int subdivisions) {
@@ -377,5 +1078,7 @@ void Model::createGrid(float size, int subdivisions) {
     std::vector<Texture> textures;
 
     meshes.push_back(Mesh(vertices, indices, textures));
+    if (geometryPolicy == CpuGeometryPolicy::Release)
+        meshes.back().releaseCpuGeometry();
 
 }
\ No newline at end of file
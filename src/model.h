@@ -10,9 +10,18 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include "camera.h"
 #include "mesh.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
 #include "shader.h"
+#include "shader_variants.h"
+#include "stl_loader.h"
+#include "texture_atlas.h"
+#include "transform.h"
 
+#include <atomic>
+#include <memory>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -23,38 +32,201 @@
 // Forward declaration
 unsigned int TextureFromFile(const char *path, const std::string &directory, bool gamma = false);
 
+// Assimp post-processing applied to every imported model; part of the mesh cache key
+const unsigned int MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs |
+                                        aiProcess_CalcTangentSpace;
+
+// Shared between a loading thread and the UI: progress in [0, 1] and a cancellation request
+struct LoadProgress {
+    std::atomic<float> value{0.0f};
+    std::atomic<bool> cancelled{false};
+};
+
+// Knobs for the import pipeline, set from the command line or the UI
+struct ImportSettings {
+    // Threads used for per-mesh processing, including the loading thread. 0 uses every hardware thread.
+    unsigned int threads = 0;
+
+    // Merge duplicate vertices after processMesh (STL and other triangle soups)
+    bool weldVertices = true;
+    WeldSettings weld;
+
+    // Welding and crease angle for the native STL reader, which replaces weldVertices for STL files
+    StlSettings stl;
+
+    // Reorder indices and vertices for the post-transform cache, overdraw and vertex fetch.
+    // overdrawThreshold is the ACMR increase accepted in exchange for finer overdraw sorting.
+    bool optimizeMeshes = true;
+    float overdrawThreshold = 1.05f;
+
+    // Identifies everything above that changes the imported geometry; part of the mesh cache key
+    uint64_t cacheKey() const;
+};
+
+// What a model keeps of its imported geometry once it is on the GPU
+enum class CpuGeometryPolicy {
+    // Keep the CPU copy for the model's lifetime
+    Keep,
+    // Drop it once it is uploaded and the LOD build is done with it; cpuGeometry() brings it back
+    Release,
+};
+
 class Model {
 public:
     // Model data 
+    // Every distinct texture the meshes use, each shared through the TextureCache
     std::vector<Texture> textures_loaded;
     std::vector<Mesh> meshes;
     std::string directory;
     bool gammaCorrection;
 
+    static ImportSettings importSettings;
+    static LodSettings lodSettings;
+    static TextureAtlasSettings atlasSettings;
+    static CpuGeometryPolicy defaultGeometryPolicy;
+
+    // Taken from defaultGeometryPolicy when the model is created
+    CpuGeometryPolicy geometryPolicy = defaultGeometryPolicy;
+
     // Constructor for loading model from file
     Model(const std::string &path, bool gamma = false);
     
     // Constructor for creating a default cube
     Model();
 
+    // Constructor from already imported mesh data; only creates the GL buffers. sourcePath and the
+    // mesh cache key it was imported with let cpuGeometry() reload released geometry from the cache.
+    Model(std::vector<MeshData> &&meshData, const std::string &directory, const std::string &sourcePath = "",
+          uint64_t cacheKey = 0);
+
+    // Reads and processes a model file without touching GL, so it can run on a worker thread.
+    // Returns false if the import failed or was cancelled through progress. cacheKey receives the
+    // mesh cache key of the import settings used.
+    static bool importMeshes(const std::string &path, std::vector<MeshData> &meshData, LoadProgress *progress = nullptr,
+                             uint64_t *cacheKey = nullptr);
+
+    // Times the native reader for path against the Assimp read and weld it replaces, bypassing
+    // the mesh cache, and prints both
+    static void compareReaders(const std::string &path);
+
     // Draws the model, and thus all its meshes
     void Draw(Shader &shader);
 
+    // Draws every mesh from its position-only stream, for shaders that read nothing but aPos
+    void DrawPositions(Shader &shader);
+
+    // Draws every mesh at the LOD that suits the model's projected size, and only the meshlets that
+    // survive culling against view; culling stats add up in view. Each mesh uses the variant of style
+    // that matches whether it is textured, made current as needed.
+    void Draw(ShaderVariants &style, ShaderQuality quality, ClusterView &view, const Camera &camera,
+              const Transform &transform, float viewportHeight);
+
+    // True while the simplified LODs are still being built; LOD0 is drawn until then
+    bool lodsPending() const { return lodBuild != nullptr; }
+    // Drops the simplified LODs and builds them again from cpuGeometry() with the current
+    // lodSettings. False when the geometry cannot be brought back.
+    bool rebuildLods();
+    unsigned int lodCount() const;
+    // Coarsest LOD picked by the last Draw
+    unsigned int drawnLod() const { return lastLod; }
+
+    // True while the diffuse textures are being packed into the model's texture array
+    bool atlasPending() const { return atlasBuild != nullptr; }
+    // Layers of the texture array the model draws with; 0 when it binds per-mesh textures
+    int atlasLayers() const { return atlasTexture ? atlasLayerCount : 0; }
+
+    // The imported geometry, for picking, export or rebuilding LODs: the copy still held if there
+    // is one, else a reload from the mesh cache, else a read back from the GPU. Null when none of
+    // these works (glTF stream meshes come back only from their file).
+    std::shared_ptr<const std::vector<MeshData>> cpuGeometry() const;
+
+    // Heap bytes of CPU geometry alive for this model, including a copy the LOD build still holds.
+    // Views into the mapped mesh cache are not counted.
+    size_t cpuGeometryBytes() const;
+    // Bytes of the vertex and index arenas held by the meshes
+    size_t gpuGeometryBytes() const;
+
     void createGrid(float size, int subdivisions);
     void replaceTextures(const std::vector<Texture>& newTextures);
     
 private:
+    // Results of the background LOD build; the build stops early once no Model holds this
+    struct LodBuild {
+        std::atomic<bool> done{false};
+        std::vector<std::vector<LodLevel>> levels;
+    };
+
+    // CPU copy of the imported meshes, shared with the LOD build. Only kept with
+    // CpuGeometryPolicy::Keep; weakGeometry sees it for as long as anything holds it.
+    std::shared_ptr<const std::vector<MeshData>> geometry;
+    std::weak_ptr<const std::vector<MeshData>> weakGeometry;
+    std::string sourcePath;
+    // Mesh cache key of the settings the model was imported with, 0 when not imported from a file
+    uint64_t sourceCacheKey = 0;
+    std::shared_ptr<LodBuild> lodBuild;
+    unsigned int lastLod = 0;
+
+    // Texture array built on the pool; the build stops early once no Model holds this
+    struct AtlasBuild {
+        std::atomic<bool> done{false};
+        bool built = false;
+        TextureAtlasData atlas;
+        // Index into the atlas slots per mesh, -1 for meshes without a diffuse image
+        std::vector<int> meshImages;
+        double milliseconds = 0.0;
+    };
+    std::shared_ptr<AtlasBuild> atlasBuild;
+    std::shared_ptr<GlTexture> atlasTexture;
+    int atlasLayerCount = 0;
+
+    // Bounding sphere of all meshes, in model space
+    glm::vec3 boundsCenter = glm::vec3(0.0f);
+    float boundsRadius = 0.0f;
+
+    // Creates the meshes from imported data and starts building their LODs
+    void setupMeshes(std::vector<MeshData> &&meshData);
+
+    // Simplifies the meshes of source on the pool
+    void startLodBuild(std::shared_ptr<const std::vector<MeshData>> source);
+    // Hands the finished LOD chains to the meshes; called from Draw on the GL thread
+    void pollLodBuild();
+
+    // Packs the first diffuse image of every mesh into a texture array on the pool
+    void startAtlasBuild(const std::vector<MeshData> &meshData);
+    // Uploads a finished texture array and points the meshes at their layers; GL thread
+    void pollAtlasBuild();
+    // Binds the texture array for a draw; false when the meshes bind their own textures
+    bool bindAtlas(Shader &shader);
+
+    void updateBounds();
+
     // Loads a model with supported ASSIMP extensions from file
     void loadModel(const std::string &path);
 
-    // Processes a node in a recursive fashion
-    void processNode(aiNode *node, const aiScene *scene);
+    // Reads a file with Assimp and converts its meshes, without post-processing
+    static bool readWithAssimp(const std::string &path, std::vector<MeshData> &meshData, LoadProgress *progress);
+
+    // Collects the meshes of a node and its children, in depth-first order
+    static void processNode(aiNode *node, const aiScene *scene, std::vector<aiMesh*> &workItems);
+
+    // Number of threads to process meshes on, from importSettings
+    static unsigned int importThreadCount();
+
+    // Process an individual mesh. Material textures are decoded through the TextureCache, relative
+    // to directory; embedded holds the scene's embedded textures, decoded once per import.
+    static MeshData processMesh(aiMesh *mesh, const aiScene *scene, const std::string &directory,
+                                const std::vector<MaterialImage> &embedded);
+
+    // Decodes the textures of one material slot, for the GL thread to turn into textures
+    static std::vector<MaterialImage> loadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName,
+                                                           const aiScene *scene, const std::string &directory,
+                                                           const std::vector<MaterialImage> &embedded);
 
-    // Process an individual mesh
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene);
+    // Decodes the embedded textures of a scene
+    static std::vector<MaterialImage> decodeEmbeddedTextures(const aiScene *scene);
 
-    // Loads material textures
-    std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName);
+    // Decodes the material images of meshes read from the mesh cache, which stores only their paths
+    static void decodeMaterialImages(std::vector<MeshData> &meshData);
     
     // Creates a default cube for testing
     void createCube();
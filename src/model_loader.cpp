@@ -0,0 +1,89 @@
+#include "model_loader.h"
+#include "geometry_pool.h"
+#include "texture_cache.h"
+
+#include <chrono>
+
+ModelLoader::~ModelLoader() {
+    shutdown();
+}
+
+void ModelLoader::start(const std::string& path) {
+    cancel();
+    reapRetired(false);
+
+    currentPath = path;
+    loading = true;
+    job = std::make_shared<Job>();
+
+    std::shared_ptr<Job> state = job;
+    worker = std::thread([state, path]() {
+        auto startTime = std::chrono::steady_clock::now();
+        state->succeeded = Model::importMeshes(path, state->meshData, &state->progress, &state->cacheKey);
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - startTime;
+        if (state->succeeded)
+            std::cout << "Model imported in " << elapsed.count() << " ms: " << path << std::endl;
+        state->done = true;
+    });
+}
+
+void ModelLoader::cancel() {
+    if (job) {
+        job->progress.cancelled = true;
+        retired.push_back({std::move(job), std::move(worker)});
+    }
+    loading = false;
+}
+
+void ModelLoader::shutdown() {
+    cancel();
+    reapRetired(true);
+}
+
+bool ModelLoader::isReady() const {
+    return loading && job && job->done;
+}
+
+float ModelLoader::progress() const {
+    return job ? job->progress.value.load() : 0.0f;
+}
+
+bool ModelLoader::finish(Model& model) {
+    if (!isReady())
+        return false;
+
+    worker.join();
+    std::shared_ptr<Job> finished = std::move(job);
+    loading = false;
+    reapRetired(false);
+    if (!finished->succeeded) {
+        std::cerr << "Failed to load model: " << currentPath << std::endl;
+        return false;
+    }
+
+    // GL stage: create the buffers for every mesh on this thread
+    std::string directory = currentPath.substr(0, currentPath.find_last_of('/'));
+    model = Model(std::move(finished->meshData), directory, currentPath, finished->cacheKey);
+    std::cout << "Model loaded successfully: " << currentPath << std::endl;
+    std::cout << "Geometry: " << model.gpuGeometryBytes() / 1024 << " KB on GPU, "
+              << model.cpuGeometryBytes() / 1024 << " KB on CPU" << std::endl;
+
+    // The previous model's arena ranges are free now
+    GeometryPool::shared().defragmentIfNeeded();
+    GeometryPool::shared().report();
+    TextureCache::shared().report();
+    GlResourceRegistry::shared().report();
+    return true;
+}
+
+void ModelLoader::reapRetired(bool wait) {
+    for (auto it = retired.begin(); it != retired.end();) {
+        if (wait || it->job->done) {
+            it->thread.join();
+            it = retired.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
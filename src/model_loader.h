@@ -0,0 +1,70 @@
+#ifndef MODEL_LOADER_H
+#define MODEL_LOADER_H
+
+#include "model.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Loads a model without blocking the render loop. Parsing and mesh processing run on a worker
+// thread; only the GL buffer creation in finish() runs on the calling (GL) thread, so the current
+// model keeps rendering until the new one is ready to be swapped in.
+class ModelLoader {
+public:
+    ModelLoader() = default;
+    ~ModelLoader();
+
+    ModelLoader(const ModelLoader&) = delete;
+    ModelLoader& operator=(const ModelLoader&) = delete;
+
+    // Starts loading path in the background, cancelling any load already in flight
+    void start(const std::string& path);
+
+    // Requests the current load to stop without waiting for the worker to reach its next checkpoint
+    void cancel();
+    // Cancels the current load and waits for every worker to exit. Called before the thread pool
+    // the workers use is torn down.
+    void shutdown();
+
+    // True from start() until finish() or cancel()
+    bool isLoading() const { return loading; }
+
+    // True once the worker is done and finish() can be called
+    bool isReady() const;
+
+    float progress() const;
+    const std::string& path() const { return currentPath; }
+
+    // Uploads the loaded meshes and moves them into model. Returns false if the load failed or
+    // was cancelled, in which case model is left untouched.
+    bool finish(Model& model);
+
+private:
+    // State shared with the worker, which may outlive a cancelled load briefly
+    struct Job {
+        LoadProgress progress;
+        std::atomic<bool> done{false};
+        bool succeeded = false;
+        std::vector<MeshData> meshData;
+        uint64_t cacheKey = 0;
+    };
+
+    // A cancelled worker that has not reached a checkpoint yet; joined once it is done
+    struct RetiredWorker {
+        std::shared_ptr<Job> job;
+        std::thread thread;
+    };
+
+    std::shared_ptr<Job> job;
+    std::thread worker;
+    std::vector<RetiredWorker> retired;
+    std::string currentPath;
+    bool loading = false;
+
+    // Joins retired workers; blocks on all of them when wait is set
+    void reapRetired(bool wait);
+};
+#endif
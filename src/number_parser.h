@@ -0,0 +1,115 @@
+#ifndef NUMBER_PARSER_H
+#define NUMBER_PARSER_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+// Number parsing for text mesh formats. Unlike strtod these stop at the end of the buffer instead of
+// needing a terminating zero, and ordinary numbers never touch the locale or allocate.
+
+inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char* skipBlanks(const char* p, const char* end) {
+    while (p < end && isBlank(*p))
+        p++;
+    return p;
+}
+
+inline const char* skipLine(const char* p, const char* end) {
+    while (p < end && *p != '\n')
+        p++;
+    return p < end ? p + 1 : end;
+}
+
+// Parses a decimal integer with an optional sign. Returns p unchanged when there is no number.
+inline const char* parseInt(const char* p, const char* end, long long& value) {
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    long long result = 0;
+    const char* digits = p;
+    while (p < end && *p >= '0' && *p <= '9')
+        result = result * 10 + (*p++ - '0');
+    if (p == digits)
+        return start;
+    value = negative ? -result : result;
+    return p;
+}
+
+// Parses a float such as "-1.25e-3". Up to 19 significant digits with a small exponent take the
+// exact fast path; anything else falls back to strtod on a bounded copy. Returns p unchanged when
+// there is no number.
+inline const char* parseFloat(const char* p, const char* end, float& value) {
+    static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any = false;
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+            digits += mantissa != 0;
+        } else {
+            exponent++;
+        }
+        p++;
+        any = true;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
+            p++;
+            any = true;
+        }
+    }
+    if (!any) {
+        // inf, nan and other rarities
+        char buffer[64];
+        size_t length = 0;
+        for (const char* q = start; q < end && length + 1 < sizeof(buffer) && !isBlank(*q) && *q != '\n' && *q != '/';)
+            buffer[length++] = *q++;
+        buffer[length] = '\0';
+        char* parsedEnd = nullptr;
+        double parsed = std::strtod(buffer, &parsedEnd);
+        if (parsedEnd == buffer)
+            return start;
+        value = static_cast<float>(parsed);
+        return start + (parsedEnd - buffer);
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        long long e = 0;
+        const char* after = parseInt(p + 1, end, e);
+        if (after != p + 1) {
+            exponent += static_cast<int>(e < -400 ? -400 : e > 400 ? 400 : e);
+            p = after;
+        }
+    }
+
+    if (exponent < -22 || exponent > 22 || mantissa >= (uint64_t(1) << 53)) {
+        std::string text(start, p);
+        value = static_cast<float>(std::strtod(text.c_str(), nullptr));
+        return p;
+    }
+    double result = exponent < 0 ? static_cast<double>(mantissa) / powers[-exponent]
+                                 : static_cast<double>(mantissa) * powers[exponent];
+    value = static_cast<float>(negative ? -result : result);
+    return p;
+}
+
+#endif
@@ -0,0 +1,488 @@
+#include "obj_loader.h"
+#include "mapped_file.h"
+#include "mesh_optimizer.h"
+#include "model.h"
+#include "number_parser.h"
+#include "texture_cache.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+namespace fs = std::filesystem;
+
+namespace {
+
+// Target chunk size; chunks end on line boundaries
+const size_t OBJ_CHUNK_SIZE = 1 << 20;
+
+// Share of the progress bar taken by parsing, the rest is building the meshes
+const float OBJ_PARSE_PROGRESS = 0.7f;
+
+// A face corner as 0-based absolute indices; -1 when the file gives none
+struct Corner {
+    int position;
+    int texCoord;
+    int normal;
+};
+
+struct ObjChunk {
+    const char* begin;
+    const char* end;
+
+    // Counted in the first pass, so the second can write straight into the shared arrays
+    size_t positionCount = 0;
+    size_t texCoordCount = 0;
+    size_t normalCount = 0;
+    size_t positionBase = 0;
+    size_t texCoordBase = 0;
+    size_t normalBase = 0;
+
+    // Triangles, three corners each
+    std::vector<Corner> corners;
+    // Corner offsets where an object, group or material statement starts a new mesh
+    std::vector<size_t> meshBreaks;
+    // usemtl statements: the corner offset they apply from and the material name
+    std::vector<std::pair<size_t, std::string>> materialUses;
+    // mtllib statements, as written
+    std::vector<std::string> materialLibraries;
+    size_t badFaces = 0;
+};
+
+// Texture maps of one .mtl material, with their MaterialImage type and file as written
+struct ObjMaterial {
+    std::vector<std::pair<std::string, std::string>> maps;
+};
+
+// A run of corners belonging to one mesh
+struct CornerSpan {
+    const ObjChunk* chunk;
+    size_t begin;
+    size_t end;
+};
+
+bool startsWithKeyword(const char* p, const char* end, const char* keyword) {
+    size_t length = strlen(keyword);
+    return static_cast<size_t>(end - p) > length && memcmp(p, keyword, length) == 0 && isBlank(p[length]);
+}
+
+// The rest of a line without surrounding blanks
+std::string restOfLine(const char* p, const char* end) {
+    p = skipBlanks(p, end);
+    const char* last = p;
+    while (last < end && *last != '\n')
+        last++;
+    while (last > p && isBlank(last[-1]))
+        last--;
+    return std::string(p, last);
+}
+
+void countElements(ObjChunk& chunk) {
+    for (const char* p = chunk.begin; p < chunk.end; p = skipLine(p, chunk.end)) {
+        p = skipBlanks(p, chunk.end);
+        if (chunk.end - p < 2 || p[0] != 'v')
+            continue;
+        if (isBlank(p[1]))
+            chunk.positionCount++;
+        else if (p[1] == 't' && chunk.end - p > 2 && isBlank(p[2]))
+            chunk.texCoordCount++;
+        else if (p[1] == 'n' && chunk.end - p > 2 && isBlank(p[2]))
+            chunk.normalCount++;
+    }
+}
+
+// OBJ indices are 1-based, or relative to the elements read so far when negative. Invalid ones give -2.
+int resolveIndex(long long index, size_t readSoFar, size_t total) {
+    if (index == 0)
+        return -2;
+    long long resolved = index > 0 ? index - 1 : static_cast<long long>(readSoFar) + index;
+    return resolved >= 0 && resolved < static_cast<long long>(total) ? static_cast<int>(resolved) : -2;
+}
+
+void parseChunk(ObjChunk& chunk, std::vector<glm::vec3>& positions, std::vector<glm::vec2>& texCoords,
+                std::vector<glm::vec3>& normals) {
+    const char* end = chunk.end;
+    size_t positionIndex = chunk.positionBase;
+    size_t texCoordIndex = chunk.texCoordBase;
+    size_t normalIndex = chunk.normalBase;
+    std::vector<Corner> face;
+
+    for (const char* p = chunk.begin; p < end; p = skipLine(p, end)) {
+        p = skipBlanks(p, end);
+        if (p >= end || *p == '\n' || *p == '#')
+            continue;
+
+        if (startsWithKeyword(p, end, "v")) {
+            glm::vec3& v = positions[positionIndex++];
+            p = skipBlanks(parseFloat(skipBlanks(p + 1, end), end, v.x), end);
+            p = skipBlanks(parseFloat(p, end, v.y), end);
+            parseFloat(p, end, v.z);
+        } else if (startsWithKeyword(p, end, "vt")) {
+            glm::vec2& uv = texCoords[texCoordIndex++];
+            p = skipBlanks(parseFloat(skipBlanks(p + 2, end), end, uv.x), end);
+            parseFloat(p, end, uv.y);
+        } else if (startsWithKeyword(p, end, "vn")) {
+            glm::vec3& n = normals[normalIndex++];
+            p = skipBlanks(parseFloat(skipBlanks(p + 2, end), end, n.x), end);
+            p = skipBlanks(parseFloat(p, end, n.y), end);
+            parseFloat(p, end, n.z);
+        } else if (startsWithKeyword(p, end, "f")) {
+            face.clear();
+            bool valid = true;
+            p = skipBlanks(p + 1, end);
+            while (p < end && *p != '\n') {
+                long long index = 0;
+                const char* next = parseInt(p, end, index);
+                if (next == p)
+                    break;
+                Corner corner = {resolveIndex(index, positionIndex, positions.size()), -1, -1};
+                p = next;
+                if (p < end && *p == '/') {
+                    next = parseInt(++p, end, index);
+                    if (next != p)
+                        corner.texCoord = resolveIndex(index, texCoordIndex, texCoords.size());
+                    p = next;
+                    if (p < end && *p == '/') {
+                        next = parseInt(++p, end, index);
+                        if (next != p)
+                            corner.normal = resolveIndex(index, normalIndex, normals.size());
+                        p = next;
+                    }
+                }
+                valid = valid && corner.position >= 0 && corner.texCoord != -2 && corner.normal != -2;
+                face.push_back(corner);
+                p = skipBlanks(p, end);
+            }
+            if (!valid || face.size() < 3) {
+                chunk.badFaces++;
+                continue;
+            }
+            // Fan triangulation, like aiProcess_Triangulate does for convex polygons
+            for (size_t i = 1; i + 1 < face.size(); i++) {
+                chunk.corners.push_back(face[0]);
+                chunk.corners.push_back(face[i]);
+                chunk.corners.push_back(face[i + 1]);
+            }
+        } else if (startsWithKeyword(p, end, "usemtl")) {
+            chunk.meshBreaks.push_back(chunk.corners.size());
+            chunk.materialUses.emplace_back(chunk.corners.size(), restOfLine(p + 6, end));
+        } else if (startsWithKeyword(p, end, "o") || startsWithKeyword(p, end, "g")) {
+            chunk.meshBreaks.push_back(chunk.corners.size());
+        } else if (startsWithKeyword(p, end, "mtllib")) {
+            chunk.materialLibraries.push_back(restOfLine(p + 6, end));
+        }
+    }
+}
+
+// Scratch space indexed by position, shared by the meshes of one file
+struct BuildScratch {
+    // First vertex created for a position, then chained through nextVertex
+    std::vector<int> firstVertex;
+    std::vector<int> nextVertex;
+    std::vector<glm::vec3> smoothNormals;
+};
+
+MeshData buildMesh(const std::vector<CornerSpan>& spans, const std::vector<glm::vec3>& positions,
+                   const std::vector<glm::vec2>& texCoords, const std::vector<glm::vec3>& normals,
+                   BuildScratch& scratch, unsigned int threads) {
+    MeshData data;
+    std::vector<unsigned int>& indices = data.indices;
+    std::vector<Corner> unique;
+    bool hasTexCoords = false;
+    bool hasNormals = true;
+
+    size_t cornerCount = 0;
+    for (const CornerSpan& span : spans)
+        cornerCount += span.end - span.begin;
+    indices.reserve(cornerCount);
+
+    // Share a vertex between corners with identical indices
+    scratch.nextVertex.clear();
+    for (const CornerSpan& span : spans) {
+        for (size_t i = span.begin; i < span.end; i++) {
+            const Corner& c = span.chunk->corners[i];
+            hasTexCoords = hasTexCoords || c.texCoord >= 0;
+            hasNormals = hasNormals && c.normal >= 0;
+
+            int vertex = scratch.firstVertex[c.position];
+            while (vertex >= 0 && (unique[vertex].texCoord != c.texCoord || unique[vertex].normal != c.normal))
+                vertex = scratch.nextVertex[vertex];
+            if (vertex < 0) {
+                vertex = static_cast<int>(unique.size());
+                unique.push_back(c);
+                scratch.nextVertex.push_back(scratch.firstVertex[c.position]);
+                scratch.firstVertex[c.position] = vertex;
+            }
+            indices.push_back(static_cast<unsigned int>(vertex));
+        }
+    }
+    for (const Corner& c : unique)
+        scratch.firstVertex[c.position] = -1;
+
+    // Without normals in the file, average the face normals around each position
+    if (!hasNormals) {
+        for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+            int a = unique[indices[t]].position, b = unique[indices[t + 1]].position, c = unique[indices[t + 2]].position;
+            glm::vec3 n = glm::cross(positions[b] - positions[a], positions[c] - positions[a]);
+            scratch.smoothNormals[a] += n;
+            scratch.smoothNormals[b] += n;
+            scratch.smoothNormals[c] += n;
+        }
+    }
+
+    std::vector<Vertex>& vertices = data.vertices;
+    vertices.resize(unique.size());
+    ThreadPool::shared().parallelFor(unique.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const Corner& c = unique[i];
+            Vertex& v = vertices[i];
+            v.Position = positions[c.position];
+            if (hasNormals) {
+                v.Normal = normals[c.normal];
+            } else {
+                float length = glm::length(scratch.smoothNormals[c.position]);
+                v.Normal = length > 0.0f ? scratch.smoothNormals[c.position] / length : glm::vec3(0.0f);
+            }
+            // Flipped like aiProcess_FlipUVs
+            v.TexCoords = glm::vec2(0.0f);
+            if (c.texCoord >= 0)
+                v.TexCoords = glm::vec2(texCoords[c.texCoord].x, 1.0f - texCoords[c.texCoord].y);
+            v.Tangent = glm::vec3(0.0f);
+            v.Bitangent = glm::vec3(0.0f);
+        }
+    }, 16384, threads);
+
+    if (!hasNormals) {
+        for (const Corner& c : unique)
+            scratch.smoothNormals[c.position] = glm::vec3(0.0f);
+    }
+    if (hasTexCoords)
+        computeTangents(vertices, indices);
+    return data;
+}
+
+const char* tokenEnd(const char* p, const char* end) {
+    while (p < end && !isBlank(*p) && *p != '\n')
+        p++;
+    return p;
+}
+
+// Numbers, on/off and channel letters follow texture map options
+bool isOptionArgument(const char* p, const char* end) {
+    float value;
+    std::string token(p, end);
+    return parseFloat(p, end, value) == end || token == "on" || token == "off" || token.size() == 1;
+}
+
+// Reads the texture maps of every material in a .mtl file, typed the way Assimp maps them:
+// map_Kd diffuse, map_Ks specular, map_Bump normal and map_Ka height. False when it cannot be read.
+bool readMaterialLibrary(const std::string& path, std::map<std::string, ObjMaterial>& materials) {
+    static const std::pair<const char*, const char*> keywords[] = {
+        {"map_Kd", "texture_diffuse"}, {"map_Ks", "texture_specular"}, {"map_Bump", "texture_normal"},
+        {"map_bump", "texture_normal"}, {"bump", "texture_normal"},   {"map_Ka", "texture_height"}};
+
+    std::ifstream file(path);
+    if (!file)
+        return false;
+    ObjMaterial* material = nullptr;
+    std::string line;
+    while (std::getline(file, line)) {
+        const char* end = line.data() + line.size();
+        const char* p = skipBlanks(line.data(), end);
+        if (startsWithKeyword(p, end, "newmtl")) {
+            material = &materials[restOfLine(p + 6, end)];
+            continue;
+        }
+        if (!material)
+            continue;
+        for (const std::pair<const char*, const char*>& keyword : keywords) {
+            if (!startsWithKeyword(p, end, keyword.first))
+                continue;
+            // Options such as "-bm 0.5" or "-clamp on" come before the file name
+            p = skipBlanks(p + strlen(keyword.first), end);
+            while (p < end && *p == '-') {
+                p = skipBlanks(tokenEnd(p, end), end);
+                while (p < end && isOptionArgument(p, tokenEnd(p, end)))
+                    p = skipBlanks(tokenEnd(p, end), end);
+            }
+            std::string texture = restOfLine(p, end);
+            if (!texture.empty())
+                material->maps.emplace_back(keyword.second, texture);
+            break;
+        }
+    }
+    return true;
+}
+
+// Decodes the maps of the materials the meshes use through the TextureCache, like processMesh does
+// for Assimp materials, and hands each mesh the images of its material
+void loadMaterials(const std::string& path, const std::vector<ObjChunk>& chunks,
+                   const std::vector<std::string>& meshMaterials, std::vector<MeshData>& meshes, unsigned int threads) {
+    fs::path directory = fs::path(path).parent_path();
+    std::map<std::string, ObjMaterial> materials;
+    std::vector<std::string> libraries;
+    for (const ObjChunk& chunk : chunks) {
+        for (const std::string& library : chunk.materialLibraries) {
+            if (std::find(libraries.begin(), libraries.end(), library) != libraries.end())
+                continue;
+            libraries.push_back(library);
+            if (!readMaterialLibrary((directory / library).string(), materials))
+                std::cout << "WARNING::OBJ::CANNOT_READ_MATERIALS: " << (directory / library).string() << std::endl;
+        }
+    }
+    if (materials.empty())
+        return;
+
+    // Each used material decodes once, and its images are shared by every mesh using it
+    std::vector<std::string> used;
+    for (const std::string& name : meshMaterials) {
+        if (!name.empty() && materials.count(name) && std::find(used.begin(), used.end(), name) == used.end())
+            used.push_back(name);
+    }
+    std::vector<std::vector<MaterialImage>> decoded(used.size());
+    ThreadPool::shared().parallelFor(used.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            for (const std::pair<std::string, std::string>& map : materials[used[i]].maps) {
+                // Diffuse maps hold sRGB color; the other maps hold data
+                TextureDecodeParams params;
+                params.srgb = map.first == "texture_diffuse";
+                fs::path file(map.second);
+                std::string texturePath = file.is_absolute() ? map.second : (directory / file).string();
+                MaterialImage image;
+                if (!TextureCache::shared().decode(texturePath, params, image))
+                    continue;
+                image.type = map.first;
+                decoded[i].push_back(image);
+            }
+        }
+    }, 1, threads);
+
+    for (size_t i = 0; i < meshes.size() && i < meshMaterials.size(); i++) {
+        auto found = std::find(used.begin(), used.end(), meshMaterials[i]);
+        if (found != used.end())
+            meshes[i].materialImages = decoded[found - used.begin()];
+    }
+}
+
+} // namespace
+
+bool loadObj(const std::string& path, std::vector<MeshData>& meshes, unsigned int threads, LoadProgress* progress,
+             float progressScale) {
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cout << "ERROR::OBJ::CANNOT_OPEN_FILE: " << path << std::endl;
+        return false;
+    }
+    const char* text = reinterpret_cast<const char*>(file.data());
+    const char* textEnd = text + file.size();
+
+    // Split on line boundaries
+    std::vector<ObjChunk> chunks;
+    for (const char* p = text; p < textEnd;) {
+        const char* end = p + std::min(OBJ_CHUNK_SIZE, static_cast<size_t>(textEnd - p));
+        end = end < textEnd ? skipLine(end, textEnd) : textEnd;
+        ObjChunk chunk;
+        chunk.begin = p;
+        chunk.end = end;
+        chunks.push_back(std::move(chunk));
+        p = end;
+    }
+
+    ThreadPool& pool = ThreadPool::shared();
+    pool.parallelFor(chunks.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            countElements(chunks[i]);
+    }, 1, threads);
+
+    size_t positionCount = 0, texCoordCount = 0, normalCount = 0;
+    for (ObjChunk& chunk : chunks) {
+        chunk.positionBase = positionCount;
+        chunk.texCoordBase = texCoordCount;
+        chunk.normalBase = normalCount;
+        positionCount += chunk.positionCount;
+        texCoordCount += chunk.texCoordCount;
+        normalCount += chunk.normalCount;
+    }
+
+    std::vector<glm::vec3> positions(positionCount);
+    std::vector<glm::vec2> texCoords(texCoordCount);
+    std::vector<glm::vec3> normals(normalCount);
+    std::atomic<size_t> parsed{0};
+    pool.parallelFor(chunks.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            if (progress && progress->cancelled)
+                return;
+            parseChunk(chunks[i], positions, texCoords, normals);
+            if (progress)
+                progress->value = progressScale * OBJ_PARSE_PROGRESS * static_cast<float>(++parsed) /
+                                  static_cast<float>(chunks.size());
+        }
+    }, 1, threads);
+    if (progress && progress->cancelled)
+        return false;
+
+    // Stitch the chunks back together into meshes, each with the material in use where it starts
+    std::vector<std::vector<CornerSpan>> meshSpans(1);
+    std::vector<std::string> meshMaterials(1);
+    std::string material;
+    size_t badFaces = 0;
+    for (const ObjChunk& chunk : chunks) {
+        badFaces += chunk.badFaces;
+        size_t use = 0;
+        auto addSpan = [&](size_t begin, size_t end) {
+            while (use < chunk.materialUses.size() && chunk.materialUses[use].first <= begin)
+                material = chunk.materialUses[use++].second;
+            if (meshSpans.back().empty())
+                meshMaterials.back() = material;
+            meshSpans.back().push_back({&chunk, begin, end});
+        };
+        size_t begin = 0;
+        for (size_t meshBreak : chunk.meshBreaks) {
+            if (meshBreak > begin)
+                addSpan(begin, meshBreak);
+            begin = meshBreak;
+            if (!meshSpans.back().empty()) {
+                meshSpans.emplace_back();
+                meshMaterials.emplace_back();
+            }
+        }
+        if (chunk.corners.size() > begin)
+            addSpan(begin, chunk.corners.size());
+        // Statements after the chunk's last face carry over to the next chunk
+        for (; use < chunk.materialUses.size(); use++)
+            material = chunk.materialUses[use].second;
+    }
+    if (meshSpans.back().empty()) {
+        meshSpans.pop_back();
+        meshMaterials.pop_back();
+    }
+    if (badFaces > 0)
+        std::cout << "WARNING::OBJ::INVALID_FACES: " << badFaces << " faces skipped in " << path << std::endl;
+    if (meshSpans.empty()) {
+        std::cout << "ERROR::OBJ::NO_FACES: " << path << std::endl;
+        return false;
+    }
+
+    BuildScratch scratch;
+    scratch.firstVertex.assign(positionCount, -1);
+    scratch.smoothNormals.assign(positionCount, glm::vec3(0.0f));
+    std::vector<MeshData> built;
+    built.reserve(meshSpans.size());
+    for (size_t i = 0; i < meshSpans.size(); i++) {
+        if (progress && progress->cancelled)
+            return false;
+        built.push_back(buildMesh(meshSpans[i], positions, texCoords, normals, scratch, threads));
+        if (progress) {
+            float done = static_cast<float>(i + 1) / static_cast<float>(meshSpans.size());
+            progress->value = progressScale * (OBJ_PARSE_PROGRESS + (1.0f - OBJ_PARSE_PROGRESS) * done);
+        }
+    }
+
+    loadMaterials(path, chunks, meshMaterials, built, threads);
+    meshes = std::move(built);
+    return true;
+}
@@ -0,0 +1,21 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include "mesh.h"
+
+#include <string>
+#include <vector>
+
+struct LoadProgress;
+
+// Reads Wavefront OBJ files without Assimp. The file is memory-mapped and parsed in chunks on up to
+// `threads` pool threads. Meshes come out the way processMesh produces them with MODEL_IMPORT_FLAGS:
+// triangulated, V flipped, smooth normals and tangents generated where the file has none. Corners
+// with the same position/UV/normal indices share a vertex, and a new mesh starts at every object,
+// group or material statement. The texture maps of the materials in the file's mtllib are decoded
+// through the TextureCache into each mesh's materialImages. Progress goes up to progressScale.
+// Returns false if the file cannot be read or the load was cancelled.
+bool loadObj(const std::string& path, std::vector<MeshData>& meshes, unsigned int threads = 0,
+             LoadProgress* progress = nullptr, float progressScale = 1.0f);
+
+#endif
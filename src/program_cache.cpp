@@ -0,0 +1,161 @@
+#include "program_cache.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+namespace fs = std::filesystem;
+
+namespace {
+
+const uint32_t PROGRAM_CACHE_MAGIC = 0x5052504e; // "NPRP"
+// Bump whenever the layout of a cache file changes
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+const char* PROGRAM_CACHE_EXTENSION = ".pbin";
+// Larger binaries than this are taken to be a corrupt header
+const uint64_t MAX_PROGRAM_BINARY = 64ull * 1024 * 1024;
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format;
+    uint32_t reserved;
+    uint64_t key;
+    uint64_t length;
+};
+
+uint64_t fnv1a(const std::string &text, uint64_t hash = 14695981039346656037ull) {
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string glString(GLenum name) {
+    const GLubyte* value = glGetString(name);
+    return value ? reinterpret_cast<const char*>(value) : "";
+}
+
+} // namespace
+
+ProgramCache& ProgramCache::shared() {
+    static ProgramCache cache;
+    return cache;
+}
+
+bool ProgramCache::supported() {
+    if (binaryFormats < 0) {
+        binaryFormats = 0;
+        if (GLEW_ARB_get_program_binary)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+    }
+    return binaryFormats > 0;
+}
+
+uint64_t ProgramCache::key(const std::string &vertexSource, const std::string &fragmentSource) {
+    if (driver.empty())
+        driver = glString(GL_VENDOR) + '\n' + glString(GL_RENDERER) + '\n' + glString(GL_VERSION);
+    uint64_t hash = fnv1a(driver + '\n' + std::to_string(PROGRAM_CACHE_VERSION) + '\n');
+    hash = fnv1a(vertexSource, hash);
+    // Keeps a vertex source ending where a fragment source begins apart from other splits
+    hash = fnv1a(std::string(1, '\0'), hash);
+    return fnv1a(fragmentSource, hash);
+}
+
+std::string ProgramCache::entryPath(uint64_t key) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+    return (fs::path(directory) / (std::string(name) + PROGRAM_CACHE_EXTENSION)).string();
+}
+
+bool ProgramCache::load(uint64_t key, GLuint program) {
+    if (!enabled || !supported())
+        return false;
+    std::string path = entryPath(key);
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    std::error_code ec;
+    uint64_t fileSize = fs::file_size(path, ec);
+
+    // The length comes from disk, so it must match what the file holds before anything is allocated
+    CacheHeader header = {};
+    std::vector<char> binary;
+    bool valid = !ec && in.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+                 header.magic == PROGRAM_CACHE_MAGIC && header.version == PROGRAM_CACHE_VERSION && header.key == key &&
+                 header.length > 0 && header.length <= MAX_PROGRAM_BINARY &&
+                 header.length == fileSize - sizeof(header);
+    if (valid) {
+        binary.resize(header.length);
+        valid = static_cast<bool>(in.read(binary.data(), static_cast<std::streamsize>(binary.size())));
+    }
+    in.close();
+
+    GLint linked = GL_FALSE;
+    if (valid) {
+        glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    }
+    if (linked != GL_TRUE) {
+        cacheStats.invalid++;
+        fs::remove(path, ec);
+        return false;
+    }
+    return true;
+}
+
+bool ProgramCache::store(uint64_t key, GLuint program) {
+    if (!enabled || !supported())
+        return false;
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return false;
+    std::vector<char> binary(static_cast<size_t>(length));
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, binary.data());
+    if (written <= 0)
+        return false;
+
+    std::error_code ec;
+    fs::create_directories(directory, ec);
+    if (ec) {
+        std::cout << "ERROR::PROGRAM_CACHE::CANNOT_CREATE_DIRECTORY: " << directory << std::endl;
+        return false;
+    }
+
+    CacheHeader header = {};
+    header.magic = PROGRAM_CACHE_MAGIC;
+    header.version = PROGRAM_CACHE_VERSION;
+    header.format = format;
+    header.key = key;
+    header.length = static_cast<uint64_t>(written);
+
+    // Written under a temporary name, so a crash never leaves a truncated entry behind
+    std::string path = entryPath(key);
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(binary.data(), written);
+        if (!out) {
+            std::cout << "ERROR::PROGRAM_CACHE::WRITE_FAILED: " << temporary << std::endl;
+            return false;
+        }
+    }
+    fs::rename(temporary, path, ec);
+    return !ec;
+}
+
+void ProgramCache::recordCached(double milliseconds) {
+    cacheStats.cached++;
+    cacheStats.cachedMilliseconds += milliseconds;
+}
+
+void ProgramCache::recordCompiled(double milliseconds) {
+    cacheStats.compiled++;
+    cacheStats.compiledMilliseconds += milliseconds;
+}
@@ -0,0 +1,57 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <string>
+
+struct ProgramCacheStats {
+    // Programs loaded from a binary, and the time spent loading them
+    unsigned int cached = 0;
+    double cachedMilliseconds = 0.0;
+    // Programs compiled from source, and the time from issuing each compile to its program being
+    // ready; compiles in flight together overlap
+    unsigned int compiled = 0;
+    double compiledMilliseconds = 0.0;
+    // Binaries found but rejected, e.g. after a driver update
+    unsigned int invalid = 0;
+};
+
+// On-disk cache of linked programs as driver binaries (glGetProgramBinary), so later runs skip
+// compiling. Entries are keyed by a hash of the preprocessed sources, which hold the permutation
+// defines, and of the driver's vendor, renderer and version. GL thread only.
+class ProgramCache {
+public:
+    static ProgramCache& shared();
+
+    bool enabled = true;
+    void setDirectory(const std::string &dir) { directory = dir; }
+
+    // False when the driver cannot hand out program binaries
+    bool supported();
+
+    uint64_t key(const std::string &vertexSource, const std::string &fragmentSource);
+
+    // Loads the binary stored under key into program, which is then linked. False on a miss, or
+    // when the driver rejects the binary; the entry is then deleted.
+    bool load(uint64_t key, GLuint program);
+    // Writes the binary of a linked program under key
+    bool store(uint64_t key, GLuint program);
+
+    void recordCached(double milliseconds);
+    void recordCompiled(double milliseconds);
+    ProgramCacheStats stats() const { return cacheStats; }
+
+private:
+    std::string directory = "../cache/programs";
+    // Vendor, renderer and version, queried on first use
+    std::string driver;
+    int binaryFormats = -1;
+    ProgramCacheStats cacheStats;
+
+    ProgramCache() = default;
+    std::string entryPath(uint64_t key) const;
+};
+
+#endif
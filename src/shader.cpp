@@ -1,64 +1,349 @@
 // shader.cpp
 #include "shader.h"
+#include "program_cache.h"
+#include "uniform_ring.h"
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath) {
-    // 1. Retrieve the vertex/fragment source code from filePath
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <unordered_map>
+
+namespace {
+
+// Every uniform name seen, by id
+std::unordered_map<std::string, unsigned int>& uniformNames() {
+    static std::unordered_map<std::string, unsigned int> names;
+    return names;
+}
+
+// Id of a name that was never interned; no program has it active
+UniformId findUniformId(const std::string &name) {
+    const std::unordered_map<std::string, unsigned int>& names = uniformNames();
+    auto found = names.find(name);
+    return found != names.end() ? UniformId{found->second} : UniformId();
+}
+
+size_t uniformSize(GLenum type) {
+    switch (type) {
+    case GL_FLOAT_VEC2: case GL_INT_VEC2: case GL_UNSIGNED_INT_VEC2: case GL_BOOL_VEC2:
+        return 8;
+    case GL_FLOAT_VEC3: case GL_INT_VEC3: case GL_UNSIGNED_INT_VEC3: case GL_BOOL_VEC3:
+        return 12;
+    case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_UNSIGNED_INT_VEC4: case GL_BOOL_VEC4: case GL_FLOAT_MAT2:
+        return 16;
+    case GL_FLOAT_MAT3:
+        return 36;
+    case GL_FLOAT_MAT4:
+        return 64;
+    default:
+        // Scalars and samplers
+        return 4;
+    }
+}
+
+// Appends a shader file to out, replacing each #include "file" (relative to the including file) with
+// that file's text, once per file. #line directives keep line numbers in compile errors pointing at
+// the right file, numbered by its index in files.
+bool expandIncludes(const std::filesystem::path &path, std::vector<std::string> &files, std::string &out) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path.string() << std::endl;
+        return false;
+    }
+    size_t source = files.size();
+    files.push_back(path.lexically_normal().string());
+
+    std::string line;
+    int number = 0;
+    while (std::getline(file, line)) {
+        number++;
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+            out += line;
+            out += '\n';
+            continue;
+        }
+        size_t open = line.find('"', start);
+        size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+        if (close == std::string::npos) {
+            std::cout << "ERROR::SHADER::BAD_INCLUDE: " << path.string() << ":" << number << std::endl;
+            return false;
+        }
+        std::filesystem::path included = (path.parent_path() / line.substr(open + 1, close - open - 1)).lexically_normal();
+        if (std::find(files.begin(), files.end(), included.string()) == files.end()) {
+            out += "#line 1 " + std::to_string(files.size()) + "\n";
+            if (!expandIncludes(included, files, out))
+                return false;
+        }
+        out += "#line " + std::to_string(number + 1) + " " + std::to_string(source) + "\n";
+    }
+    return true;
+}
+
+#ifdef GL_COMPLETION_STATUS_KHR
+const GLenum COMPLETION_STATUS = GL_COMPLETION_STATUS_KHR;
+#else
+// GL_COMPLETION_STATUS_KHR, which GL_COMPLETION_STATUS_ARB equals; GLEW before 2.2 lacks the KHR extension
+const GLenum COMPLETION_STATUS = 0x91B1;
+#endif
+
+double millisecondsSince(std::chrono::steady_clock::time_point startTime) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+// Issues the compile of one stage; its status is checked by checkCompiled once the program is needed
+GLuint compileStage(GLenum type, const std::string &source) {
+    GLuint shader = glCreateShader(type);
+    const char* code = source.c_str();
+    glShaderSource(shader, 1, &code, NULL);
+    glCompileShader(shader);
+    return shader;
+}
+
+// Prints the info log of a stage that failed to compile
+void checkCompiled(GLuint shader, const std::string &path) {
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (compiled == GL_TRUE)
+        return;
+    GLint length = 0;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+    std::string log(static_cast<size_t>(std::max(length, 1)), '\0');
+    glGetShaderInfoLog(shader, static_cast<GLsizei>(log.size()), nullptr, &log[0]);
+    std::cout << "ERROR::SHADER::COMPILATION_FAILED: " << path << "\n" << log.c_str() << std::endl;
+}
+
+// False, with the info log printed, when the program failed to link
+bool checkLinked(GLuint program, const std::string &vertexPath, const std::string &fragmentPath) {
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked == GL_TRUE)
+        return true;
+    GLint length = 0;
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+    std::string log(static_cast<size_t>(std::max(length, 1)), '\0');
+    glGetProgramInfoLog(program, static_cast<GLsizei>(log.size()), nullptr, &log[0]);
+    std::cout << "ERROR::SHADER::PROGRAM_LINKING_FAILED: " << vertexPath << " + " << fragmentPath << "\n"
+              << log.c_str() << std::endl;
+    return false;
+}
+
+} // namespace
+
+bool preprocessShader(const std::string &path, const ShaderDefines &defines, std::string &out) {
+    std::vector<std::string> files;
+    std::string source;
+    out.clear();
+    if (!expandIncludes(path, files, source))
+        return false;
+
+    // Defines go right after #version, which must stay the first line
+    size_t body = 0;
+    if (source.compare(0, 8, "#version") == 0) {
+        body = source.find('\n');
+        body = body == std::string::npos ? source.size() : body + 1;
+    }
+    out = source.substr(0, body);
+    for (const std::pair<std::string, std::string> &define : defines)
+        out += "#define " + define.first + " " + define.second + "\n";
+    if (body > 0)
+        out += "#line 2 0\n";
+    out += source.substr(body);
+    return true;
+}
+
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const ShaderDefines &defines, ShaderBuild build) {
+    // 1. Retrieve the vertex/fragment source code from filePath, with includes expanded and defines added
     std::string vertexCode;
     std::string fragmentCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
-    
-    // Ensure ifstream objects can throw exceptions
-    vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+    preprocessShader(vertexPath, defines, vertexCode);
+    preprocessShader(fragmentPath, defines, fragmentCode);
     
-    try {
-        // Open files
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
-        std::stringstream vShaderStream, fShaderStream;
-        
-        // Read file's buffer contents into streams
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
-        
-        // Close file handlers
-        vShaderFile.close();
-        fShaderFile.close();
-        
-        // Convert stream into string
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
-    }
-    catch (std::ifstream::failure& e) {
-        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+    // 2. Load the linked program from the binary cache, or issue compiling and linking it
+    program = std::make_shared<GlProgram>(GlProgram::create("shader program"));
+    ID = program->id();
+    uniforms = std::make_shared<UniformTable>();
+    ProgramCache &cache = ProgramCache::shared();
+    auto startTime = std::chrono::steady_clock::now();
+    uint64_t cacheKey = cache.key(vertexCode, fragmentCode);
+    cached = cache.load(cacheKey, ID);
+    if (cached) {
+        cache.recordCached(millisecondsSince(startTime));
+        bindUniformBlocks();
+        reflectUniforms();
+        return;
     }
-    
-    const char* vShaderCode = vertexCode.c_str();
-    const char * fShaderCode = fragmentCode.c_str();
-    
-    // 2. Compile shaders
-    unsigned int vertex, fragment;
-    
-    // Vertex shader
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vShaderCode, NULL);
-    glCompileShader(vertex);
-    
-    // Fragment Shader
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fShaderCode, NULL);
-    glCompileShader(fragment);
-    
+
+    // Compile and link return at once on a parallel compiling driver; the status queries in finish() wait
+    parallelCompile();
+    pending = std::make_shared<PendingBuild>();
+    pending->cacheKey = cacheKey;
+    pending->vertexPath = vertexPath;
+    pending->fragmentPath = fragmentPath;
+    pending->startTime = startTime;
+
+    // Vertex and fragment shaders
+    pending->vertex = compileStage(GL_VERTEX_SHADER, vertexCode);
+    pending->fragment = compileStage(GL_FRAGMENT_SHADER, fragmentCode);
+
     // Shader Program
-    ID = glCreateProgram();
-    glAttachShader(ID, vertex);
-    glAttachShader(ID, fragment);
+    glAttachShader(ID, pending->vertex);
+    glAttachShader(ID, pending->fragment);
+    if (cache.enabled && cache.supported())
+        glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(ID);
-    
+
+    if (build == ShaderBuild::Wait)
+        finish();
+}
+
+bool Shader::parallelCompile() {
+    static int supported = -1;
+    if (supported < 0) {
+        // Let the driver pick how many compiler threads to use
+        supported = 0;
+#ifdef GL_KHR_parallel_shader_compile
+        if (GLEW_KHR_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsKHR(0xffffffffu);
+            supported = 1;
+        }
+#endif
+#ifdef GL_ARB_parallel_shader_compile
+        if (!supported && GLEW_ARB_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsARB(0xffffffffu);
+            supported = 1;
+        }
+#endif
+    }
+    return supported > 0;
+}
+
+bool Shader::poll() {
+    if (!pending || pending->done)
+        return true;
+    if (parallelCompile()) {
+        GLint done = GL_FALSE;
+        glGetProgramiv(ID, COMPLETION_STATUS, &done);
+        if (done != GL_TRUE)
+            return false;
+    }
+    finish();
+    return true;
+}
+
+void Shader::finish() {
+    if (!pending || pending->done)
+        return;
+    // Copies keep the build, so they see it done rather than finishing it again
+    PendingBuild *build = pending.get();
+    build->done = true;
+    ProgramCache &cache = ProgramCache::shared();
+    checkCompiled(build->vertex, build->vertexPath);
+    checkCompiled(build->fragment, build->fragmentPath);
+    if (checkLinked(ID, build->vertexPath, build->fragmentPath))
+        cache.store(build->cacheKey, ID);
+
     // Delete the shaders as they're linked into our program now and no longer necessary
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
+    glDetachShader(ID, build->vertex);
+    glDetachShader(ID, build->fragment);
+    glDeleteShader(build->vertex);
+    glDeleteShader(build->fragment);
+    cache.recordCompiled(millisecondsSince(build->startTime));
+
+    bindUniformBlocks();
+    reflectUniforms();
+}
+
+void Shader::bindUniformBlocks() {
+    GLuint frameBlock = glGetUniformBlockIndex(ID, "FrameConstants");
+    if (frameBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(ID, frameBlock, FRAME_CONSTANTS_BINDING);
+    GLuint objectBlock = glGetUniformBlockIndex(ID, "ObjectConstants");
+    if (objectBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(ID, objectBlock, OBJECT_CONSTANTS_BINDING);
+}
+
+void Shader::reflectUniforms() {
+    *uniforms = UniformTable();
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<char> buffer(std::max(maxLength, 1));
+
+    auto add = [this](const std::string &name, GLint location, size_t size) {
+        UniformId id = uniformId(name);
+        if (uniforms->slots.size() <= id.index)
+            uniforms->slots.resize(id.index + 1, -1);
+        uniforms->slots[id.index] = static_cast<int>(uniforms->uniforms.size());
+        Uniform uniform;
+        uniform.location = location;
+        uniform.offset = uniforms->values.size();
+        uniform.size = size;
+        uniforms->uniforms.push_back(uniform);
+        uniforms->values.resize(uniforms->values.size() + size);
+    };
+
+    for (GLint i = 0; i < count; i++) {
+        GLsizei length = 0;
+        GLint elements = 0;
+        GLenum type = 0;
+        glGetActiveUniform(ID, static_cast<GLuint>(i), static_cast<GLsizei>(buffer.size()), &length, &elements,
+                           &type, buffer.data());
+        std::string name(buffer.data(), length);
+        GLint location = glGetUniformLocation(ID, name.c_str());
+        // Uniforms in blocks have no location
+        if (location < 0)
+            continue;
+        size_t size = uniformSize(type);
+        if (elements <= 1) {
+            add(name, location, size);
+            continue;
+        }
+        // Arrays are reported as name[0]; each element is set on its own, and the bare name is the first
+        std::string base = name.substr(0, name.rfind('['));
+        for (GLint element = 0; element < elements; element++) {
+            std::string elementName = base + "[" + std::to_string(element) + "]";
+            add(elementName, glGetUniformLocation(ID, elementName.c_str()), size);
+        }
+        UniformId baseId = uniformId(base);
+        if (uniforms->slots.size() <= baseId.index)
+            uniforms->slots.resize(baseId.index + 1, -1);
+        uniforms->slots[baseId.index] = uniforms->slots[uniformId(base + "[0]").index];
+    }
+}
+
+UniformId Shader::uniformId(const std::string &name) {
+    std::unordered_map<std::string, unsigned int>& names = uniformNames();
+    auto inserted = names.emplace(name, static_cast<unsigned int>(names.size()));
+    return UniformId{inserted.first->second};
+}
+
+GLint Shader::changed(UniformId id, const void* value, size_t size) const {
+    UniformTable &table = *uniforms;
+    if (id.index >= table.slots.size() || table.slots[id.index] < 0) {
+        table.stats.inactive++;
+        return -1;
+    }
+    Uniform &uniform = table.uniforms[table.slots[id.index]];
+    // A setter of another size than the uniform's type is left for GL to reject
+    if (size == uniform.size) {
+        unsigned char* shadow = table.values.data() + uniform.offset;
+        if (uniform.known && memcmp(shadow, value, size) == 0) {
+            table.stats.unchanged++;
+            return -1;
+        }
+        memcpy(shadow, value, size);
+        uniform.known = true;
+    }
+    table.stats.uploads++;
+    return uniform.location;
+}
+
+UniformStats Shader::takeUniformStats() const {
+    UniformStats stats = uniforms->stats;
+    uniforms->stats = UniformStats();
+    return stats;
 }
 
 void Shader::use() {
@@ -66,37 +351,89 @@ void Shader::use() {
 }
 
 void Shader::setBool(const std::string &name, bool value) const {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    setBool(findUniformId(name), value);
 }
 
 void Shader::setInt(const std::string &name, int value) const {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    setInt(findUniformId(name), value);
 }
 
 void Shader::setFloat(const std::string &name, float value) const {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    setFloat(findUniformId(name), value);
 }
 
 void Shader::setVec2(const std::string &name, const glm::vec2 &value) const {
-    glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    setVec2(findUniformId(name), value);
 }
 
 void Shader::setVec3(const std::string &name, const glm::vec3 &value) const {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    setVec3(findUniformId(name), value);
 }
 
 void Shader::setVec4(const std::string &name, const glm::vec4 &value) const {
-    glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    setVec4(findUniformId(name), value);
 }
 
 void Shader::setMat2(const std::string &name, const glm::mat2 &mat) const {
-    glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    setMat2(findUniformId(name), mat);
 }
 
 void Shader::setMat3(const std::string &name, const glm::mat3 &mat) const {
-    glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    setMat3(findUniformId(name), mat);
 }
 
 void Shader::setMat4(const std::string &name, const glm::mat4 &mat) const {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
-}
\ No newline at end of file
+    setMat4(findUniformId(name), mat);
+}
+
+void Shader::setBool(UniformId id, bool value) const {
+    setInt(id, static_cast<int>(value));
+}
+
+void Shader::setInt(UniformId id, int value) const {
+    GLint location = changed(id, &value, sizeof(value));
+    if (location >= 0)
+        glUniform1i(location, value);
+}
+
+void Shader::setFloat(UniformId id, float value) const {
+    GLint location = changed(id, &value, sizeof(value));
+    if (location >= 0)
+        glUniform1f(location, value);
+}
+
+void Shader::setVec2(UniformId id, const glm::vec2 &value) const {
+    GLint location = changed(id, &value[0], sizeof(value));
+    if (location >= 0)
+        glUniform2fv(location, 1, &value[0]);
+}
+
+void Shader::setVec3(UniformId id, const glm::vec3 &value) const {
+    GLint location = changed(id, &value[0], sizeof(value));
+    if (location >= 0)
+        glUniform3fv(location, 1, &value[0]);
+}
+
+void Shader::setVec4(UniformId id, const glm::vec4 &value) const {
+    GLint location = changed(id, &value[0], sizeof(value));
+    if (location >= 0)
+        glUniform4fv(location, 1, &value[0]);
+}
+
+void Shader::setMat2(UniformId id, const glm::mat2 &mat) const {
+    GLint location = changed(id, &mat[0][0], sizeof(mat));
+    if (location >= 0)
+        glUniformMatrix2fv(location, 1, GL_FALSE, &mat[0][0]);
+}
+
+void Shader::setMat3(UniformId id, const glm::mat3 &mat) const {
+    GLint location = changed(id, &mat[0][0], sizeof(mat));
+    if (location >= 0)
+        glUniformMatrix3fv(location, 1, GL_FALSE, &mat[0][0]);
+}
+
+void Shader::setMat4(UniformId id, const glm::mat4 &mat) const {
+    GLint location = changed(id, &mat[0][0], sizeof(mat));
+    if (location >= 0)
+        glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+}
@@ -6,17 +6,74 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
+#include "gl_resource.h"
+
+#include <utility>
+#include <vector>
+
+// Macros added to a shader's source after its #version line, e.g. {"HAS_TEXTURE", "1"}
+using ShaderDefines = std::vector<std::pair<std::string, std::string>>;
+
+// Reads a shader file with its #include "file" lines (relative to the including file) expanded and
+// defines added. False, with the error printed, when a file cannot be read.
+bool preprocessShader(const std::string &path, const ShaderDefines &defines, std::string &out);
+
+// When a Shader's program becomes usable
+enum class ShaderBuild {
+    // The constructor returns with the program linked
+    Wait,
+    // The constructor only issues compiling and linking; poll() or finish() completes the program, so
+    // a driver with KHR_parallel_shader_compile builds it in the background alongside others
+    Parallel
+};
+
+// Interned uniform name; a name has the same id in every program
+struct UniformId {
+    unsigned int index = ~0u;
+};
+
+struct UniformStats {
+    // glUniform calls made
+    size_t uploads = 0;
+    // Calls skipped because the program already held the value
+    size_t unchanged = 0;
+    // Calls skipped because the program has no such active uniform
+    size_t inactive = 0;
+};
+
 class Shader {
 public:
     unsigned int ID;
+    // Shared by every copy; the program is deleted with the last one
+    std::shared_ptr<GlProgram> program;
     
-    Shader(const char* vertexPath, const char* fragmentPath);
+    Shader(const char* vertexPath, const char* fragmentPath, const ShaderDefines &defines = ShaderDefines(),
+           ShaderBuild build = ShaderBuild::Wait);
     void use();
+
+    // True once the program is linked and ready to use. Without parallel compile support this
+    // finishes the build, blocking until the driver is done.
+    bool poll();
+    // Blocks until the program is linked
+    void finish();
+    // The driver compiles in the background and reports progress through GL_COMPLETION_STATUS_KHR
+    static bool parallelCompile();
+
+    // The program was loaded from the ProgramCache rather than compiled
+    bool loadedFromCache() const { return cached; }
+
+    // Id of a uniform name, for setters called every draw
+    static UniformId uniformId(const std::string &name);
+
+    // The setters expect the program finished and in use. Values equal to the last one set are not uploaded again.
     void setBool(const std::string &name, bool value) const;
     void setInt(const std::string &name, int value) const;
     void setFloat(const std::string &name, float value) const;
@@ -26,5 +83,57 @@ public:
     void setMat2(const std::string &name, const glm::mat2 &mat) const;
     void setMat3(const std::string &name, const glm::mat3 &mat) const;
     void setMat4(const std::string &name, const glm::mat4 &mat) const;
+
+    void setBool(UniformId id, bool value) const;
+    void setInt(UniformId id, int value) const;
+    void setFloat(UniformId id, float value) const;
+    void setVec2(UniformId id, const glm::vec2 &value) const;
+    void setVec3(UniformId id, const glm::vec3 &value) const;
+    void setVec4(UniformId id, const glm::vec4 &value) const;
+    void setMat2(UniformId id, const glm::mat2 &mat) const;
+    void setMat3(UniformId id, const glm::mat3 &mat) const;
+    void setMat4(UniformId id, const glm::mat4 &mat) const;
+
+    // Counts since the last call, shared by every copy of the program
+    UniformStats takeUniformStats() const;
+
+private:
+    struct Uniform {
+        GLint location = -1;
+        // Bytes of the shadow copy in UniformTable::values
+        size_t offset = 0;
+        size_t size = 0;
+        bool known = false;
+    };
+
+    // The program's active uniforms, reflected once after linking, with the last value set on each
+    struct UniformTable {
+        // Index into uniforms per UniformId, -1 when the name is not active here
+        std::vector<int> slots;
+        std::vector<Uniform> uniforms;
+        std::vector<unsigned char> values;
+        UniformStats stats;
+    };
+    // Created with the program, so copies made while it builds see the reflected uniforms too
+    std::shared_ptr<UniformTable> uniforms;
+    bool cached = false;
+
+    // Compile and link issued, shared by every copy; done once one of them finished it
+    struct PendingBuild {
+        bool done = false;
+        GLuint vertex = 0;
+        GLuint fragment = 0;
+        uint64_t cacheKey = 0;
+        std::string vertexPath;
+        std::string fragmentPath;
+        std::chrono::steady_clock::time_point startTime;
+    };
+    std::shared_ptr<PendingBuild> pending;
+
+    // Attaches the FrameConstants and ObjectConstants blocks to the bindings UniformRing fills
+    void bindUniformBlocks();
+    void reflectUniforms();
+    // Location to upload value to, or -1 when the upload can be skipped
+    GLint changed(UniformId id, const void* value, size_t size) const;
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "shader_variants.h"
+
+#include <chrono>
+#include <iostream>
+#include <tuple>
+#include <utility>
+
+const char* shaderQualityName(ShaderQuality quality) {
+    switch (quality) {
+    case ShaderQuality::Low:
+        return "low";
+    case ShaderQuality::Medium:
+        return "medium";
+    default:
+        return "high";
+    }
+}
+
+bool parseShaderQuality(const std::string &name, ShaderQuality &quality) {
+    for (ShaderQuality candidate : {ShaderQuality::Low, ShaderQuality::Medium, ShaderQuality::High}) {
+        if (name == shaderQualityName(candidate)) {
+            quality = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ShaderVariantKey::operator<(const ShaderVariantKey &other) const {
+    return std::tie(hasTexture, quality) < std::tie(other.hasTexture, other.quality);
+}
+
+ShaderDefines ShaderVariantKey::defines() const {
+    return {{"HAS_TEXTURE", hasTexture ? "1" : "0"}, {"QUALITY", std::to_string(static_cast<int>(quality))}};
+}
+
+std::string ShaderVariantKey::name() const {
+    std::string text;
+    for (const std::pair<std::string, std::string> &define : defines())
+        text += (text.empty() ? "" : " ") + define.first + "=" + define.second;
+    return text;
+}
+
+ShaderVariants::ShaderVariants(std::string name, std::string vertexPath, std::string fragmentPath)
+    : styleName(std::move(name)), vertexPath(std::move(vertexPath)), fragmentPath(std::move(fragmentPath)) {}
+
+ShaderVariants::Variant &ShaderVariants::request(const ShaderVariantKey &key) {
+    auto found = variants.find(key);
+    if (found != variants.end())
+        return found->second;
+    auto startTime = std::chrono::steady_clock::now();
+    Variant variant{Shader(vertexPath.c_str(), fragmentPath.c_str(), key.defines(), ShaderBuild::Parallel), startTime};
+    return variants.emplace(key, variant).first->second;
+}
+
+void ShaderVariants::finished(const ShaderVariantKey &key, Variant &variant) {
+    variant.ready = true;
+    variant.compileMilliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - variant.startTime).count();
+    std::cout << "Shader " << styleName << " [" << key.name() << "] "
+              << (variant.shader.loadedFromCache() ? "loaded" : "compiled") << " in " << variant.compileMilliseconds
+              << " ms" << std::endl;
+}
+
+Shader &ShaderVariants::get(const ShaderVariantKey &key) {
+    Variant &variant = request(key);
+    if (variant.ready) {
+        hitCount++;
+        return variant.shader;
+    }
+    variant.shader.finish();
+    finished(key, variant);
+    return variant.shader;
+}
+
+bool ShaderVariants::ready(const ShaderVariantKey &key) {
+    Variant &variant = request(key);
+    if (!variant.ready && variant.shader.poll())
+        finished(key, variant);
+    return variant.ready;
+}
+
+std::vector<ShaderVariantInfo> ShaderVariants::compiled() const {
+    std::vector<ShaderVariantInfo> info;
+    for (const auto &variant : variants) {
+        if (variant.second.ready)
+            info.push_back({variant.first.name(), variant.second.compileMilliseconds});
+    }
+    return info;
+}
+
+size_t ShaderVariants::pending() const {
+    size_t count = 0;
+    for (const auto &variant : variants)
+        count += variant.second.ready ? 0 : 1;
+    return count;
+}
+
+UniformStats ShaderVariants::takeUniformStats() const {
+    UniformStats total;
+    for (const auto &variant : variants) {
+        UniformStats stats = variant.second.shader.takeUniformStats();
+        total.uploads += stats.uploads;
+        total.unchanged += stats.unchanged;
+        total.inactive += stats.inactive;
+    }
+    return total;
+}
@@ -0,0 +1,78 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include "shader.h"
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+// Quality tiers a style shader is compiled for; lower tiers skip texture lookups and strokes
+enum class ShaderQuality { Low = 0, Medium = 1, High = 2 };
+
+// One permutation of a style shader. Each field becomes a define, so the driver compiles every
+// combination with its branches folded away.
+struct ShaderVariantKey {
+    // HAS_TEXTURE: the mesh samples its diffuse texture rather than using objectColor
+    bool hasTexture = false;
+    // QUALITY: 0-2
+    ShaderQuality quality = ShaderQuality::High;
+
+    bool operator<(const ShaderVariantKey &other) const;
+    ShaderDefines defines() const;
+    // e.g. "HAS_TEXTURE=1 QUALITY=2"
+    std::string name() const;
+};
+
+const char* shaderQualityName(ShaderQuality quality);
+// False when the name is not low, medium or high
+bool parseShaderQuality(const std::string &name, ShaderQuality &quality);
+
+struct ShaderVariantInfo {
+    std::string key;
+    double compileMilliseconds = 0.0;
+};
+
+// The permutations of one vertex/fragment pair. A variant is compiled the first time it is asked
+// for and kept, so each combination compiles once. Compiles are issued without waiting, so the
+// variants a frame asks ready() about build together on a parallel compiling driver. GL thread only.
+class ShaderVariants {
+public:
+    ShaderVariants(std::string name, std::string vertexPath, std::string fragmentPath);
+
+    const std::string &name() const { return styleName; }
+    // Blocks until the variant is linked
+    Shader &get(const ShaderVariantKey &key);
+    // Issues the variant's compile if needed; true once it is linked. Never blocks on a driver with
+    // parallel shader compile.
+    bool ready(const ShaderVariantKey &key);
+
+    // The compiled variants, in key order, with the time from issuing each to it being ready
+    std::vector<ShaderVariantInfo> compiled() const;
+    // Variants issued and still compiling
+    size_t pending() const;
+    unsigned int hits() const { return hitCount; }
+
+    // Summed over every variant
+    UniformStats takeUniformStats() const;
+
+private:
+    struct Variant {
+        Shader shader;
+        std::chrono::steady_clock::time_point startTime;
+        bool ready = false;
+        double compileMilliseconds = 0.0;
+    };
+
+    std::string styleName;
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::map<ShaderVariantKey, Variant> variants;
+    unsigned int hitCount = 0;
+
+    Variant &request(const ShaderVariantKey &key);
+    void finished(const ShaderVariantKey &key, Variant &variant);
+};
+
+#endif
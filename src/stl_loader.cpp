@@ -0,0 +1,257 @@
+#include "stl_loader.h"
+#include "mapped_file.h"
+#include "mesh_optimizer.h"
+#include "model.h"
+#include "number_parser.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+// Binary layout: 80 byte header, triangle count, then 50 byte records of a normal, three corners
+// and an attribute word
+const size_t STL_HEADER_SIZE = 84;
+const size_t STL_RECORD_SIZE = 50;
+
+// Target chunk size for ASCII files; chunks end on line boundaries
+const size_t STL_CHUNK_SIZE = 1 << 20;
+
+const size_t TRIANGLE_GRAIN = 16384;
+
+// Progress after reading the records and after welding; the rest is normals
+const float STL_READ_PROGRESS = 0.3f;
+const float STL_WELD_PROGRESS = 0.6f;
+
+// Faces closer than this (cosine) share a slot even with a zero crease angle
+const float SAME_NORMAL_COS = 0.99999f;
+
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "STL corners are copied straight into glm::vec3");
+
+bool isBinaryStl(const unsigned char* data, size_t size) {
+    if (size < STL_HEADER_SIZE)
+        return false;
+    uint32_t triangleCount;
+    memcpy(&triangleCount, data + 80, sizeof(triangleCount));
+    if (STL_HEADER_SIZE + STL_RECORD_SIZE * static_cast<size_t>(triangleCount) == size)
+        return true;
+    // Some binary exporters also start the header with "solid", so only trust it when the size disagrees
+    return size < 5 || memcmp(data, "solid", 5) != 0;
+}
+
+void readBinary(const unsigned char* data, size_t size, const std::string& path, std::vector<glm::vec3>& corners,
+                unsigned int threads) {
+    uint32_t triangleCount;
+    memcpy(&triangleCount, data + 80, sizeof(triangleCount));
+    size_t available = (size - STL_HEADER_SIZE) / STL_RECORD_SIZE;
+    if (triangleCount > available) {
+        std::cout << "WARNING::STL::TRUNCATED: " << path << " has " << available << " of " << triangleCount
+                  << " triangles" << std::endl;
+        triangleCount = static_cast<uint32_t>(available);
+    }
+
+    // The stored face normals are ignored; exporters often leave them zero or stale
+    corners.resize(static_cast<size_t>(triangleCount) * 3);
+    ThreadPool::shared().parallelFor(triangleCount, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++)
+            memcpy(&corners[t * 3], data + STL_HEADER_SIZE + t * STL_RECORD_SIZE + 12, 3 * sizeof(glm::vec3));
+    }, TRIANGLE_GRAIN, threads);
+}
+
+void readAscii(const char* text, size_t size, std::vector<glm::vec3>& corners, unsigned int threads) {
+    const char* textEnd = text + size;
+    std::vector<std::pair<const char*, const char*>> chunks;
+    for (const char* p = text; p < textEnd;) {
+        const char* end = p + std::min(STL_CHUNK_SIZE, static_cast<size_t>(textEnd - p));
+        end = end < textEnd ? skipLine(end, textEnd) : textEnd;
+        chunks.emplace_back(p, end);
+        p = end;
+    }
+
+    // Every facet lists exactly three vertex lines, so the chunks' vertices concatenate into triangles
+    std::vector<std::vector<glm::vec3>> chunkCorners(chunks.size());
+    ThreadPool::shared().parallelFor(chunks.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const char* chunkEnd = chunks[i].second;
+            for (const char* p = chunks[i].first; p < chunkEnd; p = skipLine(p, chunkEnd)) {
+                p = skipBlanks(p, chunkEnd);
+                if (chunkEnd - p < 7 || memcmp(p, "vertex", 6) != 0 || !isBlank(p[6]))
+                    continue;
+                glm::vec3 v(0.0f);
+                p = skipBlanks(parseFloat(skipBlanks(p + 6, chunkEnd), chunkEnd, v.x), chunkEnd);
+                p = skipBlanks(parseFloat(p, chunkEnd, v.y), chunkEnd);
+                parseFloat(p, chunkEnd, v.z);
+                chunkCorners[i].push_back(v);
+            }
+        }
+    }, 1, threads);
+
+    size_t total = 0;
+    for (const std::vector<glm::vec3>& chunk : chunkCorners)
+        total += chunk.size();
+    corners.clear();
+    corners.reserve(total);
+    for (const std::vector<glm::vec3>& chunk : chunkCorners)
+        corners.insert(corners.end(), chunk.begin(), chunk.end());
+}
+
+} // namespace
+
+bool loadStl(const std::string& path, std::vector<MeshData>& meshes, const StlSettings& settings,
+             unsigned int threads, LoadProgress* progress, float progressScale) {
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cout << "ERROR::STL::CANNOT_OPEN_FILE: " << path << std::endl;
+        return false;
+    }
+
+    std::vector<glm::vec3> corners;
+    if (isBinaryStl(file.data(), file.size()))
+        readBinary(file.data(), file.size(), path, corners, threads);
+    else
+        readAscii(reinterpret_cast<const char*>(file.data()), file.size(), corners, threads);
+    file.close();
+
+    if (corners.size() % 3 != 0) {
+        std::cout << "WARNING::STL::INCOMPLETE_FACET: " << path << std::endl;
+        corners.resize(corners.size() - corners.size() % 3);
+    }
+    if (corners.empty()) {
+        std::cout << "ERROR::STL::NO_FACES: " << path << std::endl;
+        return false;
+    }
+    if (progress) {
+        if (progress->cancelled)
+            return false;
+        progress->value = progressScale * STL_READ_PROGRESS;
+    }
+
+    // Weld the corners into shared positions and drop the triangles that collapse
+    ThreadPool& pool = ThreadPool::shared();
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> cornerPosition = weldPositions(corners, settings.positionEpsilon, positions, threads);
+    size_t kept = 0;
+    for (size_t c = 0; c + 2 < cornerPosition.size(); c += 3) {
+        uint32_t a = cornerPosition[c], b = cornerPosition[c + 1], d = cornerPosition[c + 2];
+        if (a == b || b == d || a == d)
+            continue;
+        cornerPosition[kept++] = a;
+        cornerPosition[kept++] = b;
+        cornerPosition[kept++] = d;
+    }
+    if (kept < cornerPosition.size()) {
+        std::cout << "WARNING::STL::DEGENERATE_FACES: " << (cornerPosition.size() - kept) / 3
+                  << " faces removed from " << path << std::endl;
+    }
+    cornerPosition.resize(kept);
+    std::vector<glm::vec3>().swap(corners);
+    if (progress) {
+        if (progress->cancelled)
+            return false;
+        progress->value = progressScale * STL_WELD_PROGRESS;
+    }
+
+    // Face normals, area-weighted for summing and unit length for the crease test
+    size_t triangleCount = cornerPosition.size() / 3;
+    std::vector<glm::vec3> faceNormals(triangleCount);
+    std::vector<glm::vec3> faceDirections(triangleCount);
+    pool.parallelFor(triangleCount, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++) {
+            const glm::vec3& a = positions[cornerPosition[t * 3]];
+            glm::vec3 n = glm::cross(positions[cornerPosition[t * 3 + 1]] - a, positions[cornerPosition[t * 3 + 2]] - a);
+            float length = glm::length(n);
+            faceNormals[t] = n;
+            faceDirections[t] = length > 0.0f ? n / length : glm::vec3(0.0f);
+        }
+    }, TRIANGLE_GRAIN, threads);
+
+    // Corners around every position, in face order
+    std::vector<uint32_t> firstCorner(positions.size() + 1, 0);
+    for (uint32_t p : cornerPosition)
+        firstCorner[p + 1]++;
+    for (size_t p = 0; p < positions.size(); p++)
+        firstCorner[p + 1] += firstCorner[p];
+    std::vector<uint32_t> positionCorners(cornerPosition.size());
+    {
+        std::vector<uint32_t> fill(firstCorner.begin(), firstCorner.end() - 1);
+        for (size_t c = 0; c < cornerPosition.size(); c++)
+            positionCorners[fill[cornerPosition[c]]++] = static_cast<uint32_t>(c);
+    }
+
+    // The faces around a position are grouped into slots: a face joins the first slot whose seed face
+    // lies within the crease angle of its own, otherwise it seeds a new slot. Each slot's normal is the
+    // sum of its faces and its corners share a vertex, so a position costs its corners times its slots.
+    // Slot numbers are local to the position and slot normals are stored in its corner range.
+    float cosCrease = std::min(std::cos(glm::radians(settings.creaseAngle)), SAME_NORMAL_COS);
+    std::vector<uint32_t> cornerSlot(cornerPosition.size());
+    std::vector<glm::vec3> slotNormals(cornerPosition.size());
+    std::vector<uint32_t> slotCount(positions.size());
+    pool.parallelFor(positions.size(), [&](size_t begin, size_t end) {
+        std::vector<glm::vec3> seeds;
+        for (size_t p = begin; p < end; p++) {
+            uint32_t first = firstCorner[p], last = firstCorner[p + 1];
+            seeds.clear();
+            for (uint32_t i = first; i < last; i++) {
+                uint32_t face = positionCorners[i] / 3;
+                const glm::vec3& direction = faceDirections[face];
+                uint32_t slot = 0;
+                // Zero-area faces have no direction to compare and join the first slot
+                if (direction != glm::vec3(0.0f) || seeds.empty()) {
+                    while (slot < seeds.size() && glm::dot(seeds[slot], direction) < cosCrease)
+                        slot++;
+                }
+                if (slot == seeds.size()) {
+                    seeds.push_back(direction);
+                    slotNormals[first + slot] = glm::vec3(0.0f);
+                }
+                slotNormals[first + slot] += faceNormals[face];
+                cornerSlot[positionCorners[i]] = slot;
+            }
+            for (uint32_t slot = 0; slot < seeds.size(); slot++) {
+                glm::vec3& normal = slotNormals[first + slot];
+                float length = glm::length(normal);
+                normal = length > 0.0f ? normal / length : seeds[slot];
+            }
+            slotCount[p] = static_cast<uint32_t>(seeds.size());
+        }
+    }, TRIANGLE_GRAIN, threads);
+    if (progress && progress->cancelled)
+        return false;
+
+    std::vector<uint32_t> firstVertex(positions.size());
+    uint32_t vertexCount = 0;
+    for (size_t p = 0; p < positions.size(); p++) {
+        firstVertex[p] = vertexCount;
+        vertexCount += slotCount[p];
+    }
+
+    MeshData data;
+    data.vertices.resize(vertexCount);
+    data.indices.resize(cornerPosition.size());
+    pool.parallelFor(positions.size(), [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; p++) {
+            for (uint32_t s = 0; s < slotCount[p]; s++) {
+                Vertex& v = data.vertices[firstVertex[p] + s];
+                v.Position = positions[p];
+                v.Normal = slotNormals[firstCorner[p] + s];
+                v.TexCoords = glm::vec2(0.0f);
+                v.Tangent = glm::vec3(0.0f);
+                v.Bitangent = glm::vec3(0.0f);
+            }
+        }
+    }, TRIANGLE_GRAIN, threads);
+    pool.parallelFor(cornerPosition.size(), [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; c++)
+            data.indices[c] = firstVertex[cornerPosition[c]] + cornerSlot[c];
+    }, TRIANGLE_GRAIN, threads);
+
+    meshes.clear();
+    meshes.push_back(std::move(data));
+    if (progress)
+        progress->value = progressScale;
+    return true;
+}
@@ -0,0 +1,26 @@
+#ifndef STL_LOADER_H
+#define STL_LOADER_H
+
+#include "mesh.h"
+
+#include <string>
+#include <vector>
+
+struct LoadProgress;
+
+struct StlSettings {
+    // Maximum position difference per axis when welding, relative to the mesh bounds diagonal
+    float positionEpsilon = 1e-6f;
+    // Faces meeting at a sharper angle than this, in degrees, keep separate normals
+    float creaseAngle = 45.0f;
+};
+
+// Reads binary or ASCII STL files without Assimp. The file is memory-mapped and the triangle
+// records are read in parallel. Positions are welded on a hash grid and each corner gets the
+// area-weighted normal of the faces around it that lie within the crease angle, so the result is one
+// indexed mesh with smooth normals and hard edges at creases. Progress goes up to progressScale.
+// Returns false if the file cannot be read or the load was cancelled.
+bool loadStl(const std::string& path, std::vector<MeshData>& meshes, const StlSettings& settings,
+             unsigned int threads = 0, LoadProgress* progress = nullptr, float progressScale = 1.0f);
+
+#endif
@@ -1,5 +1,17 @@
 #include "texture.h"
-#include "stb_image.h"
+#include "mip_generator.h"
+#include "texture_streamer.h"
+
+namespace {
+
+// Matches the default objectColor, so untextured and still-streaming meshes look alike
+const unsigned char PLACEHOLDER_TEXEL[4] = {204, 204, 204, 255};
+
+} // namespace
+
+size_t mippedTextureBytes(int width, int height, int channels) {
+    return static_cast<size_t>(width) * height * channels * 4 / 3;
+}
     
 bool Texture::loadTexture(const std::string& path){
     Assimp::Importer importer;
@@ -29,7 +41,8 @@ bool Texture::loadTexture(const std::string& path){
     height = texture->mHeight;
     
     // Generate OpenGL texture
-    glGenTextures(1, &id);
+    object = std::make_shared<GlTexture>(GlTexture::create("texture"));
+    id = object->id();
     glBindTexture(GL_TEXTURE_2D, id);
     
     // Set texture parameters
@@ -51,6 +64,7 @@ bool Texture::loadTexture(const std::string& path){
     // Upload texture data
     glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, texture->pcData);
     glGenerateMipmap(GL_TEXTURE_2D);
+    object->setBytes(mippedTextureBytes(width, height, channels));
     
         std::cout << "Texture loaded with Assimp: " << path << " (" << width << "x" << height << ")" << std::endl;
         return true;
@@ -66,49 +80,65 @@ void Texture::unbind() const{
 }
 
 void Texture::cleanup(){
-    if (id != 0) {
-        glDeleteTextures(1, &id);
-        id = 0;
-    }
+    object.reset();
+    id = 0;
 }
 
-bool Texture::loadTextureFromFile(const std::string& path) {
-    // Generate OpenGL texture
-    glGenTextures(1, &id);
-    glBindTexture(GL_TEXTURE_2D, id);
+bool Texture::loadTextureFromFile(const std::string& path, bool srgb) {
+    type = "texture_diffuse";
+    TextureDecodeParams params;
+    params.srgb = srgb;
+    if (TextureStreamer::shared().load(path, params, *this))
+        return true;
 
-    // Set texture parameters
+    std::cerr << "Failed to load texture: " << path << std::endl;
+    return false;
+}
+
+bool Texture::loadFromPixels(const unsigned char* pixels, int width, int height, int channels) {
+    if (!pixels || width <= 0 || height <= 0 || channels < 1 || channels > 4)
+        return false;
+
+    GLenum formats[] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+    GLenum format = formats[channels - 1];
+
+    object = std::make_shared<GlTexture>(GlTexture::create("texture"));
+    id = object->id();
+    glBindTexture(GL_TEXTURE_2D, id);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    // Load image
-    int width, height, nrChannels;
-    unsigned char *data = stbi_load(path.c_str(), &width, &height, &nrChannels, 0);
-    
-    if (data) {
-        GLenum format = GL_RGB;
-        if (nrChannels == 1)
-            format = GL_RED;
-        else if (nrChannels == 3)
-            format = GL_RGB;
-        else if (nrChannels == 4)
-            format = GL_RGBA;
-
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    MipChain mips;
+    generateMips(pixels, width, height, channels, false, TextureStreamer::shared().mips, mips);
+    // Rows of 1 and 3 channel images are not 4-byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t i = 0; i < mips.levels.size(); i++) {
+        const MipChain::Level& level = mips.levels[i];
+        glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), format, level.width, level.height, 0, format,
+                     GL_UNSIGNED_BYTE, mips.data.data() + level.offset);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(mips.levels.size()) - 1);
 
-        // Store texture properties
-        this->width = width;
-        this->height = height;
-        this->channels = nrChannels;
-        this->type = "texture_diffuse";
+    this->width = width;
+    this->height = height;
+    this->channels = channels;
+    object->setBytes(mips.data.size());
+    return true;
+}
 
-        stbi_image_free(data);
-        return true;
-    }
-    
-    std::cerr << "Failed to load texture: " << path << std::endl;
-    return false;
+void Texture::createPlaceholder() {
+    object = std::make_shared<GlTexture>(GlTexture::create("texture"));
+    id = object->id();
+    glBindTexture(GL_TEXTURE_2D, id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, PLACEHOLDER_TEXEL);
+    // A single level is a complete mip chain once the maximum level says so
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    object->setBytes(4);
 }
@@ -5,14 +5,36 @@
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 #include <GL/glew.h>
+#include <memory>
 #include <string>
 #include <iostream>
 
+#include "gl_resource.h"
+
+// How an image file is decoded; textures decoded differently from the same file are cached apart
+struct TextureDecodeParams {
+    // Channels to decode to, 0 keeps the file's own count
+    int channels = 0;
+    // Flip rows on decode, for texture coordinates that were not flipped on import
+    bool flipVertically = false;
+    // Color channels hold sRGB values, as in albedo maps; mips are filtered in linear light
+    bool srgb = false;
+
+    bool operator==(const TextureDecodeParams& other) const {
+        return channels == other.channels && flipVertically == other.flipVertically && srgb == other.srgb;
+    }
+};
+
+// Level 0 plus a third for the mip chain
+size_t mippedTextureBytes(int width, int height, int channels);
+
 class Texture{
     public:
         unsigned int id;
         std::string type;
         int width, height, channels;
+        // Shared by every copy; the GL texture is deleted with the last one
+        std::shared_ptr<GlTexture> object;
         
         Texture() : id(0), width(0), height(0), channels(0) {}
         
@@ -22,9 +44,20 @@ class Texture{
 
         void unbind() const;
 
+        // Drops this copy's reference to the GL texture
         void cleanup();
 
-        bool loadTextureFromFile(const std::string& path);
+        // Queues the file on the TextureStreamer and returns at once with a placeholder, which the
+        // decoded pixels replace within a few frames. srgb is true for color (diffuse/albedo) images,
+        // false for data such as noise. False when the file does not exist.
+        bool loadTextureFromFile(const std::string& path, bool srgb);
+
+        // Creates the texture from already decoded linear 8-bit pixels, with mipmaps built on the
+        // CPU using the TextureStreamer's mip settings
+        bool loadFromPixels(const unsigned char* pixels, int width, int height, int channels);
+
+        // Creates the texture with a single neutral texel, drawn until streamed pixels replace it
+        void createPlaceholder();
 };
 
 
@@ -0,0 +1,239 @@
+#include "texture_atlas.h"
+#include "texture_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+namespace {
+
+// Gutter around packed images, in texels. Rectangles start on multiples of it, so they stay
+// texel-aligned, with at least one texel of gutter, down to level log2(ATLAS_PADDING).
+const int ATLAS_PADDING = 16;
+const int ATLAS_PACKED_LEVELS = 5;
+const int MIN_LAYER_SIZE = 256;
+
+struct Placement {
+    int layer = 0;
+    int x = 0;
+    int y = 0;
+};
+
+int roundUp(int value, int multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+int levelCount(int width, int height) {
+    int levels = 1;
+    while (width > 1 || height > 1) {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        levels++;
+    }
+    return levels;
+}
+
+// RGBA copy of an image; grey is spread over the color channels
+std::vector<unsigned char> toRgba(const MaterialImage& image) {
+    size_t texels = static_cast<size_t>(image.width) * image.height;
+    std::vector<unsigned char> rgba(texels * 4);
+    const unsigned char* source = image.pixels->data();
+    int channels = image.channels;
+    for (size_t i = 0; i < texels; i++) {
+        const unsigned char* in = source + i * channels;
+        unsigned char* out = rgba.data() + i * 4;
+        if (channels >= 3) {
+            out[0] = in[0];
+            out[1] = in[1];
+            out[2] = in[2];
+        } else {
+            out[0] = out[1] = out[2] = in[0];
+        }
+        out[3] = channels == 4 ? in[3] : channels == 2 ? in[1] : 255;
+    }
+    return rgba;
+}
+
+// Shelf packing into square layers of size, tallest first. Returns the number of layers used.
+int packShelves(const std::vector<int>& widths, const std::vector<int>& heights, int size,
+                std::vector<Placement>& placements) {
+    std::vector<size_t> order(widths.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return heights[a] != heights[b] ? heights[a] > heights[b] : widths[a] > widths[b];
+    });
+
+    placements.assign(widths.size(), Placement());
+    int layer = 0, x = 0, y = 0, shelfHeight = 0;
+    for (size_t i : order) {
+        if (x + widths[i] > size) {
+            y += shelfHeight;
+            x = 0;
+            shelfHeight = 0;
+        }
+        if (y + heights[i] > size) {
+            layer++;
+            x = y = shelfHeight = 0;
+        }
+        placements[i] = {layer, x, y};
+        x += widths[i];
+        shelfHeight = std::max(shelfHeight, heights[i]);
+    }
+    return layer + 1;
+}
+
+// Copies an image into a layer with its gutter, which repeats the image as GL_REPEAT would
+void blitWithGutter(const std::vector<unsigned char>& rgba, int width, int height, int layerSize, int x, int y,
+                    unsigned char* layer) {
+    for (int row = -ATLAS_PADDING; row < height + ATLAS_PADDING; row++) {
+        int sourceRow = ((row % height) + height) % height;
+        unsigned char* out = layer + (static_cast<size_t>(y + ATLAS_PADDING + row) * layerSize + x) * 4;
+        for (int column = -ATLAS_PADDING; column < width + ATLAS_PADDING; column++) {
+            int sourceColumn = ((column % width) + width) % width;
+            memcpy(out + (column + ATLAS_PADDING) * 4,
+                   rgba.data() + (static_cast<size_t>(sourceRow) * width + sourceColumn) * 4, 4);
+        }
+    }
+}
+
+} // namespace
+
+bool buildTextureAtlas(const std::vector<MaterialImage>& sources, const TextureAtlasSettings& settings,
+                       const MipSettings& mips, unsigned int formats, int maxLayers, TextureAtlasData& out) {
+    if (sources.empty())
+        return false;
+
+    std::vector<MaterialImage> images = sources;
+    std::vector<std::vector<unsigned char>> rgba(images.size());
+    bool opaque = true;
+    bool srgb = true;
+    for (size_t i = 0; i < images.size(); i++) {
+        MaterialImage& image = images[i];
+        if (!image.pixels && (image.path.empty() || !TextureCache::shared().decodePixels(image.path, image.params, image)))
+            return false;
+        rgba[i] = toRgba(image);
+        image.pixels.reset();
+        opaque = opaque && blockFormatForImage(rgba[i].data(), image.width, image.height, 4) == BlockFormat::BC1;
+        srgb = srgb && image.params.srgb;
+    }
+
+    bool sameSize = std::all_of(images.begin(), images.end(), [&](const MaterialImage& image) {
+        return image.width == images[0].width && image.height == images[0].height;
+    });
+    out.slots.assign(images.size(), AtlasSlot());
+    std::vector<Placement> placements;
+    if (sameSize && images[0].width <= settings.maxLayerSize && images[0].height <= settings.maxLayerSize) {
+        out.packed = false;
+        out.layerWidth = images[0].width;
+        out.layerHeight = images[0].height;
+        out.layers = static_cast<int>(images.size());
+        for (size_t i = 0; i < images.size(); i++)
+            out.slots[i].layer = static_cast<int>(i);
+    } else {
+        // Smallest square layer that holds everything, or the largest allowed split over layers
+        std::vector<int> widths(images.size()), heights(images.size());
+        int largest = 0;
+        for (size_t i = 0; i < images.size(); i++) {
+            widths[i] = roundUp(images[i].width + 2 * ATLAS_PADDING, ATLAS_PADDING);
+            heights[i] = roundUp(images[i].height + 2 * ATLAS_PADDING, ATLAS_PADDING);
+            largest = std::max(largest, std::max(widths[i], heights[i]));
+        }
+        if (largest > settings.maxLayerSize)
+            return false;
+        int size = MIN_LAYER_SIZE;
+        while (size < largest)
+            size *= 2;
+        size = std::min(size, settings.maxLayerSize);
+        int layers = packShelves(widths, heights, size, placements);
+        while (layers > 1 && size * 2 <= settings.maxLayerSize) {
+            size *= 2;
+            layers = packShelves(widths, heights, size, placements);
+        }
+
+        out.packed = true;
+        out.layerWidth = out.layerHeight = size;
+        out.layers = layers;
+        for (size_t i = 0; i < images.size(); i++) {
+            AtlasSlot& slot = out.slots[i];
+            slot.layer = placements[i].layer;
+            slot.rect = glm::vec4(static_cast<float>(placements[i].x + ATLAS_PADDING) / size,
+                                  static_cast<float>(placements[i].y + ATLAS_PADDING) / size,
+                                  static_cast<float>(images[i].width) / size, static_cast<float>(images[i].height) / size);
+        }
+    }
+    if (out.layers > maxLayers)
+        return false;
+
+    out.format = opaque ? BlockFormat::BC1 : BlockFormat::BC7;
+    out.compressed = (formats & (1u << static_cast<int>(out.format))) != 0;
+    int levels = levelCount(out.layerWidth, out.layerHeight);
+    // Smaller levels of packed layers would blend neighbouring images
+    if (out.packed)
+        levels = std::min(levels, ATLAS_PACKED_LEVELS);
+    out.levels.assign(levels, std::vector<unsigned char>());
+
+    // One layer at a time, so only one uncompressed mip chain is alive
+    std::vector<unsigned char> layer;
+    for (int l = 0; l < out.layers; l++) {
+        const unsigned char* texels;
+        if (out.packed) {
+            layer.assign(static_cast<size_t>(out.layerWidth) * out.layerHeight * 4, 0);
+            for (size_t i = 0; i < images.size(); i++) {
+                if (placements[i].layer == l)
+                    blitWithGutter(rgba[i], images[i].width, images[i].height, out.layerWidth, placements[i].x,
+                                   placements[i].y, layer.data());
+            }
+            texels = layer.data();
+        } else {
+            texels = rgba[l].data();
+        }
+
+        MipChain chain;
+        generateMips(texels, out.layerWidth, out.layerHeight, 4, srgb, mips, chain);
+        if (!out.packed)
+            std::vector<unsigned char>().swap(rgba[l]);
+        for (int level = 0; level < levels; level++) {
+            const MipChain::Level& source = chain.levels[level];
+            std::vector<unsigned char>& data = out.levels[level];
+            if (out.compressed) {
+                size_t size = compressedLevelSize(out.format, source.width, source.height);
+                data.resize(data.size() + size);
+                compressImage(chain.data.data() + source.offset, source.width, source.height, 4, out.format,
+                              data.data() + data.size() - size);
+            } else {
+                data.insert(data.end(), chain.data.begin() + source.offset,
+                            chain.data.begin() + source.offset + source.size);
+            }
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<GlTexture> uploadTextureAtlas(const TextureAtlasData& atlas) {
+    auto texture = std::make_shared<GlTexture>(GlTexture::create("texture atlas"));
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture->id());
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(atlas.levels.size()) - 1);
+
+    size_t bytes = 0;
+    int width = atlas.layerWidth, height = atlas.layerHeight;
+    for (size_t level = 0; level < atlas.levels.size(); level++) {
+        const std::vector<unsigned char>& data = atlas.levels[level];
+        if (atlas.compressed) {
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(level), glCompressedFormat(atlas.format),
+                                   width, height, atlas.layers, 0, static_cast<GLsizei>(data.size()), data.data());
+        } else {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(level), GL_RGBA8, width, height, atlas.layers, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+        }
+        bytes += data.size();
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    texture->setBytes(bytes);
+    return texture;
+}
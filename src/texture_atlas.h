@@ -0,0 +1,46 @@
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include "gl_resource.h"
+#include "mesh.h"
+#include "mip_generator.h"
+#include "texture_compressor.h"
+
+#include <memory>
+#include <vector>
+
+struct TextureAtlasSettings {
+    // Pack each model's diffuse textures into one array texture, bound once per model draw
+    bool enabled = true;
+    // Largest layer edge; images of different sizes are packed into square layers up to this size
+    int maxLayerSize = 4096;
+};
+
+// A model's diffuse images as the layers of one array texture, built on the pool. Images of one
+// size get a layer each; otherwise they are packed into shared layers, with a gutter of wrapped
+// texels around each so repeating texture coordinates filter across the seam.
+struct TextureAtlasData {
+    int layerWidth = 0;
+    int layerHeight = 0;
+    int layers = 0;
+    // Images are rectangles in shared layers rather than a layer each
+    bool packed = false;
+    bool compressed = false;
+    BlockFormat format = BlockFormat::BC7;
+    // One per input image
+    std::vector<AtlasSlot> slots;
+    // Every layer of a level back to back: RGBA texels, or blocks when compressed
+    std::vector<std::vector<unsigned char>> levels;
+};
+
+// Pool thread. Converts the images to RGBA, lays them out, builds their mips and compresses them
+// when one of formats (bits per BlockFormat) suits them. Images without pixels are decoded again
+// through the TextureCache. False when an image is missing or does not fit maxLayers layers of
+// maxLayerSize.
+bool buildTextureAtlas(const std::vector<MaterialImage>& sources, const TextureAtlasSettings& settings,
+                       const MipSettings& mips, unsigned int formats, int maxLayers, TextureAtlasData& out);
+
+// GL thread. Creates the GL_TEXTURE_2D_ARRAY holding the atlas
+std::shared_ptr<GlTexture> uploadTextureAtlas(const TextureAtlasData& atlas);
+
+#endif
@@ -0,0 +1,225 @@
+#include "texture_cache.h"
+#include "stb_image.h"
+#include "texture_streamer.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+namespace fs = std::filesystem;
+
+TextureCache& TextureCache::shared() {
+    static TextureCache cache;
+    return cache;
+}
+
+std::string TextureCache::canonicalPath(const std::string& path) {
+    // Materials written on Windows use backslashes
+    std::string portable = path;
+    std::replace(portable.begin(), portable.end(), '\\', '/');
+    std::error_code ec;
+    fs::path canonical = fs::weakly_canonical(portable, ec);
+    return ec ? "" : canonical.string();
+}
+
+namespace {
+
+// Modification time of a file, or the earliest time when it cannot be read
+fs::file_time_type modificationTime(const std::string& path) {
+    std::error_code ec;
+    fs::file_time_type time = fs::last_write_time(path, ec);
+    return ec ? fs::file_time_type::min() : time;
+}
+
+} // namespace
+
+std::string TextureCache::key(const std::string& path, const TextureDecodeParams& params) {
+    return path + '\n' + std::to_string(params.channels) + (params.flipVertically ? "f" : "") + (params.srgb ? "s" : "");
+}
+
+bool TextureCache::textureAlive(const std::string& key) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = textures.find(key);
+    return found != textures.end() && !found->second.object.expired();
+}
+
+bool TextureCache::decodeInto(const std::string& path, const TextureDecodeParams& params, ImageEntry& entry,
+                              std::shared_ptr<const std::vector<unsigned char>>& pixels) {
+    pixels = entry.pixels.lock();
+    if (pixels)
+        return true;
+
+    stbi_set_flip_vertically_on_load_thread(params.flipVertically ? 1 : 0);
+    int width, height, channels;
+    unsigned char* data = stbi_load(path.c_str(), &width, &height, &channels, params.channels);
+    stbi_set_flip_vertically_on_load_thread(0);
+    if (!data) {
+        std::cout << "WARNING::TEXTURE_CACHE::CANNOT_DECODE: " << path << std::endl;
+        entry.failed = true;
+        entry.failedTime = modificationTime(path);
+        return false;
+    }
+    if (params.channels != 0)
+        channels = params.channels;
+    pixels = std::make_shared<const std::vector<unsigned char>>(data, data + static_cast<size_t>(width) * height * channels);
+    stbi_image_free(data);
+    decodeCount++;
+
+    entry.failed = false;
+    entry.pixels = pixels;
+    entry.width = width;
+    entry.height = height;
+    entry.channels = channels;
+    return true;
+}
+
+std::shared_ptr<TextureCache::ImageEntry> TextureCache::imageEntry(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<ImageEntry>& slot = images[key];
+    if (!slot)
+        slot = std::make_shared<ImageEntry>();
+    return slot;
+}
+
+bool TextureCache::decode(const std::string& path, const TextureDecodeParams& params, MaterialImage& image) {
+    return decodeImage(path, params, image, true);
+}
+
+bool TextureCache::decodePixels(const std::string& path, const TextureDecodeParams& params, MaterialImage& image) {
+    return decodeImage(path, params, image, false);
+}
+
+bool TextureCache::decodeImage(const std::string& path, const TextureDecodeParams& params, MaterialImage& image,
+                               bool skipLive) {
+    std::string canonical = canonicalPath(path);
+    image.path.clear();
+    image.params = params;
+    image.pixels.reset();
+    if (canonical.empty()) {
+        std::cout << "WARNING::TEXTURE_CACHE::MISSING_IMAGE: " << path << std::endl;
+        return false;
+    }
+
+    std::string imageKey = key(canonical, params);
+    std::shared_ptr<ImageEntry> entry = imageEntry(imageKey);
+
+    // Concurrent imports of the same file wait for one decode
+    std::lock_guard<std::mutex> lock(entry->mutex);
+    if (!skipLive || !textureAlive(imageKey)) {
+        // A file that failed is not decoded again until it changes, or appears
+        if (entry->failed && entry->pixels.expired() && modificationTime(canonical) == entry->failedTime)
+            return false;
+        if (!decodeInto(canonical, params, *entry, image.pixels))
+            return false;
+    }
+    image.path = canonical;
+    image.width = entry->width;
+    image.height = entry->height;
+    image.channels = entry->channels;
+    return true;
+}
+
+bool TextureCache::acquire(const MaterialImage& image, Texture& texture) {
+    if (image.path.empty()) {
+        if (!image.pixels)
+            return false;
+        TextureStreamer::shared().upload(texture, image.pixels, image.width, image.height, image.channels,
+                                         image.params.srgb);
+        texture.type = image.type;
+        return true;
+    }
+
+    if (find(image.path, image.params, texture)) {
+        texture.type = image.type;
+        return true;
+    }
+
+    // The texture the import counted on may have gone since; the streamer decodes the file again
+    if (!image.pixels) {
+        if (!TextureStreamer::shared().load(image.path, image.params, texture))
+            return false;
+        texture.type = image.type;
+        return true;
+    }
+
+    TextureStreamer::shared().upload(texture, image.pixels, image.width, image.height, image.channels,
+                                     image.params.srgb);
+    texture.type = image.type;
+    insert(image.path, image.params, texture);
+    return true;
+}
+
+bool TextureCache::find(const std::string& path, const TextureDecodeParams& params, Texture& texture) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = textures.find(key(path, params));
+    if (found == textures.end())
+        return false;
+    std::shared_ptr<GlTexture> object = found->second.object.lock();
+    if (!object)
+        return false;
+    texture.object = object;
+    texture.id = object->id();
+    texture.width = found->second.width;
+    texture.height = found->second.height;
+    texture.channels = found->second.channels;
+    hitCount++;
+    return true;
+}
+
+void TextureCache::insert(const std::string& path, const TextureDecodeParams& params, const Texture& texture) {
+    std::lock_guard<std::mutex> lock(mutex);
+    textures[key(path, params)] = {texture.object, texture.width, texture.height, texture.channels};
+    missCount++;
+}
+
+TextureCache::TextureEntry* TextureCache::entryFor(const std::string& key, const std::weak_ptr<GlTexture>& object) {
+    auto found = textures.find(key);
+    if (found == textures.end())
+        return nullptr;
+    const std::weak_ptr<GlTexture>& current = found->second.object;
+    if (current.owner_before(object) || object.owner_before(current))
+        return nullptr;
+    return &found->second;
+}
+
+void TextureCache::setSize(const std::string& path, const TextureDecodeParams& params,
+                           const std::weak_ptr<GlTexture>& object, int width, int height, int channels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    TextureEntry* entry = entryFor(key(path, params), object);
+    if (!entry)
+        return;
+    entry->width = width;
+    entry->height = height;
+    entry->channels = channels;
+}
+
+void TextureCache::remove(const std::string& path, const TextureDecodeParams& params,
+                          const std::weak_ptr<GlTexture>& object) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string entryKey = key(path, params);
+    if (entryFor(entryKey, object))
+        textures.erase(entryKey);
+}
+
+TextureCacheStats TextureCache::stats() const {
+    TextureCacheStats stats;
+    stats.hits = hitCount;
+    stats.misses = missCount;
+    stats.decodes = decodeCount;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& entry : textures) {
+        std::shared_ptr<GlTexture> object = entry.second.object.lock();
+        if (!object)
+            continue;
+        stats.liveTextures++;
+        stats.textureBytes += GlResourceRegistry::shared().bytes(GlResourceType::Texture, object->id());
+    }
+    return stats;
+}
+
+void TextureCache::report() const {
+    TextureCacheStats current = stats();
+    std::cout << "Texture cache: " << current.liveTextures << " textures (" << current.textureBytes / 1024 << " KB), "
+              << current.hits << " hits, " << current.misses << " misses, " << current.decodes << " decodes"
+              << std::endl;
+}
@@ -0,0 +1,105 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include "mesh.h"
+#include "texture.h"
+
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct TextureCacheStats {
+    // Textures reused from the cache and created for it
+    unsigned int hits = 0;
+    unsigned int misses = 0;
+    // Image files decoded
+    unsigned int decodes = 0;
+    size_t liveTextures = 0;
+    // As recorded in the GlResourceRegistry; placeholders count until their pixels arrive
+    size_t textureBytes = 0;
+};
+
+// Process-wide cache of material textures keyed by canonical path and decode parameters. A file is
+// decoded once while its pixels are held by any import, and uploaded once while any Texture still
+// refers to it; every mesh and model using it shares that GL texture, which is deleted with the
+// last Texture copy.
+class TextureCache {
+public:
+    static TextureCache& shared();
+
+    // Decodes an image file, on any thread. Pixels are shared with concurrent imports of the same
+    // file and left null when its texture is alive already, so acquire() reuses that. Returns false,
+    // with the path left empty, when the file cannot be read.
+    bool decode(const std::string& path, const TextureDecodeParams& params, MaterialImage& image);
+
+    // Decodes an image file on any thread, even when its texture is alive
+    bool decodePixels(const std::string& path, const TextureDecodeParams& params, MaterialImage& image);
+
+    // GL thread: the texture for an image from decode(), created on first use and streamed in by
+    // the TextureStreamer. Images without a path are uploaded on their own.
+    bool acquire(const MaterialImage& image, Texture& texture);
+
+    // GL thread: shares the live texture of a canonical path, counting a hit
+    bool find(const std::string& path, const TextureDecodeParams& params, Texture& texture);
+    // GL thread: records a texture just created for a canonical path, counting a miss
+    void insert(const std::string& path, const TextureDecodeParams& params, const Texture& texture);
+    // Any thread: records the size of a texture inserted before its file was decoded. Entries
+    // replaced by another texture since are left alone.
+    void setSize(const std::string& path, const TextureDecodeParams& params, const std::weak_ptr<GlTexture>& object,
+                 int width, int height, int channels);
+    // Any thread: forgets a texture whose file could not be decoded, so the next load tries again
+    void remove(const std::string& path, const TextureDecodeParams& params, const std::weak_ptr<GlTexture>& object);
+
+    TextureCacheStats stats() const;
+
+    // Prints the counts of stats()
+    void report() const;
+
+    // Canonical form of a path, with separators made portable; "" when it cannot be resolved
+    static std::string canonicalPath(const std::string& path);
+
+private:
+    struct ImageEntry {
+        std::mutex mutex;
+        // The last decode failed, and the file's modification time then; the file is tried again
+        // once that time changes
+        bool failed = false;
+        std::filesystem::file_time_type failedTime;
+        std::weak_ptr<const std::vector<unsigned char>> pixels;
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+    };
+
+    struct TextureEntry {
+        std::weak_ptr<GlTexture> object;
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<ImageEntry>> images;
+    std::unordered_map<std::string, TextureEntry> textures;
+    std::atomic<unsigned int> hitCount{0};
+    std::atomic<unsigned int> missCount{0};
+    std::atomic<unsigned int> decodeCount{0};
+
+    TextureCache() = default;
+
+    static std::string key(const std::string& path, const TextureDecodeParams& params);
+    // The entry of key when it still refers to object; mutex must be held
+    TextureEntry* entryFor(const std::string& key, const std::weak_ptr<GlTexture>& object);
+    bool textureAlive(const std::string& key) const;
+    std::shared_ptr<ImageEntry> imageEntry(const std::string& key);
+    // Decodes into entry unless its pixels are still alive; entry's mutex must be held
+    bool decodeInto(const std::string& path, const TextureDecodeParams& params, ImageEntry& entry,
+                    std::shared_ptr<const std::vector<unsigned char>>& pixels);
+    // decode() and decodePixels(); skipLive leaves the pixels out when the texture is alive
+    bool decodeImage(const std::string& path, const TextureDecodeParams& params, MaterialImage& image, bool skipLive);
+};
+
+#endif
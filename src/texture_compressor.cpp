@@ -0,0 +1,526 @@
+#include "texture_compressor.h"
+#include "ktx_file.h"
+#include "stb_image.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+namespace fs = std::filesystem;
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXTURE_COMPRESSOR_SSE2 1
+#endif
+
+namespace {
+
+// Bump whenever the encoders change their output, so cached files are rebuilt
+const int COMPRESSOR_VERSION = 2;
+
+// Weights of the 16 BC7 index values, in 64ths
+const int BC7_WEIGHTS4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// The 16 texels of a block, one row of 16 values per channel
+struct Block {
+    alignas(16) float channel[4][16];
+};
+
+void loadBlock(const unsigned char* pixels, int width, int height, int channels, int blockX, int blockY,
+               Block& block) {
+    for (int y = 0; y < 4; y++) {
+        // Blocks over the edge repeat the last row and column
+        int sourceY = std::min(blockY * 4 + y, height - 1);
+        for (int x = 0; x < 4; x++) {
+            int sourceX = std::min(blockX * 4 + x, width - 1);
+            const unsigned char* texel = pixels + (static_cast<size_t>(sourceY) * width + sourceX) * channels;
+            for (int c = 0; c < 4; c++)
+                block.channel[c][y * 4 + x] = c < channels ? texel[c] : (c == 3 ? 255.0f : 0.0f);
+        }
+    }
+}
+
+// Position of every texel along the line from a to b, rounded to one of levels steps
+void projectIndices(const Block& block, int first, int count, const float* a, const float* b, int levels,
+                    int* indices) {
+    float direction[4] = {};
+    float lengthSquared = 0.0f;
+    for (int c = 0; c < count; c++) {
+        direction[c] = b[c] - a[c];
+        lengthSquared += direction[c] * direction[c];
+    }
+    if (lengthSquared < 1e-8f) {
+        std::fill(indices, indices + 16, 0);
+        return;
+    }
+    float scale = static_cast<float>(levels - 1) / lengthSquared;
+    for (int c = 0; c < count; c++)
+        direction[c] *= scale;
+
+#ifdef TEXTURE_COMPRESSOR_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 top = _mm_set1_ps(static_cast<float>(levels - 1));
+    for (int i = 0; i < 16; i += 4) {
+        __m128 t = _mm_setzero_ps();
+        for (int c = 0; c < count; c++) {
+            __m128 offset = _mm_sub_ps(_mm_load_ps(&block.channel[first + c][i]), _mm_set1_ps(a[c]));
+            t = _mm_add_ps(t, _mm_mul_ps(offset, _mm_set1_ps(direction[c])));
+        }
+        t = _mm_min_ps(_mm_max_ps(t, zero), top);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(indices + i), _mm_cvtps_epi32(t));
+    }
+#else
+    for (int i = 0; i < 16; i++) {
+        float t = 0.0f;
+        for (int c = 0; c < count; c++)
+            t += (block.channel[first + c][i] - a[c]) * direction[c];
+        t = std::min(std::max(t, 0.0f), static_cast<float>(levels - 1));
+        indices[i] = static_cast<int>(std::nearbyint(t));
+    }
+#endif
+}
+
+// Endpoints along the principal axis of the texels, spanning their projections
+void fitEndpoints(const Block& block, int first, int count, float* a, float* b) {
+    float mean[4] = {};
+    float low[4], high[4];
+    for (int c = 0; c < count; c++) {
+        low[c] = high[c] = block.channel[first + c][0];
+        for (int i = 0; i < 16; i++) {
+            float value = block.channel[first + c][i];
+            mean[c] += value;
+            low[c] = std::min(low[c], value);
+            high[c] = std::max(high[c], value);
+        }
+        mean[c] /= 16.0f;
+    }
+
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; i++) {
+        for (int r = 0; r < count; r++) {
+            float dr = block.channel[first + r][i] - mean[r];
+            for (int c = r; c < count; c++)
+                covariance[r][c] += dr * (block.channel[first + c][i] - mean[c]);
+        }
+    }
+    for (int r = 0; r < count; r++) {
+        for (int c = 0; c < r; c++)
+            covariance[r][c] = covariance[c][r];
+    }
+
+    // Power iteration from the bounding box diagonal
+    float axis[4];
+    for (int c = 0; c < count; c++)
+        axis[c] = high[c] - low[c];
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[4] = {};
+        float length = 0.0f;
+        for (int r = 0; r < count; r++) {
+            for (int c = 0; c < count; c++)
+                next[r] += covariance[r][c] * axis[c];
+            length = std::max(length, std::fabs(next[r]));
+        }
+        if (length < 1e-8f)
+            break;
+        for (int c = 0; c < count; c++)
+            axis[c] = next[c] / length;
+    }
+
+    float lengthSquared = 0.0f;
+    for (int c = 0; c < count; c++)
+        lengthSquared += axis[c] * axis[c];
+    if (lengthSquared < 1e-8f) {
+        for (int c = 0; c < count; c++)
+            a[c] = b[c] = mean[c];
+        return;
+    }
+
+    float lowest = 0.0f, highest = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        float t = 0.0f;
+        for (int c = 0; c < count; c++)
+            t += (block.channel[first + c][i] - mean[c]) * axis[c];
+        lowest = std::min(lowest, t);
+        highest = std::max(highest, t);
+    }
+    for (int c = 0; c < count; c++) {
+        a[c] = std::min(std::max(mean[c] + axis[c] * lowest / lengthSquared, 0.0f), 255.0f);
+        b[c] = std::min(std::max(mean[c] + axis[c] * highest / lengthSquared, 0.0f), 255.0f);
+    }
+}
+
+// Least-squares endpoints for the given interpolation weights (0 at a, 1 at b)
+void refineEndpoints(const Block& block, int first, int count, const float* weights, float* a, float* b) {
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = {}, bx[4] = {};
+    for (int i = 0; i < 16; i++) {
+        float w = weights[i];
+        aa += (1.0f - w) * (1.0f - w);
+        ab += (1.0f - w) * w;
+        bb += w * w;
+        for (int c = 0; c < count; c++) {
+            ax[c] += (1.0f - w) * block.channel[first + c][i];
+            bx[c] += w * block.channel[first + c][i];
+        }
+    }
+    float determinant = aa * bb - ab * ab;
+    if (std::fabs(determinant) < 1e-6f)
+        return;
+    for (int c = 0; c < count; c++) {
+        a[c] = std::min(std::max((bb * ax[c] - ab * bx[c]) / determinant, 0.0f), 255.0f);
+        b[c] = std::min(std::max((aa * bx[c] - ab * ax[c]) / determinant, 0.0f), 255.0f);
+    }
+}
+
+uint16_t packRgb565(const float* color) {
+    int r = static_cast<int>(std::lround(color[0] * 31.0f / 255.0f));
+    int g = static_cast<int>(std::lround(color[1] * 63.0f / 255.0f));
+    int b = static_cast<int>(std::lround(color[2] * 31.0f / 255.0f));
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+void unpackRgb565(uint16_t packed, float* color) {
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = static_cast<float>((r << 3) | (r >> 2));
+    color[1] = static_cast<float>((g << 2) | (g >> 4));
+    color[2] = static_cast<float>((b << 3) | (b >> 2));
+}
+
+void encodeBc1(const Block& block, unsigned char* out) {
+    float a[4], b[4];
+    fitEndpoints(block, 0, 3, a, b);
+    int steps[16];
+    float weights[16];
+    projectIndices(block, 0, 3, a, b, 4, steps);
+    for (int i = 0; i < 16; i++)
+        weights[i] = steps[i] / 3.0f;
+    refineEndpoints(block, 0, 3, weights, a, b);
+
+    // Indices are chosen against the endpoints as the GPU will see them
+    uint16_t color0 = packRgb565(a);
+    uint16_t color1 = packRgb565(b);
+    unpackRgb565(color0, a);
+    unpackRgb565(color1, b);
+    projectIndices(block, 0, 3, a, b, 4, steps);
+
+    // Four-color mode needs color0 > color1; step 0 is color0, step 3 color1
+    static const uint32_t STEP_INDEX[4] = {0, 2, 3, 1};
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        if (color0 < color1) {
+            std::swap(color0, color1);
+            for (int& step : steps)
+                step = 3 - step;
+        }
+        for (int i = 0; i < 16; i++)
+            indices |= STEP_INDEX[steps[i]] << (2 * i);
+    }
+    memcpy(out, &color0, 2);
+    memcpy(out + 2, &color1, 2);
+    memcpy(out + 4, &indices, 4);
+}
+
+void encodeBc4(const Block& block, int channel, unsigned char* out) {
+    float low = block.channel[channel][0], high = low;
+    for (int i = 1; i < 16; i++) {
+        low = std::min(low, block.channel[channel][i]);
+        high = std::max(high, block.channel[channel][i]);
+    }
+
+    // Eight-value mode needs alpha0 > alpha1; step 0 is alpha0, step 7 alpha1
+    unsigned char alpha0 = static_cast<unsigned char>(high);
+    unsigned char alpha1 = static_cast<unsigned char>(low);
+    uint64_t indices = 0;
+    if (alpha0 != alpha1) {
+        float a = high, b = low;
+        int steps[16];
+        projectIndices(block, channel, 1, &a, &b, 8, steps);
+        for (int i = 0; i < 16; i++) {
+            uint64_t index = steps[i] == 0 ? 0 : steps[i] == 7 ? 1 : static_cast<uint64_t>(steps[i] + 1);
+            indices |= index << (3 * i);
+        }
+    }
+    out[0] = alpha0;
+    out[1] = alpha1;
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = static_cast<unsigned char>(indices >> (8 * i));
+}
+
+// Appends bits to a 128-bit block, least significant first
+struct BitWriter {
+    unsigned char* out;
+    int position = 0;
+
+    void write(uint32_t value, int bits) {
+        for (int i = 0; i < bits; i++, position++) {
+            if (value & (1u << i))
+                out[position >> 3] |= static_cast<unsigned char>(1u << (position & 7));
+        }
+    }
+};
+
+// 7-bit endpoint and shared p-bit closest to an 8-bit color
+void quantizeBc7Endpoint(const float* color, int* quantized, int& pBit) {
+    float bestError = 0.0f;
+    for (int p = 0; p < 2; p++) {
+        int candidate[4];
+        float error = 0.0f;
+        for (int c = 0; c < 4; c++) {
+            candidate[c] = std::min(std::max(static_cast<int>(std::lround((color[c] - p) / 2.0f)), 0), 127);
+            float value = static_cast<float>((candidate[c] << 1) | p);
+            error += (value - color[c]) * (value - color[c]);
+        }
+        if (p == 0 || error < bestError) {
+            bestError = error;
+            pBit = p;
+            std::copy(candidate, candidate + 4, quantized);
+        }
+    }
+}
+
+// BC7 mode 6: one subset, RGBA endpoints with 7 bits and a p-bit each, 4-bit indices
+void encodeBc7(const Block& block, unsigned char* out) {
+    float a[4], b[4];
+    fitEndpoints(block, 0, 4, a, b);
+    int steps[16];
+    float weights[16];
+    projectIndices(block, 0, 4, a, b, 16, steps);
+    for (int i = 0; i < 16; i++)
+        weights[i] = BC7_WEIGHTS4[steps[i]] / 64.0f;
+    refineEndpoints(block, 0, 4, weights, a, b);
+
+    int endpoint[2][4];
+    int pBit[2];
+    quantizeBc7Endpoint(a, endpoint[0], pBit[0]);
+    quantizeBc7Endpoint(b, endpoint[1], pBit[1]);
+    for (int c = 0; c < 4; c++) {
+        a[c] = static_cast<float>((endpoint[0][c] << 1) | pBit[0]);
+        b[c] = static_cast<float>((endpoint[1][c] << 1) | pBit[1]);
+    }
+    projectIndices(block, 0, 4, a, b, 16, steps);
+
+    // The first index is stored without its top bit, so it must be below 8
+    if (steps[0] >= 8) {
+        std::swap(endpoint[0], endpoint[1]);
+        std::swap(pBit[0], pBit[1]);
+        for (int& step : steps)
+            step = 15 - step;
+    }
+
+    memset(out, 0, 16);
+    BitWriter writer{out};
+    writer.write(1u << 6, 7);
+    for (int c = 0; c < 4; c++) {
+        writer.write(static_cast<uint32_t>(endpoint[0][c]), 7);
+        writer.write(static_cast<uint32_t>(endpoint[1][c]), 7);
+    }
+    writer.write(static_cast<uint32_t>(pBit[0]), 1);
+    writer.write(static_cast<uint32_t>(pBit[1]), 1);
+    writer.write(static_cast<uint32_t>(steps[0]), 3);
+    for (int i = 1; i < 16; i++)
+        writer.write(static_cast<uint32_t>(steps[i]), 4);
+}
+
+bool isOpaque(const unsigned char* pixels, size_t texels, int channels) {
+    if (channels != 4)
+        return true;
+    for (size_t i = 0; i < texels; i++) {
+        if (pixels[i * 4 + 3] != 255)
+            return false;
+    }
+    return true;
+}
+
+// Size, modification time and settings of the source; a cached file with another stamp is stale
+std::string sourceStamp(const std::string& path, const TextureDecodeParams& params, const MipSettings& mips) {
+    std::error_code ec;
+    uintmax_t size = fs::file_size(path, ec);
+    if (ec)
+        return "";
+    auto writeTime = fs::last_write_time(path, ec);
+    if (ec)
+        return "";
+    std::string stamp = std::to_string(size) + ' ' + std::to_string(writeTime.time_since_epoch().count()) + ' ' +
+                        std::to_string(params.channels) + (params.flipVertically ? " flip" : "") +
+                        (params.srgb ? " srgb " : " ") + mipFilterName(mips.filter);
+    if (mips.preserveCoverage)
+        stamp += " coverage " + std::to_string(mips.alphaCutoff);
+    return stamp + ' ' + std::to_string(COMPRESSOR_VERSION);
+}
+
+} // namespace
+
+BlockFormat blockFormatFor(int channels, bool opaque) {
+    if (channels == 1)
+        return BlockFormat::BC4;
+    if (channels == 2)
+        return BlockFormat::BC5;
+    return channels == 4 && !opaque ? BlockFormat::BC7 : BlockFormat::BC1;
+}
+
+BlockFormat blockFormatForImage(const unsigned char* pixels, int width, int height, int channels) {
+    return blockFormatFor(channels, isOpaque(pixels, static_cast<size_t>(width) * height, channels));
+}
+
+size_t blockBytes(BlockFormat format) {
+    return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+size_t compressedLevelSize(BlockFormat format, int width, int height) {
+    return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+GLenum glCompressedFormat(BlockFormat format) {
+    switch (format) {
+    case BlockFormat::BC1:
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BlockFormat::BC4:
+        return GL_COMPRESSED_RED_RGTC1;
+    case BlockFormat::BC5:
+        return GL_COMPRESSED_RG_RGTC2;
+    case BlockFormat::BC7:
+        return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    }
+    return 0;
+}
+
+const char* blockFormatName(BlockFormat format) {
+    static const char* names[] = {"BC1", "BC4", "BC5", "BC7"};
+    return names[static_cast<int>(format)];
+}
+
+bool blockFormatSupported(BlockFormat format) {
+    switch (format) {
+    case BlockFormat::BC1:
+        return GLEW_EXT_texture_compression_s3tc;
+    case BlockFormat::BC7:
+        return GLEW_ARB_texture_compression_bptc;
+    default:
+        // RGTC is core since GL 3.0
+        return true;
+    }
+}
+
+void compressImage(const unsigned char* pixels, int width, int height, int channels, BlockFormat format,
+                   unsigned char* out, unsigned int threads) {
+    int blocksX = (width + 3) / 4;
+    int blocksY = (height + 3) / 4;
+    size_t bytes = blockBytes(format);
+    ThreadPool::shared().parallelFor(static_cast<size_t>(blocksY), [&](size_t begin, size_t end) {
+        Block block;
+        for (size_t by = begin; by < end; by++) {
+            for (int bx = 0; bx < blocksX; bx++) {
+                loadBlock(pixels, width, height, channels, bx, static_cast<int>(by), block);
+                unsigned char* encoded = out + (by * blocksX + bx) * bytes;
+                switch (format) {
+                case BlockFormat::BC1:
+                    encodeBc1(block, encoded);
+                    break;
+                case BlockFormat::BC4:
+                    encodeBc4(block, 0, encoded);
+                    break;
+                case BlockFormat::BC5:
+                    encodeBc4(block, 0, encoded);
+                    encodeBc4(block, 1, encoded + 8);
+                    break;
+                case BlockFormat::BC7:
+                    encodeBc7(block, encoded);
+                    break;
+                }
+            }
+        }
+    }, 4, threads);
+}
+
+void compressTexture(const MipChain& mips, CompressedTexture& out, unsigned int threads) {
+    out.format = blockFormatForImage(mips.data.data(), mips.width, mips.height, mips.channels);
+    out.width = mips.width;
+    out.height = mips.height;
+    out.levels.clear();
+
+    // Lay out every level first, so data is allocated once
+    size_t total = 0;
+    for (const MipChain::Level& level : mips.levels) {
+        size_t size = compressedLevelSize(out.format, level.width, level.height);
+        out.levels.push_back({total, size, level.width, level.height});
+        total += size;
+    }
+    out.data.assign(total, 0);
+
+    for (size_t i = 0; i < mips.levels.size(); i++) {
+        const MipChain::Level& level = mips.levels[i];
+        compressImage(mips.data.data() + level.offset, level.width, level.height, mips.channels, out.format,
+                      out.data.data() + out.levels[i].offset, threads);
+    }
+}
+
+std::string compressedCachePath(const std::string& path, const TextureDecodeParams& params) {
+    std::string cachePath = path;
+    if (params.channels != 0 || params.flipVertically)
+        cachePath += '.' + std::to_string(params.channels) + (params.flipVertically ? "f" : "");
+    return cachePath + (params.srgb ? ".srgb.ktx2" : ".ktx2");
+}
+
+bool loadCompressedCache(const std::string& path, const TextureDecodeParams& params, const MipSettings& mips,
+                         CompressedTexture& texture) {
+    std::string expected = sourceStamp(path, params, mips);
+    std::string stamp;
+    if (expected.empty() || !readKtx2(compressedCachePath(path, params), texture, stamp))
+        return false;
+    return stamp == expected;
+}
+
+bool storeCompressedCache(const std::string& path, const TextureDecodeParams& params, const MipSettings& mips,
+                          const CompressedTexture& texture) {
+    std::string stamp = sourceStamp(path, params, mips);
+    if (stamp.empty())
+        return false;
+    if (!writeKtx2(compressedCachePath(path, params), texture, stamp)) {
+        std::cout << "WARNING::TEXTURE_COMPRESSOR::CANNOT_WRITE_CACHE: " << compressedCachePath(path, params)
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void compressDirectory(const std::string& directory, bool srgb, const MipSettings& mips, unsigned int threads) {
+    static const char* extensions[] = {".png", ".jpg", ".jpeg", ".tga", ".bmp"};
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(directory, ec)) {
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (!entry.is_regular_file() || std::find(std::begin(extensions), std::end(extensions), extension) == std::end(extensions))
+            continue;
+
+        std::string path = entry.path().string();
+        int width, height, channels;
+        unsigned char* pixels = stbi_load(path.c_str(), &width, &height, &channels, 0);
+        if (!pixels) {
+            std::cout << "WARNING::TEXTURE_COMPRESSOR::CANNOT_DECODE: " << path << std::endl;
+            continue;
+        }
+        TextureDecodeParams params;
+        params.srgb = srgb;
+        auto start = std::chrono::steady_clock::now();
+        MipChain chain;
+        generateMips(pixels, width, height, channels, params.srgb, mips, chain, threads);
+        stbi_image_free(pixels);
+        CompressedTexture texture;
+        compressTexture(chain, texture, threads);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        if (!storeCompressedCache(path, params, mips, texture))
+            continue;
+        size_t plain = mippedTextureBytes(width, height, channels);
+        std::cout << path << ": " << width << "x" << height << " " << blockFormatName(texture.format) << ", "
+                  << plain / 1024 << " KB -> " << texture.data.size() / 1024 << " KB in " << elapsed.count() << " ms"
+                  << std::endl;
+    }
+    if (ec)
+        std::cout << "ERROR::TEXTURE_COMPRESSOR::CANNOT_READ_DIRECTORY: " << directory << std::endl;
+}
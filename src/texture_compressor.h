@@ -0,0 +1,63 @@
+#ifndef TEXTURE_COMPRESSOR_H
+#define TEXTURE_COMPRESSOR_H
+
+#include "mip_generator.h"
+#include "texture.h"
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// GPU block formats, each storing 4x4 texels per block
+enum class BlockFormat { BC1, BC4, BC5, BC7 };
+
+// A mip chain in one block format, levels back to back from the largest
+struct CompressedTexture {
+    struct Level {
+        size_t offset = 0;
+        size_t size = 0;
+        int width = 0;
+        int height = 0;
+    };
+    BlockFormat format = BlockFormat::BC1;
+    int width = 0;
+    int height = 0;
+    std::vector<Level> levels;
+    std::vector<unsigned char> data;
+};
+
+// BC4 for one channel, BC5 for two, BC1 for opaque color and BC7 for color with alpha
+BlockFormat blockFormatFor(int channels, bool opaque);
+BlockFormat blockFormatForImage(const unsigned char* pixels, int width, int height, int channels);
+size_t blockBytes(BlockFormat format);
+size_t compressedLevelSize(BlockFormat format, int width, int height);
+GLenum glCompressedFormat(BlockFormat format);
+const char* blockFormatName(BlockFormat format);
+
+// GL thread: whether the driver samples the format (BC1 and BC7 are extensions on GL 3.3)
+bool blockFormatSupported(BlockFormat format);
+
+// Encodes one image of 8-bit texels with 1-4 channels into out, which holds compressedLevelSize
+// bytes. Block rows run on up to threads pool threads; texels are matched to endpoints four at a
+// time with SSE2 where it is available. Deterministic for a given input.
+void compressImage(const unsigned char* pixels, int width, int height, int channels, BlockFormat format,
+                   unsigned char* out, unsigned int threads = 0);
+
+// Compresses every level of a mip chain in the format blockFormatFor picks for its largest level
+void compressTexture(const MipChain& mips, CompressedTexture& out, unsigned int threads = 0);
+
+// Compressed copies of image files are cached in a KTX2 file next to the source, stamped with the
+// source's size and modification time and the settings its mips were built with
+std::string compressedCachePath(const std::string& path, const TextureDecodeParams& params);
+bool loadCompressedCache(const std::string& path, const TextureDecodeParams& params, const MipSettings& mips,
+                         CompressedTexture& texture);
+bool storeCompressedCache(const std::string& path, const TextureDecodeParams& params, const MipSettings& mips,
+                          const CompressedTexture& texture);
+
+// Compresses every image in a directory ahead of time and prints the savings. srgb must match what
+// the images are loaded as at runtime (color or data), or the cached copies are never found.
+void compressDirectory(const std::string& directory, bool srgb, const MipSettings& mips, unsigned int threads = 0);
+
+#endif
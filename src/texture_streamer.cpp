@@ -0,0 +1,294 @@
+#include "texture_streamer.h"
+#include "texture_cache.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+namespace fs = std::filesystem;
+
+namespace {
+
+const size_t MIN_UPLOAD_BUDGET = 64 * 1024;
+
+// Channels sampled from a texture stored in a block format
+int blockFormatChannels(BlockFormat format) {
+    switch (format) {
+    case BlockFormat::BC4:
+        return 1;
+    case BlockFormat::BC5:
+        return 2;
+    case BlockFormat::BC1:
+        return 3;
+    case BlockFormat::BC7:
+        return 4;
+    }
+    return 4;
+}
+
+} // namespace
+
+TextureStreamer& TextureStreamer::shared() {
+    static TextureStreamer streamer;
+    return streamer;
+}
+
+TextureStreamer::~TextureStreamer() {
+    DecodedImage* image = decoded.exchange(nullptr);
+    while (image) {
+        DecodedImage* next = image->next;
+        delete image;
+        image = next;
+    }
+}
+
+bool TextureStreamer::load(const std::string& path, const TextureDecodeParams& params, Texture& texture) {
+    std::error_code ec;
+    std::string canonical = TextureCache::canonicalPath(path);
+    if (canonical.empty() || !fs::is_regular_file(canonical, ec))
+        return false;
+    if (TextureCache::shared().find(canonical, params, texture))
+        return true;
+
+    texture.createPlaceholder();
+    TextureCache::shared().insert(canonical, params, texture);
+
+    std::weak_ptr<GlTexture> target = texture.object;
+    TextureCompressionSettings settings = compression;
+    MipSettings mipSettings = mips;
+    unsigned int formats = settings.enabled ? compressibleFormats() : 0;
+    decoding++;
+    ThreadPool::shared().submit([this, canonical, params, target, settings, mipSettings, formats]() {
+        if (stopped || target.expired()) {
+            decoding--;
+            return;
+        }
+        // A current compressed file skips decoding and compression altogether
+        if (formats != 0) {
+            auto cached = std::make_shared<CompressedTexture>();
+            if (loadCompressedCache(canonical, params, mipSettings, *cached) &&
+                (formats & (1u << static_cast<int>(cached->format)))) {
+                int channels = params.channels != 0 ? params.channels : blockFormatChannels(cached->format);
+                TextureCache::shared().setSize(canonical, params, target, cached->width, cached->height, channels);
+                DecodedImage* result = new DecodedImage();
+                result->target = target;
+                result->compressed = std::move(cached);
+                result->fromCache = true;
+                push(result);
+                decoding--;
+                return;
+            }
+        }
+
+        MaterialImage image;
+        if (TextureCache::shared().decodePixels(canonical, params, image)) {
+            TextureCache::shared().setSize(canonical, params, target, image.width, image.height, image.channels);
+            DecodedImage* result = new DecodedImage();
+            result->target = target;
+            prepare(*result, *image.pixels, image.width, image.height, image.channels, params.srgb, mipSettings,
+                    formats);
+            if (result->compressed && settings.writeCache)
+                storeCompressedCache(canonical, params, mipSettings, *result->compressed);
+            push(result);
+        } else {
+            // The placeholder is not worth sharing; a later load decodes again once the file changes
+            TextureCache::shared().remove(canonical, params, target);
+        }
+        decoding--;
+    });
+    return true;
+}
+
+void TextureStreamer::upload(Texture& texture, std::shared_ptr<const std::vector<unsigned char>> pixels, int width,
+                             int height, int channels, bool srgb) {
+    texture.createPlaceholder();
+    texture.width = width;
+    texture.height = height;
+    texture.channels = channels;
+    if (!pixels || pixels->empty() || channels < 1 || channels > 4)
+        return;
+
+    std::weak_ptr<GlTexture> target = texture.object;
+    MipSettings mipSettings = mips;
+    unsigned int formats = compression.enabled ? compressibleFormats() : 0;
+    decoding++;
+    ThreadPool::shared().submit([this, target, pixels, width, height, channels, srgb, mipSettings, formats]() {
+        if (!stopped && !target.expired()) {
+            DecodedImage* result = new DecodedImage();
+            result->target = target;
+            prepare(*result, *pixels, width, height, channels, srgb, mipSettings, formats);
+            push(result);
+        }
+        decoding--;
+    });
+}
+
+unsigned int TextureStreamer::compressibleFormats() {
+    if (!formatsQueried) {
+        for (BlockFormat format : {BlockFormat::BC1, BlockFormat::BC4, BlockFormat::BC5, BlockFormat::BC7}) {
+            if (blockFormatSupported(format))
+                supportedFormats |= 1u << static_cast<int>(format);
+        }
+        formatsQueried = true;
+    }
+    return supportedFormats;
+}
+
+void TextureStreamer::prepare(DecodedImage& image, const std::vector<unsigned char>& pixels, int width, int height,
+                              int channels, bool srgb, const MipSettings& mips, unsigned int formats) {
+    auto chain = std::make_shared<MipChain>();
+    generateMips(pixels.data(), width, height, channels, srgb, mips, *chain);
+    BlockFormat format = blockFormatForImage(pixels.data(), width, height, channels);
+    if (formats & (1u << static_cast<int>(format))) {
+        auto compressed = std::make_shared<CompressedTexture>();
+        compressTexture(*chain, *compressed);
+        // Only the blocks are uploaded
+        image.compressed = std::move(compressed);
+        return;
+    }
+    image.mips = std::move(chain);
+}
+
+void TextureStreamer::push(DecodedImage* image) {
+    if (stopped) {
+        delete image;
+        return;
+    }
+    image->next = decoded.load(std::memory_order_relaxed);
+    while (!decoded.compare_exchange_weak(image->next, image, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+}
+
+void TextureStreamer::update() {
+    // The stack holds the newest image first; queue them in the order they finished
+    DecodedImage* image = decoded.exchange(nullptr, std::memory_order_acquire);
+    std::vector<DecodedImage*> finished;
+    for (; image; image = image->next)
+        finished.push_back(image);
+    for (auto it = finished.rbegin(); it != finished.rend(); ++it) {
+        Upload upload;
+        upload.target = (*it)->target;
+        upload.mips = std::move((*it)->mips);
+        upload.compressed = std::move((*it)->compressed);
+        upload.fromCache = (*it)->fromCache;
+        uploads.push_back(std::move(upload));
+        delete *it;
+    }
+
+    // Some progress every frame even with a tiny budget
+    size_t budget = std::max(uploadBudget, MIN_UPLOAD_BUDGET);
+    while (!uploads.empty() && budget > 0) {
+        Upload& upload = uploads.front();
+        std::shared_ptr<GlTexture> object = upload.target.lock();
+        if (!object || (!upload.compressed && !upload.mips)) {
+            uploads.pop_front();
+            continue;
+        }
+        if (!stage(upload, object->id(), budget))
+            break;
+        if (upload.compressed) {
+            object->setBytes(upload.compressed->data.size());
+            compressedCount++;
+            if (upload.fromCache)
+                compressedCacheHitCount++;
+        } else {
+            object->setBytes(upload.mips->data.size());
+        }
+        completedCount++;
+        // The buffer is deleted only once the driver has read it
+        uploads.pop_front();
+    }
+}
+
+bool TextureStreamer::stage(Upload& upload, GLuint texture, size_t& budget) {
+    const std::vector<unsigned char>& data = upload.compressed ? upload.compressed->data : upload.mips->data;
+    size_t total = data.size();
+    if (!upload.staging) {
+        upload.staging = GlBuffer::create("texture staging buffer");
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.staging.id());
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, total, nullptr, GL_STREAM_DRAW);
+        upload.staging.setBytes(total);
+    } else {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload.staging.id());
+    }
+
+    size_t chunk = std::min(budget, total - upload.staged);
+    if (chunk > 0) {
+        // Ranges already written are never touched again, so no synchronization is needed
+        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, upload.staged, chunk,
+                                        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (!mapped) {
+            std::cout << "ERROR::TEXTURE_STREAMER::CANNOT_MAP_STAGING_BUFFER" << std::endl;
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            budget = 0;
+            return false;
+        }
+        memcpy(mapped, data.data() + upload.staged, chunk);
+        // The contents are lost in the rare case the buffer was corrupted; stage the range again
+        if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE) {
+            upload.staged += chunk;
+            stagedTotal += chunk;
+        }
+        budget -= chunk;
+    }
+    if (upload.staged < total) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return false;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    if (upload.compressed) {
+        // Every level comes from the buffer, at its offset in the staged chain
+        const CompressedTexture& compressed = *upload.compressed;
+        GLenum format = glCompressedFormat(compressed.format);
+        for (size_t i = 0; i < compressed.levels.size(); i++) {
+            const CompressedTexture::Level& level = compressed.levels[i];
+            glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), format, level.width, level.height, 0,
+                                   static_cast<GLsizei>(level.size), reinterpret_cast<const void*>(level.offset));
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(compressed.levels.size()) - 1);
+        return true;
+    }
+
+    const MipChain& mipChain = *upload.mips;
+    GLenum formats[] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+    GLenum format = formats[mipChain.channels - 1];
+    // Rows of 1 and 3 channel images are not 4-byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t i = 0; i < mipChain.levels.size(); i++) {
+        const MipChain::Level& level = mipChain.levels[i];
+        glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), format, level.width, level.height, 0, format,
+                     GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(level.offset));
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(mipChain.levels.size()) - 1);
+    return true;
+}
+
+TextureStreamStats TextureStreamer::stats() const {
+    TextureStreamStats stats;
+    stats.decoding = decoding;
+    stats.uploading = uploads.size();
+    stats.completed = completedCount;
+    stats.stagedBytes = stagedTotal;
+    stats.compressed = compressedCount;
+    stats.compressedCacheHits = compressedCacheHitCount;
+    return stats;
+}
+
+void TextureStreamer::shutdown() {
+    stopped = true;
+    while (decoding > 0)
+        std::this_thread::yield();
+    DecodedImage* image = decoded.exchange(nullptr);
+    while (image) {
+        DecodedImage* next = image->next;
+        delete image;
+        image = next;
+    }
+    uploads.clear();
+}
@@ -0,0 +1,117 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include "gl_resource.h"
+#include "mip_generator.h"
+#include "texture.h"
+#include "texture_compressor.h"
+
+#include <GL/glew.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct TextureStreamStats {
+    // Files being decoded on the pool, and decoded images waiting for or in upload
+    unsigned int decoding = 0;
+    size_t uploading = 0;
+    unsigned int completed = 0;
+    size_t stagedBytes = 0;
+    // Completed textures stored in a block format, and those read from a KTX2 file
+    unsigned int compressed = 0;
+    unsigned int compressedCacheHits = 0;
+};
+
+struct TextureCompressionSettings {
+    // Compress textures to BC formats the driver supports before upload
+    bool enabled = true;
+    // Save compressed image files next to the source for the next run
+    bool writeCache = true;
+};
+
+// Moves texture loads off the render thread. Files are decoded and their mip chains built on the
+// ThreadPool and handed back through a lock-free queue; update() then copies the levels into pixel
+// buffer objects, at most uploadBudget bytes per frame, and respecifies a texture from its buffer
+// once every level is staged. Until then the texture keeps its placeholder texel. Textures that
+// lose their last Texture copy before that are dropped from the queue.
+// With compression on, mip chains are block-compressed on the pool as well, or read straight
+// from their KTX2 cache file.
+class TextureStreamer {
+public:
+    static TextureStreamer& shared();
+
+    TextureCompressionSettings compression;
+    MipSettings mips;
+
+    // Pixel bytes staged per update()
+    size_t uploadBudget = 8 * 1024 * 1024;
+
+    // GL thread. Gives texture a placeholder and queues the file for decoding, or shares the
+    // texture the TextureCache holds for it already. False when the file does not exist.
+    bool load(const std::string& path, const TextureDecodeParams& params, Texture& texture);
+
+    // GL thread. Gives texture a placeholder and queues already decoded pixels
+    void upload(Texture& texture, std::shared_ptr<const std::vector<unsigned char>> pixels, int width, int height,
+                int channels, bool srgb);
+
+    // GL thread, once per frame
+    void update();
+
+    TextureStreamStats stats() const;
+
+    // GL thread. Bit per BlockFormat the driver samples
+    unsigned int compressibleFormats();
+
+    // Waits for decodes in flight and drops every pending upload, before the GL context goes away
+    void shutdown();
+
+private:
+    // Handed from the decoder threads to the GL thread
+    // Exactly one of mips and compressed is set
+    struct DecodedImage {
+        std::weak_ptr<GlTexture> target;
+        std::shared_ptr<const MipChain> mips;
+        std::shared_ptr<const CompressedTexture> compressed;
+        bool fromCache = false;
+        DecodedImage* next = nullptr;
+    };
+
+    struct Upload {
+        std::weak_ptr<GlTexture> target;
+        std::shared_ptr<const MipChain> mips;
+        std::shared_ptr<const CompressedTexture> compressed;
+        bool fromCache = false;
+        GlBuffer staging;
+        size_t staged = 0;
+    };
+
+    // Lock-free stack of decoded images; update() takes all of them at once
+    std::atomic<DecodedImage*> decoded{nullptr};
+    std::atomic<unsigned int> decoding{0};
+    std::atomic<bool> stopped{false};
+
+    std::deque<Upload> uploads;
+    unsigned int completedCount = 0;
+    unsigned int compressedCount = 0;
+    unsigned int compressedCacheHitCount = 0;
+    size_t stagedTotal = 0;
+    // Bit per BlockFormat the driver samples, known once the first texture is queued
+    unsigned int supportedFormats = 0;
+    bool formatsQueried = false;
+
+    TextureStreamer() = default;
+    ~TextureStreamer();
+
+    void push(DecodedImage* image);
+    // Pool thread: builds the mip chain of the pixels and block-compresses it when one of formats
+    // suits the image
+    static void prepare(DecodedImage& image, const std::vector<unsigned char>& pixels, int width, int height,
+                        int channels, bool srgb, const MipSettings& mips, unsigned int formats);
+    // Copies up to budget bytes of the upload into its buffer; true once the texture is complete
+    bool stage(Upload& upload, GLuint texture, size_t& budget);
+};
+
+#endif
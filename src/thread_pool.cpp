@@ -0,0 +1,128 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace {
+
+// Shared between the caller of parallelFor and its helpers. Helpers that start after the work is
+// exhausted only touch this state, which they keep alive through their shared_ptr.
+struct ParallelJob {
+    std::atomic<size_t> next{0};
+    size_t count = 0;
+    size_t grain = 1;
+    const std::function<void(size_t, size_t)>* body = nullptr;
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    unsigned int active = 0;
+    std::exception_ptr error;
+
+    void run() {
+        for (;;) {
+            size_t begin = next.fetch_add(grain);
+            if (begin >= count)
+                return;
+            try {
+                (*body)(begin, std::min(begin + grain, count));
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error)
+                    error = std::current_exception();
+                // Skip the remaining chunks
+                next = count;
+            }
+        }
+    }
+};
+
+} // namespace
+
+ThreadPool::ThreadPool(unsigned int threadCount) {
+    threadCount = std::max(threadCount, 1u);
+    workers.reserve(threadCount);
+    for (unsigned int i = 0; i < threadCount; i++)
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 1u));
+    return pool;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push(std::move(task));
+    }
+    condition.notify_one();
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t, size_t)>& body, size_t grain,
+                             unsigned int maxThreads) {
+    if (count == 0)
+        return;
+    grain = std::max<size_t>(grain, 1);
+
+    size_t chunks = (count + grain - 1) / grain;
+    unsigned int threads = maxThreads == 0 ? size() + 1 : std::min(maxThreads, size() + 1);
+    threads = static_cast<unsigned int>(std::min<size_t>(threads, chunks));
+    if (threads <= 1) {
+        body(0, count);
+        return;
+    }
+
+    auto job = std::make_shared<ParallelJob>();
+    job->count = count;
+    job->grain = grain;
+    job->body = &body;
+
+    for (unsigned int i = 0; i + 1 < threads; i++) {
+        submit([job]() {
+            {
+                std::lock_guard<std::mutex> lock(job->mutex);
+                job->active++;
+            }
+            job->run();
+            {
+                std::lock_guard<std::mutex> lock(job->mutex);
+                job->active--;
+            }
+            job->finished.notify_all();
+        });
+    }
+
+    // Work alongside the helpers, then wait only for helpers that actually picked up chunks
+    job->run();
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->finished.wait(lock, [&job]() { return job->active == 0; });
+    if (job->error)
+        std::rethrow_exception(job->error);
+}
+
+void ThreadPool::workerLoop() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for CPU-heavy asset processing.
+// parallelFor lets the calling thread take part in the work and never waits on a task that has
+// not started, so it can be nested and called from inside other pool tasks without deadlocking.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned int threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Process-wide pool with one worker per hardware thread
+    static ThreadPool& shared();
+
+    unsigned int size() const { return static_cast<unsigned int>(workers.size()); }
+
+    // Queues a task to run on a worker
+    void submit(std::function<void()> task);
+
+    // Calls body(begin, end) over [0, count) in chunks of grain items, using at most maxThreads
+    // threads including the caller (0 means all of them). Returns once every chunk has run.
+    void parallelFor(size_t count, const std::function<void(size_t, size_t)>& body, size_t grain = 1,
+                     unsigned int maxThreads = 0);
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+
+    void workerLoop();
+};
+#endif
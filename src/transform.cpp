@@ -10,7 +10,7 @@ Transform::Transform(glm::vec3 scale, glm::vec3 rotation, glm::vec3 position)
       CurrentOperation(SCALE_UNIFORM) {
 }
 
-glm::mat4 Transform::GetModelMatrix() {
+glm::mat4 Transform::GetModelMatrix() const {
     glm::mat4 model = glm::mat4(1.0f);
     
     // Apply transformations 
@@ -41,7 +41,7 @@ public:
     );
     
     // Get the transformation matrix
-    glm::mat4 GetModelMatrix();
+    glm::mat4 GetModelMatrix() const;
     
     // Process mouse movement based on current operation
     void ProcessMouseMovement(float xoffset, float yoffset);
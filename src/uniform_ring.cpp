@@ -0,0 +1,104 @@
+#include "uniform_ring.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+// Bytes per frame; a frame writes one FrameConstants and an ObjectConstants per object
+const size_t REGION_SIZE = 64 * 1024;
+// Upper bound of one wait on a fence, in nanoseconds
+const GLuint64 FENCE_TIMEOUT = 1000000000;
+
+} // namespace
+
+ObjectConstants ObjectConstants::fromModel(const glm::mat4 &model) {
+    ObjectConstants constants;
+    constants.model = model;
+    constants.normalMatrix = glm::transpose(glm::inverse(model));
+    return constants;
+}
+
+UniformRing& UniformRing::shared() {
+    static UniformRing ring;
+    return ring;
+}
+
+void UniformRing::create() {
+    GLint offsetAlignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+    if (offsetAlignment > 0)
+        alignment = static_cast<size_t>(offsetAlignment);
+    regionSize = (REGION_SIZE + alignment - 1) / alignment * alignment;
+    size_t total = regionSize * FRAMES;
+
+    buffer = GlBuffer::create("uniform ring");
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer.id());
+    if (GLEW_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_UNIFORM_BUFFER, static_cast<GLsizeiptr>(total), nullptr, flags);
+        mapped = static_cast<unsigned char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, static_cast<GLsizeiptr>(total), flags));
+    } else {
+        glBufferData(GL_UNIFORM_BUFFER, static_cast<GLsizeiptr>(total), nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    buffer.setBytes(total);
+    ringStats.persistent = mapped != nullptr;
+}
+
+void UniformRing::beginFrame() {
+    if (!buffer)
+        create();
+
+    frame = (frame + 1) % FRAMES;
+    used = 0;
+    GLsync& fence = fences[frame];
+    if (fence) {
+        if (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) {
+            ringStats.fenceWaits++;
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+}
+
+bool UniformRing::bind(GLuint binding, const void* data, size_t size) {
+    if (used + size > regionSize) {
+        std::cout << "WARNING::UNIFORM_RING::FULL: " << regionSize << " bytes per frame used up" << std::endl;
+        return false;
+    }
+    size_t offset = static_cast<size_t>(frame) * regionSize + used;
+    if (mapped) {
+        memcpy(mapped + offset, data, size);
+    } else {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer.id());
+        glBufferSubData(GL_UNIFORM_BUFFER, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size), data);
+    }
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer.id(), static_cast<GLintptr>(offset),
+                      static_cast<GLsizeiptr>(size));
+    used += (size + alignment - 1) / alignment * alignment;
+    return true;
+}
+
+void UniformRing::endFrame() {
+    if (!buffer)
+        return;
+    fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ringStats.frameBytes = used;
+}
+
+void UniformRing::shutdown() {
+    for (GLsync& fence : fences) {
+        if (fence)
+            glDeleteSync(fence);
+        fence = nullptr;
+    }
+    if (mapped) {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer.id());
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        mapped = nullptr;
+    }
+    buffer.reset();
+}
@@ -0,0 +1,88 @@
+#ifndef UNIFORM_RING_H
+#define UNIFORM_RING_H
+
+#include "gl_resource.h"
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+// Binding points of the uniform blocks the shaders declare; Shader attaches its blocks to them
+const GLuint FRAME_CONSTANTS_BINDING = 0;
+const GLuint OBJECT_CONSTANTS_BINDING = 1;
+
+// The FrameConstants block in std140 layout: each vec3 takes the first 12 bytes of a 16-byte slot
+// and the float after it the last 4
+struct FrameConstants {
+    glm::mat4 projection{1.0f};
+    glm::mat4 view{1.0f};
+    glm::vec3 viewPos{0.0f};
+    float ambientStrength = 0.0f;
+    glm::vec3 lightPos{0.0f};
+    float specularStrength = 0.0f;
+    glm::vec3 lightColor{1.0f};
+    float shininess = 0.0f;
+    float time = 0.0f;
+    float padding[3] = {};
+};
+
+// The ObjectConstants block in std140 layout
+struct ObjectConstants {
+    glm::mat4 model{1.0f};
+    // Inverse transpose of model for normals, as a mat4 since a std140 mat3 has padded columns
+    glm::mat4 normalMatrix{1.0f};
+
+    static ObjectConstants fromModel(const glm::mat4 &model);
+};
+
+struct UniformRingStats {
+    // Bytes written in the last frame
+    size_t frameBytes = 0;
+    // Frames that had to wait for the GPU to finish with their region
+    unsigned int fenceWaits = 0;
+    // The buffer stays mapped (ARB_buffer_storage); otherwise blocks go through glBufferSubData
+    bool persistent = false;
+};
+
+// One uniform buffer split into a region per frame in flight. Blocks are copied into the current
+// frame's region and bound by range, so every program reads the same copy and nothing is sent per
+// program. A fence per region keeps a frame from overwriting data the GPU may still read.
+// GL thread only.
+class UniformRing {
+public:
+    static UniformRing& shared();
+
+    // Before the frame's first block; creates the buffer on first use
+    void beginFrame();
+    // Copies a block into the frame's region and binds it to binding. False when the region is full.
+    bool bind(GLuint binding, const void* data, size_t size);
+    template <typename Block>
+    bool bind(GLuint binding, const Block &block) {
+        return bind(binding, &block, sizeof(Block));
+    }
+    // After the frame's last draw that reads the blocks
+    void endFrame();
+
+    UniformRingStats stats() const { return ringStats; }
+
+    // Deletes the buffer and fences before the GL context goes away
+    void shutdown();
+
+private:
+    static const int FRAMES = 3;
+
+    GlBuffer buffer;
+    unsigned char* mapped = nullptr;
+    size_t regionSize = 0;
+    size_t alignment = 256;
+    int frame = 0;
+    size_t used = 0;
+    GLsync fences[FRAMES] = {};
+    UniformRingStats ringStats;
+
+    UniformRing() = default;
+    void create();
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "vertex_quantizer.h"
+
+#include <cstddef>
+
+// One attribute of a vertex format, as glVertexAttribPointer takes it
+template <GLuint Location, GLint Components, GLenum Type, GLboolean Normalized, size_t Offset>
+struct VertexAttribute {
+    static void setup(GLsizei stride, size_t base) {
+        glEnableVertexAttribArray(Location);
+        glVertexAttribPointer(Location, Components, Type, Normalized, stride, (void*)(base + Offset));
+    }
+};
+
+// Compile-time description of a vertex record and its attributes. setup() expands to the
+// attribute pointer calls for the record, with nothing decided at run time.
+template <typename Record, typename... Attributes>
+struct VertexFormat {
+    using VertexType = Record;
+    static constexpr GLsizei stride = sizeof(Record);
+
+    // Points every attribute at records starting base bytes into the bound array buffer
+    static void setup(size_t base = 0) { (Attributes::setup(stride, base), ...); }
+};
+
+using FullVertexFormat = VertexFormat<Vertex,
+    VertexAttribute<0, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Position)>,
+    VertexAttribute<1, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Normal)>,
+    VertexAttribute<2, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, TexCoords)>,
+    VertexAttribute<3, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Tangent)>,
+    VertexAttribute<4, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Bitangent)>>;
+
+using QuantizedVertexFormat = VertexFormat<QuantizedVertex,
+    VertexAttribute<0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(QuantizedVertex, position)>,
+    VertexAttribute<1, 2, GL_SHORT, GL_TRUE, offsetof(QuantizedVertex, normal)>,
+    VertexAttribute<2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(QuantizedVertex, texCoords)>>;
+
+// Quantized vertex with its tangent frame, for VertexLayoutSettings::tangentFrames
+struct QuantizedFramedVertex {
+    QuantizedVertex vertex;
+    QuantizedTangentFrame frame;
+};
+
+using QuantizedFramedVertexFormat = VertexFormat<QuantizedFramedVertex,
+    VertexAttribute<0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(QuantizedFramedVertex, vertex) + offsetof(QuantizedVertex, position)>,
+    VertexAttribute<1, 2, GL_SHORT, GL_TRUE, offsetof(QuantizedFramedVertex, vertex) + offsetof(QuantizedVertex, normal)>,
+    VertexAttribute<2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(QuantizedFramedVertex, vertex) + offsetof(QuantizedVertex, texCoords)>,
+    VertexAttribute<3, 4, GL_SHORT, GL_TRUE, offsetof(QuantizedFramedVertex, frame)>>;
+
+// Position-only streams for passes that read nothing but aPos
+using PositionFormat = VertexFormat<glm::vec3,
+    VertexAttribute<0, 3, GL_FLOAT, GL_FALSE, 0>>;
+
+using QuantizedPositionFormat = VertexFormat<QuantizedPosition,
+    VertexAttribute<0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 0>>;
+
+#endif
@@ -0,0 +1,192 @@
+#include "vertex_quantizer.h"
+#include "mesh.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const size_t VERTEX_GRAIN = 16384;
+
+// Smallest |w| a snorm16 quaternion keeps, so the handedness sign survives w == 0
+const float TANGENT_FRAME_MIN_W = 1.0f / 32767.0f;
+
+int16_t toSnorm16(float value) {
+    return static_cast<int16_t>(std::lround(std::max(-1.0f, std::min(1.0f, value)) * 32767.0f));
+}
+
+uint16_t toUnorm16(float value) {
+    return static_cast<uint16_t>(std::lround(std::max(0.0f, std::min(1.0f, value)) * 65535.0f));
+}
+
+glm::vec3 normalizeOr(const glm::vec3& v, const glm::vec3& fallback) {
+    float length = glm::length(v);
+    return length > 0.0f ? v / length : fallback;
+}
+
+} // namespace
+
+uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t exponent = (bits >> 23) & 0xFF;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    if (exponent == 0xFF)
+        return static_cast<uint16_t>(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+
+    int halfExponent = static_cast<int>(exponent) - 127 + 15;
+    if (halfExponent >= 31)
+        return static_cast<uint16_t>(sign | 0x7C00);
+    if (halfExponent <= 0) {
+        // Subnormal half, rounded to nearest even
+        if (halfExponent < -10)
+            return static_cast<uint16_t>(sign);
+        mantissa |= 0x800000;
+        uint32_t shift = static_cast<uint32_t>(14 - halfExponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1)))
+            half++;
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    // A carry out of the mantissa bumps the exponent, which is still the right rounding
+    uint32_t half = (static_cast<uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+    return static_cast<uint16_t>(sign | half);
+}
+
+float halfToFloat(uint16_t value) {
+    uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1F;
+    uint32_t mantissa = value & 0x3FF;
+    uint32_t bits;
+    if (exponent == 0x1F) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    } else if (exponent != 0) {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    } else {
+        float magnitude = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -magnitude : magnitude;
+    }
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+glm::vec2 encodeOctahedral(const glm::vec3& n) {
+    float sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (sum == 0.0f)
+        return glm::vec2(0.0f);
+    glm::vec2 e(n.x / sum, n.y / sum);
+    if (n.z < 0.0f) {
+        // Fold the lower hemisphere over the diagonals
+        glm::vec2 folded(1.0f - std::fabs(e.y), 1.0f - std::fabs(e.x));
+        e.x = e.x >= 0.0f ? folded.x : -folded.x;
+        e.y = e.y >= 0.0f ? folded.y : -folded.y;
+    }
+    return e;
+}
+
+glm::vec3 decodeOctahedral(const glm::vec2& e) {
+    // Same as the vertex shaders
+    glm::vec3 n(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+    float t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return normalizeOr(n, glm::vec3(0.0f, 0.0f, 1.0f));
+}
+
+void quantizeVertices(const Vertex* vertices, size_t count, const glm::vec3& boundsMin, const glm::vec3& boundsSize,
+                      QuantizedVertex* out, unsigned int threads) {
+    glm::vec3 inverseSize(boundsSize.x > 0.0f ? 1.0f / boundsSize.x : 0.0f,
+                          boundsSize.y > 0.0f ? 1.0f / boundsSize.y : 0.0f,
+                          boundsSize.z > 0.0f ? 1.0f / boundsSize.z : 0.0f);
+    ThreadPool::shared().parallelFor(count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const Vertex& v = vertices[i];
+            QuantizedVertex& q = out[i];
+            glm::vec3 p = (v.Position - boundsMin) * inverseSize;
+            q.position[0] = toUnorm16(p.x);
+            q.position[1] = toUnorm16(p.y);
+            q.position[2] = toUnorm16(p.z);
+            q.position[3] = 0;
+            glm::vec2 n = encodeOctahedral(v.Normal);
+            q.normal[0] = toSnorm16(n.x);
+            q.normal[1] = toSnorm16(n.y);
+            q.texCoords[0] = floatToHalf(v.TexCoords.x);
+            q.texCoords[1] = floatToHalf(v.TexCoords.y);
+        }
+    }, VERTEX_GRAIN, threads);
+}
+
+void dequantizeVertices(const unsigned char* records, size_t stride, size_t count, const glm::vec3& boundsMin,
+                        const glm::vec3& boundsSize, Vertex* out, unsigned int threads) {
+    ThreadPool::shared().parallelFor(count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            QuantizedVertex q;
+            memcpy(&q, records + i * stride, sizeof(q));
+            Vertex& v = out[i];
+            glm::vec3 p(q.position[0] / 65535.0f, q.position[1] / 65535.0f, q.position[2] / 65535.0f);
+            v.Position = boundsMin + p * boundsSize;
+            v.Normal = decodeOctahedral(glm::vec2(std::max(q.normal[0] / 32767.0f, -1.0f),
+                                                  std::max(q.normal[1] / 32767.0f, -1.0f)));
+            v.TexCoords = glm::vec2(halfToFloat(q.texCoords[0]), halfToFloat(q.texCoords[1]));
+            v.Tangent = glm::vec3(0.0f);
+            v.Bitangent = glm::vec3(0.0f);
+        }
+    }, VERTEX_GRAIN, threads);
+}
+
+void encodeTangentFrames(const Vertex* vertices, size_t count, QuantizedTangentFrame* out, unsigned int threads) {
+    ThreadPool::shared().parallelFor(count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const Vertex& v = vertices[i];
+            glm::vec3 n = normalizeOr(v.Normal, glm::vec3(0.0f, 0.0f, 1.0f));
+            glm::vec3 t = v.Tangent - n * glm::dot(n, v.Tangent);
+            if (glm::length(t) < 1e-6f)
+                t = std::fabs(n.x) < 0.9f ? glm::cross(n, glm::vec3(1.0f, 0.0f, 0.0f))
+                                          : glm::cross(n, glm::vec3(0.0f, 1.0f, 0.0f));
+            t = glm::normalize(t);
+            glm::vec3 b = glm::cross(n, t);
+            bool mirrored = glm::dot(b, v.Bitangent) < 0.0f;
+
+            // Quaternion of the rotation with columns (t, b, n)
+            glm::vec4 q;
+            float trace = t.x + b.y + n.z;
+            if (trace > 0.0f) {
+                float s = std::sqrt(trace + 1.0f) * 2.0f;
+                q = glm::vec4((b.z - n.y) / s, (n.x - t.z) / s, (t.y - b.x) / s, 0.25f * s);
+            } else if (t.x > b.y && t.x > n.z) {
+                float s = std::sqrt(1.0f + t.x - b.y - n.z) * 2.0f;
+                q = glm::vec4(0.25f * s, (b.x + t.y) / s, (n.x + t.z) / s, (b.z - n.y) / s);
+            } else if (b.y > n.z) {
+                float s = std::sqrt(1.0f + b.y - t.x - n.z) * 2.0f;
+                q = glm::vec4((b.x + t.y) / s, 0.25f * s, (n.y + b.z) / s, (n.x - t.z) / s);
+            } else {
+                float s = std::sqrt(1.0f + n.z - t.x - b.y) * 2.0f;
+                q = glm::vec4((n.x + t.z) / s, (n.y + b.z) / s, 0.25f * s, (t.y - b.x) / s);
+            }
+            q /= glm::length(q);
+
+            // q and -q are the same rotation: keep w positive, then let its sign carry the handedness
+            if (q.w < 0.0f)
+                q = -q;
+            if (q.w < TANGENT_FRAME_MIN_W) {
+                glm::vec3 xyz(q.x, q.y, q.z);
+                xyz *= std::sqrt(1.0f - TANGENT_FRAME_MIN_W * TANGENT_FRAME_MIN_W) / glm::length(xyz);
+                q = glm::vec4(xyz, TANGENT_FRAME_MIN_W);
+            }
+            if (mirrored)
+                q = -q;
+            for (int k = 0; k < 4; k++)
+                out[i].rotation[k] = toSnorm16(q[k]);
+        }
+    }, VERTEX_GRAIN, threads);
+}
@@ -0,0 +1,52 @@
+#ifndef VERTEX_QUANTIZER_H
+#define VERTEX_QUANTIZER_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+struct Vertex;
+
+// Compact GPU vertex written by Mesh::setupMesh when VertexLayoutSettings::quantize is set.
+// 16 bytes instead of the 56 of Vertex; the vertex shaders decode it.
+struct QuantizedVertex {
+    // unorm16 within the mesh bounds; the fourth keeps the normal 4-byte aligned
+    uint16_t position[4];
+    // snorm16 octahedral
+    int16_t normal[2];
+    // Half floats
+    uint16_t texCoords[2];
+};
+
+// Position-only stream of a quantized mesh, the same encoding as QuantizedVertex::position
+struct QuantizedPosition {
+    uint16_t position[4];
+};
+
+// Optional tangent frame: a snorm16 quaternion rotating +Z onto the normal and +X onto the
+// tangent. The sign of w holds the bitangent handedness.
+struct QuantizedTangentFrame {
+    int16_t rotation[4];
+};
+
+uint16_t floatToHalf(float value);
+float halfToFloat(uint16_t value);
+
+// Octahedral mapping of a unit vector onto [-1, 1]^2
+glm::vec2 encodeOctahedral(const glm::vec3& n);
+glm::vec3 decodeOctahedral(const glm::vec2& e);
+
+// Fills out for count vertices, with positions relative to boundsMin and scaled by boundsSize.
+// Runs on up to threads pool threads.
+void quantizeVertices(const Vertex* vertices, size_t count, const glm::vec3& boundsMin, const glm::vec3& boundsSize,
+                      QuantizedVertex* out, unsigned int threads = 0);
+
+// Inverse of quantizeVertices for records stride bytes apart (the quantized vertex may be part of
+// a bigger record). Tangents and bitangents are left at zero.
+void dequantizeVertices(const unsigned char* records, size_t stride, size_t count, const glm::vec3& boundsMin,
+                        const glm::vec3& boundsSize, Vertex* out, unsigned int threads = 0);
+
+void encodeTangentFrames(const Vertex* vertices, size_t count, QuantizedTangentFrame* out, unsigned int threads = 0);
+
+#endif